@@ -0,0 +1,251 @@
+#include "ChordMatcher.h"
+#include <algorithm>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace {
+    int lowestBit(std::uint64_t value)
+    {
+#ifdef _MSC_VER
+        unsigned long index = 0;
+        _BitScanForward64(&index, value);
+        return static_cast<int>(index);
+#else
+        return __builtin_ctzll(value);
+#endif
+    }
+
+    // True when every key of the chord is available, i.e. chord & ~available is empty
+    bool isSubset(const std::uint64_t *chord, const std::uint64_t *available)
+    {
+#if defined(__AVX2__)
+        const __m256i chordKeys = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(chord));
+        const __m256i availableKeys = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(available));
+        return _mm256_testc_si256(availableKeys, chordKeys) != 0;
+#else
+        return ((chord[0] & ~available[0]) | (chord[1] & ~available[1])
+                | (chord[2] & ~available[2]) | (chord[3] & ~available[3])) == 0;
+#endif
+    }
+}
+
+ChordMatcher::ChordMatcher()
+{
+    reset();
+}
+
+void ChordMatcher::reset()
+{
+    m_pressed.fill(0);
+    m_consumed.fill(0);
+    m_swallowUps.fill(0);
+    m_pending.fill(0);
+    m_pressNs.fill(0);
+    m_pendingMessages.fill(MidiBytes{});
+    m_pendingDeadlineNs.fill(0);
+    for (ActiveChord &chord : m_activeChords) {
+        chord.inUse = false;
+    }
+    m_outputCount = 0;
+}
+
+void ChordMatcher::process(const CompiledMappingTable &table, int vkCode, bool isKeyDown, bool isRepeat,
+                           std::int64_t timestampNs, const MidiBytes *keyMessage)
+{
+    m_outputCount = 0;
+
+    if (vkCode < 0 || vkCode >= KEY_COUNT) {
+        if (keyMessage) {
+            emitMessage(*keyMessage);
+        }
+        return;
+    }
+
+    if (isKeyDown) {
+        onKeyDown(table, vkCode, isRepeat, timestampNs, keyMessage);
+    } else {
+        onKeyUp(vkCode, keyMessage);
+    }
+}
+
+void ChordMatcher::onKeyDown(const CompiledMappingTable &table, int vkCode, bool isRepeat,
+                             std::int64_t timestampNs, const MidiBytes *keyMessage)
+{
+    if (isRepeat) {
+        // A key waiting on, or used by, a withholding chord stays silent until released
+        if (keyMessage && !testKey(m_pending, vkCode) && !testKey(m_swallowUps, vkCode)) {
+            emitMessage(*keyMessage);
+        }
+        return;
+    }
+
+    setKey(m_pressed, vkCode);
+    m_pressNs[vkCode] = timestampNs;
+
+    const CompiledChord *chord = findCompletedChord(table, vkCode, timestampNs);
+    if (chord) {
+        if (keyMessage && !(chord->flags & CompiledChord::WithholdKeys)) {
+            emitMessage(*keyMessage);
+        }
+        fireChord(*chord);
+        return;
+    }
+
+    if (!keyMessage) {
+        return;
+    }
+    if (table.withheldKeys.contains(vkCode) && table.chordWindowNs > 0) {
+        setKey(m_pending, vkCode);
+        m_pendingMessages[vkCode] = *keyMessage;
+        m_pendingDeadlineNs[vkCode] = timestampNs + table.chordWindowNs;
+        return;
+    }
+    emitMessage(*keyMessage);
+}
+
+void ChordMatcher::onKeyUp(int vkCode, const MidiBytes *keyMessage)
+{
+    clearKey(m_pressed, vkCode);
+
+    // Released before any chord completed: the withheld press goes out late rather than never
+    if (testKey(m_pending, vkCode)) {
+        clearKey(m_pending, vkCode);
+        emitMessage(m_pendingMessages[vkCode]);
+    }
+
+    if (testKey(m_consumed, vkCode)) {
+        clearKey(m_consumed, vkCode);
+        for (ActiveChord &active : m_activeChords) {
+            if (active.inUse && testKey(active.keys, vkCode)) {
+                if (active.hasRelease) {
+                    emitMessage(active.releaseMessage);
+                }
+                active.inUse = false;
+                break;
+            }
+        }
+    }
+
+    if (testKey(m_swallowUps, vkCode)) {
+        clearKey(m_swallowUps, vkCode);
+        return;
+    }
+    if (keyMessage) {
+        emitMessage(*keyMessage);
+    }
+}
+
+const CompiledChord *ChordMatcher::findCompletedChord(const CompiledMappingTable &table, int vkCode,
+                                                      std::int64_t timestampNs) const
+{
+    const std::uint32_t begin = table.chordStart[vkCode];
+    const std::uint32_t end = table.chordStart[vkCode + 1];
+    if (begin == end) {
+        return nullptr;
+    }
+
+    alignas(32) KeyWords available;
+    for (std::size_t i = 0; i < available.size(); ++i) {
+        available[i] = m_pressed[i] & ~m_consumed[i];
+    }
+
+    const std::int64_t earliestNs = timestampNs - table.chordWindowNs;
+    for (std::uint32_t index = begin; index < end; ++index) {
+        const CompiledChord &chord = table.chordsByKey[index];
+        if (!isSubset(chord.keys.data(), available.data())) {
+            continue;
+        }
+
+        bool withinWindow = true;
+        for (std::size_t word = 0; word < chord.keys.size() && withinWindow; ++word) {
+            for (std::uint64_t bits = chord.keys[word]; bits != 0; bits &= bits - 1) {
+                if (m_pressNs[word * 64 + lowestBit(bits)] < earliestNs) {
+                    withinWindow = false;
+                    break;
+                }
+            }
+        }
+        if (withinWindow) {
+            return &chord;
+        }
+    }
+    return nullptr;
+}
+
+void ChordMatcher::fireChord(const CompiledChord &chord)
+{
+    const bool withhold = (chord.flags & CompiledChord::WithholdKeys) != 0;
+    for (std::size_t word = 0; word < chord.keys.size(); ++word) {
+        m_consumed[word] |= chord.keys[word];
+        if (withhold) {
+            m_pending[word] &= ~chord.keys[word];
+            m_swallowUps[word] |= chord.keys[word];
+        }
+    }
+
+    emitMessage(chord.messages[1]);
+
+    // With every slot taken the chord still fires, it just sends no release message
+    for (ActiveChord &active : m_activeChords) {
+        if (!active.inUse) {
+            active.keys = chord.keys;
+            active.releaseMessage = chord.messages[0];
+            active.hasRelease = (chord.flags & CompiledChord::KeyUpEnabled) != 0;
+            active.inUse = true;
+            break;
+        }
+    }
+}
+
+void ChordMatcher::expire(std::int64_t nowNs)
+{
+    m_outputCount = 0;
+
+    for (std::size_t word = 0; word < m_pending.size(); ++word) {
+        for (std::uint64_t bits = m_pending[word]; bits != 0; bits &= bits - 1) {
+            const int vkCode = static_cast<int>(word * 64) + lowestBit(bits);
+            if (m_pendingDeadlineNs[vkCode] <= nowNs) {
+                clearKey(m_pending, vkCode);
+                emitMessage(m_pendingMessages[vkCode]);
+            }
+        }
+    }
+}
+
+std::int64_t ChordMatcher::nextDeadlineNs() const
+{
+    std::int64_t deadlineNs = NO_DEADLINE;
+    for (std::size_t word = 0; word < m_pending.size(); ++word) {
+        for (std::uint64_t bits = m_pending[word]; bits != 0; bits &= bits - 1) {
+            const int vkCode = static_cast<int>(word * 64) + lowestBit(bits);
+            deadlineNs = std::min(deadlineNs, m_pendingDeadlineNs[vkCode]);
+        }
+    }
+    return deadlineNs;
+}
+
+void ChordMatcher::emitMessage(const MidiBytes &message)
+{
+    if (m_outputCount < static_cast<int>(m_output.size())) {
+        m_output[m_outputCount++] = message;
+    }
+}
+
+bool ChordMatcher::testKey(const KeyWords &words, int vkCode)
+{
+    return (words[vkCode >> 6] & (std::uint64_t(1) << (vkCode & 63))) != 0;
+}
+
+void ChordMatcher::setKey(KeyWords &words, int vkCode)
+{
+    words[vkCode >> 6] |= std::uint64_t(1) << (vkCode & 63);
+}
+
+void ChordMatcher::clearKey(KeyWords &words, int vkCode)
+{
+    words[vkCode >> 6] &= ~(std::uint64_t(1) << (vkCode & 63));
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include "CompiledMappingTable.h"
+
+// Chord detection for the dispatcher thread. Each key event passes through with the
+// message its own mapping produced; the matcher adds chord messages, holds back the
+// messages of keys in withholding chords for the chord window, and drops them when
+// the chord completes. Single-threaded and allocation-free.
+class ChordMatcher
+{
+public:
+    static constexpr int KEY_COUNT = KeyMask::KEY_COUNT;
+    static constexpr int MAX_ACTIVE_CHORDS = 16;
+    static constexpr std::int64_t NO_DEADLINE = INT64_MAX;
+
+    ChordMatcher();
+
+    // keyMessage is the key's own mapping output, or null. The messages to send are
+    // available from messages() until the next call.
+    void process(const CompiledMappingTable &table, int vkCode, bool isKeyDown, bool isRepeat,
+                 std::int64_t timestampNs, const MidiBytes *keyMessage);
+
+    // Releases withheld messages whose chord window ended by nowNs
+    void expire(std::int64_t nowNs);
+
+    // When expire() next has work to do
+    std::int64_t nextDeadlineNs() const;
+
+    const MidiBytes *messages() const { return m_output.data(); }
+    int messageCount() const { return m_outputCount; }
+
+    void reset();
+
+private:
+    using KeyWords = std::array<std::uint64_t, KEY_COUNT / 64>;
+
+    struct ActiveChord {
+        KeyWords keys;
+        MidiBytes releaseMessage;
+        bool hasRelease;
+        bool inUse;
+    };
+
+    void onKeyDown(const CompiledMappingTable &table, int vkCode, bool isRepeat, std::int64_t timestampNs,
+                   const MidiBytes *keyMessage);
+    void onKeyUp(int vkCode, const MidiBytes *keyMessage);
+    const CompiledChord *findCompletedChord(const CompiledMappingTable &table, int vkCode,
+                                            std::int64_t timestampNs) const;
+    void fireChord(const CompiledChord &chord);
+    void emitMessage(const MidiBytes &message);
+
+    static bool testKey(const KeyWords &words, int vkCode);
+    static void setKey(KeyWords &words, int vkCode);
+    static void clearKey(KeyWords &words, int vkCode);
+
+    alignas(32) KeyWords m_pressed;
+    KeyWords m_consumed;      // Pressed keys already used by a fired chord
+    KeyWords m_swallowUps;    // Keys whose own key-up belongs to a withholding chord
+    KeyWords m_pending;       // Keys whose own key-down message is being withheld
+    std::array<std::int64_t, KEY_COUNT> m_pressNs;
+    std::array<MidiBytes, KEY_COUNT> m_pendingMessages;
+    std::array<std::int64_t, KEY_COUNT> m_pendingDeadlineNs;
+    std::array<ActiveChord, MAX_ACTIVE_CHORDS> m_activeChords;
+    std::array<MidiBytes, KEY_COUNT + 4> m_output;
+    int m_outputCount;
+};
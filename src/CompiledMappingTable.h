@@ -0,0 +1,109 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+#include "KeyBitset.h"
+#include "MidiEngine.h"
+
+struct CompiledMapping {
+    enum Flags : std::uint8_t {
+        KeyUpEnabled   = 0x01,
+        KeyDownEnabled = 0x02,
+        FilterRepeats  = 0x04,
+        HoldEnabled    = 0x08
+    };
+
+    MidiBytes messages[2];
+    std::uint8_t flags;
+    std::uint8_t reserved;
+    MidiBytes holdMessage;
+    std::uint16_t holdThresholdMs;
+
+    CompiledMapping() : messages{}, flags(0), reserved(0), holdMessage{}, holdThresholdMs(0) {}
+};
+
+// A chord as one 256-bit key set, so matching is a single subset test
+struct alignas(32) CompiledChord {
+    enum Flags : std::uint8_t {
+        KeyUpEnabled = 0x01,
+        WithholdKeys = 0x02
+    };
+
+    std::array<std::uint64_t, KeyMask::KEY_COUNT / 64> keys;
+    MidiBytes messages[2];
+    std::uint8_t flags;
+    std::uint8_t keyCount;
+
+    CompiledChord() : keys{}, messages{}, flags(0), keyCount(0) {}
+};
+
+// One state of the sequence trie, reached after the keys that lead to it
+struct CompiledSequenceNode {
+    static constexpr int MAX_STEPS = 7;
+    static constexpr int MAX_MESSAGES = 16;
+
+    enum Flags : std::uint8_t {
+        Accepting   = 0x01,
+        HasChildren = 0x02
+    };
+
+    std::int64_t timeoutNs;         // How long the next step may take
+    std::uint32_t messageStart;     // Burst sent when a sequence ends here
+    std::uint8_t messageCount;
+    std::uint8_t depth;
+    std::uint8_t flags;
+
+    CompiledSequenceNode() : timeoutNs(0), messageStart(0), messageCount(0), depth(0), flags(0) {}
+};
+
+// One step of a macro, due offsetUs after the key press
+struct CompiledMacroEvent {
+    std::uint32_t offsetUs;
+    MidiBytes message;
+
+    CompiledMacroEvent() : offsetUs(0), message{} {}
+};
+
+struct CompiledMacro {
+    static constexpr int MAX_EVENTS = 128;
+
+    enum Flags : std::uint8_t {
+        CancelOnRelease = 0x01
+    };
+
+    std::uint32_t eventStart;   // Events are macroEvents[eventStart] onwards, in time order
+    std::uint16_t eventCount;
+    std::uint8_t flags;
+
+    CompiledMacro() : eventStart(0), eventCount(0), flags(0) {}
+};
+
+struct alignas(64) CompiledMappingTable {
+    static constexpr int SLOT_COUNT = 256;
+
+    // Unique per published table for the life of the process; 0 until published.
+    // Unlike the address, which a new table can reuse, it tells tables apart.
+    std::uint64_t generation;
+
+    std::array<CompiledMapping, SLOT_COUNT> mappings;
+
+    // Chords containing key k are chordsByKey[chordStart[k]] up to chordStart[k + 1],
+    // largest first, so a key press only scans the chords it can complete
+    std::vector<CompiledChord> chordsByKey;
+    std::array<std::uint32_t, SLOT_COUNT + 1> chordStart;
+    KeyMask withheldKeys;
+    std::int64_t chordWindowNs;
+
+    // Sequence trie as a dense state table: pressing key k in state s moves to
+    // sequenceTransitions[s * SLOT_COUNT + k]. State 0 is the root and also means
+    // "no transition", since no key leads back to it.
+    std::vector<std::uint16_t> sequenceTransitions;
+    std::vector<CompiledSequenceNode> sequenceNodes;
+    std::vector<MidiBytes> sequenceMessages;
+
+    std::array<CompiledMacro, SLOT_COUNT> macros;
+    std::vector<CompiledMacroEvent> macroEvents;
+
+    CompiledMappingTable() : generation(0), chordStart{}, chordWindowNs(0) {}
+};
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <QMutex>
+#include <QMutexLocker>
+#include <cstdint>
+
+// Lets one error through per interval and counts the rest, so a failure that repeats
+// on every key press produces an occasional notification instead of a flood.
+class ErrorRateLimiter
+{
+public:
+    explicit ErrorRateLimiter(std::int64_t intervalNs)
+        : m_intervalNs(intervalNs)
+        , m_lastReportNs(0)
+        , m_hasReported(false)
+        , m_suppressed(0)
+    {
+    }
+
+    // On true, suppressedCount receives how many errors were swallowed since the last report
+    bool allow(std::int64_t nowNs, int &suppressedCount)
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_hasReported && nowNs - m_lastReportNs < m_intervalNs) {
+            ++m_suppressed;
+            return false;
+        }
+
+        suppressedCount = m_suppressed;
+        m_suppressed = 0;
+        m_lastReportNs = nowNs;
+        m_hasReported = true;
+        return true;
+    }
+
+    void reset()
+    {
+        QMutexLocker locker(&m_mutex);
+        m_hasReported = false;
+        m_suppressed = 0;
+    }
+
+private:
+    QMutex m_mutex;
+    std::int64_t m_intervalNs;
+    std::int64_t m_lastReportNs;
+    bool m_hasReported;
+    int m_suppressed;
+};
@@ -0,0 +1,534 @@
+#include "EvdevInputSource.h"
+#include "KeyEvent.h"
+#include "KeyEventDispatcher.h"
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QThread>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <linux/uinput.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+    constexpr int MAX_EPOLL_EVENTS = 16;
+    constexpr int GRAB_RELEASE_WAIT_MS = 1000;
+    constexpr int GRAB_RELEASE_POLL_MS = 10;
+    constexpr const char* PASSTHROUGH_DEVICE_NAME = "KtoMIDI passthrough";
+
+    struct KeyCodePair {
+        int evdevCode;
+        int vkCode;
+    };
+
+    constexpr KeyCodePair KEY_CODE_PAIRS[] = {
+        {KEY_ESC, 0x1B}, {KEY_BACKSPACE, 0x08}, {KEY_TAB, 0x09}, {KEY_ENTER, 0x0D},
+        {KEY_SPACE, 0x20}, {KEY_CAPSLOCK, 0x14},
+        {KEY_1, 0x31}, {KEY_2, 0x32}, {KEY_3, 0x33}, {KEY_4, 0x34}, {KEY_5, 0x35},
+        {KEY_6, 0x36}, {KEY_7, 0x37}, {KEY_8, 0x38}, {KEY_9, 0x39}, {KEY_0, 0x30},
+        {KEY_A, 0x41}, {KEY_B, 0x42}, {KEY_C, 0x43}, {KEY_D, 0x44}, {KEY_E, 0x45},
+        {KEY_F, 0x46}, {KEY_G, 0x47}, {KEY_H, 0x48}, {KEY_I, 0x49}, {KEY_J, 0x4A},
+        {KEY_K, 0x4B}, {KEY_L, 0x4C}, {KEY_M, 0x4D}, {KEY_N, 0x4E}, {KEY_O, 0x4F},
+        {KEY_P, 0x50}, {KEY_Q, 0x51}, {KEY_R, 0x52}, {KEY_S, 0x53}, {KEY_T, 0x54},
+        {KEY_U, 0x55}, {KEY_V, 0x56}, {KEY_W, 0x57}, {KEY_X, 0x58}, {KEY_Y, 0x59},
+        {KEY_Z, 0x5A},
+        {KEY_MINUS, 0xBD}, {KEY_EQUAL, 0xBB}, {KEY_LEFTBRACE, 0xDB}, {KEY_RIGHTBRACE, 0xDD},
+        {KEY_SEMICOLON, 0xBA}, {KEY_APOSTROPHE, 0xDE}, {KEY_GRAVE, 0xC0}, {KEY_BACKSLASH, 0xDC},
+        {KEY_COMMA, 0xBC}, {KEY_DOT, 0xBE}, {KEY_SLASH, 0xBF}, {KEY_102ND, 0xE2},
+        {KEY_LEFTSHIFT, 0xA0}, {KEY_RIGHTSHIFT, 0xA1}, {KEY_LEFTCTRL, 0xA2}, {KEY_RIGHTCTRL, 0xA3},
+        {KEY_LEFTALT, 0xA4}, {KEY_RIGHTALT, 0xA5}, {KEY_LEFTMETA, 0x5B}, {KEY_RIGHTMETA, 0x5C},
+        {KEY_COMPOSE, 0x5D},
+        {KEY_F1, 0x70}, {KEY_F2, 0x71}, {KEY_F3, 0x72}, {KEY_F4, 0x73}, {KEY_F5, 0x74},
+        {KEY_F6, 0x75}, {KEY_F7, 0x76}, {KEY_F8, 0x77}, {KEY_F9, 0x78}, {KEY_F10, 0x79},
+        {KEY_F11, 0x7A}, {KEY_F12, 0x7B}, {KEY_F13, 0x7C}, {KEY_F14, 0x7D}, {KEY_F15, 0x7E},
+        {KEY_F16, 0x7F}, {KEY_F17, 0x80}, {KEY_F18, 0x81}, {KEY_F19, 0x82}, {KEY_F20, 0x83},
+        {KEY_F21, 0x84}, {KEY_F22, 0x85}, {KEY_F23, 0x86}, {KEY_F24, 0x87},
+        {KEY_SYSRQ, 0x2C}, {KEY_SCROLLLOCK, 0x91}, {KEY_PAUSE, 0x13},
+        {KEY_INSERT, 0x2D}, {KEY_DELETE, 0x2E}, {KEY_HOME, 0x24}, {KEY_END, 0x23},
+        {KEY_PAGEUP, 0x21}, {KEY_PAGEDOWN, 0x22},
+        {KEY_LEFT, 0x25}, {KEY_UP, 0x26}, {KEY_RIGHT, 0x27}, {KEY_DOWN, 0x28},
+        {KEY_NUMLOCK, 0x90}, {KEY_KPSLASH, 0x6F}, {KEY_KPASTERISK, 0x6A}, {KEY_KPMINUS, 0x6D},
+        {KEY_KPPLUS, 0x6B}, {KEY_KPENTER, 0x0D}, {KEY_KPDOT, 0x6E},
+        {KEY_KP0, 0x60}, {KEY_KP1, 0x61}, {KEY_KP2, 0x62}, {KEY_KP3, 0x63}, {KEY_KP4, 0x64},
+        {KEY_KP5, 0x65}, {KEY_KP6, 0x66}, {KEY_KP7, 0x67}, {KEY_KP8, 0x68}, {KEY_KP9, 0x69},
+        {KEY_MUTE, 0xAD}, {KEY_VOLUMEDOWN, 0xAE}, {KEY_VOLUMEUP, 0xAF},
+        {KEY_NEXTSONG, 0xB0}, {KEY_PREVIOUSSONG, 0xB1}, {KEY_STOPCD, 0xB2}, {KEY_PLAYPAUSE, 0xB3},
+    };
+
+    struct KeyCodeTable {
+        std::array<std::uint8_t, KEY_MAX + 1> vkCodes{};
+
+        KeyCodeTable()
+        {
+            for (const KeyCodePair &pair : KEY_CODE_PAIRS) {
+                vkCodes[pair.evdevCode] = static_cast<std::uint8_t>(pair.vkCode);
+            }
+        }
+    };
+
+    const KeyCodeTable &keyCodeTable()
+    {
+        static const KeyCodeTable table;
+        return table;
+    }
+
+    bool testBit(const unsigned long *bits, int bit)
+    {
+        constexpr int BITS_PER_LONG = sizeof(unsigned long) * 8;
+        return (bits[bit / BITS_PER_LONG] >> (bit % BITS_PER_LONG)) & 1UL;
+    }
+
+    using KeyBits = unsigned long[KEY_MAX / (sizeof(unsigned long) * 8) + 1];
+
+    bool anyKeyHeld(int fd)
+    {
+        KeyBits state = {};
+        if (ioctl(fd, EVIOCGKEY(sizeof(state)), state) < 0) {
+            return false;
+        }
+        for (unsigned long word : state) {
+            if (word != 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool isKeyboard(const QString &path)
+    {
+        const int fd = ::open(QFile::encodeName(path).constData(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        if (fd < 0) {
+            return false;
+        }
+
+        KeyBits keyBits = {};
+        const bool hasKeys = ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(keyBits)), keyBits) >= 0;
+        ::close(fd);
+
+        return hasKeys && testBit(keyBits, KEY_A) && testBit(keyBits, KEY_Z) && testBit(keyBits, KEY_SPACE);
+    }
+}
+
+EvdevInputSource::EvdevInputSource(const QStringList &paths, QObject *parent)
+    : InputSource(parent)
+    , m_paths(paths)
+    , m_epollFd(-1)
+    , m_wakeFd(-1)
+    , m_passthroughFd(-1)
+    , m_exclusiveGrab(false)
+    , m_running(false)
+    , m_dispatcher(nullptr)
+{
+}
+
+EvdevInputSource::~EvdevInputSource()
+{
+    stop();
+}
+
+QStringList EvdevInputSource::detectKeyboards()
+{
+    QStringList keyboards;
+    const QDir inputDir("/dev/input");
+    const QStringList entries = inputDir.entryList({"event*"}, QDir::System, QDir::Name);
+    for (const QString &entry : entries) {
+        const QString path = inputDir.absoluteFilePath(entry);
+        if (isKeyboard(path)) {
+            keyboards.append(path);
+        }
+    }
+    return keyboards;
+}
+
+int EvdevInputSource::virtualKeyFromEvdev(int code)
+{
+    if (code < 0 || code > KEY_MAX) {
+        return 0;
+    }
+    return keyCodeTable().vkCodes[code];
+}
+
+bool EvdevInputSource::start()
+{
+    if (m_running) {
+        return true;
+    }
+    stop();
+
+    const QStringList paths = m_paths.isEmpty() ? detectKeyboards() : m_paths;
+    if (paths.isEmpty()) {
+        qCritical() << "No keyboard input devices found under /dev/input";
+        return false;
+    }
+
+    m_epollFd = epoll_create1(EPOLL_CLOEXEC);
+    m_wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_epollFd < 0 || m_wakeFd < 0) {
+        qCritical() << "Failed to create evdev poll set:" << strerror(errno);
+        closeDevices();
+        return false;
+    }
+
+    epoll_event wakeEvent{};
+    wakeEvent.events = EPOLLIN;
+    wakeEvent.data.ptr = nullptr;
+    epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_wakeFd, &wakeEvent);
+
+    for (const QString &path : paths) {
+        if (!openDevice(path)) {
+            closeDevices();
+            return false;
+        }
+    }
+
+    if (m_exclusiveGrab) {
+        if (!openPassthroughDevice()) {
+            closeDevices();
+            return false;
+        }
+        for (const std::unique_ptr<Device> &device : m_devices) {
+            if (device->isLiveDevice && !grabDevice(*device)) {
+                closeDevices();
+                return false;
+            }
+        }
+    }
+
+    m_captureFilter.resetPressedKeys();
+    m_running = true;
+    m_captureThread.reset(QThread::create([this] { run(); }));
+    m_captureThread->setObjectName("EvdevCapture");
+    m_captureThread->start(QThread::TimeCriticalPriority);
+    return true;
+}
+
+void EvdevInputSource::stop()
+{
+    if (m_captureThread) {
+        m_running = false;
+        const std::uint64_t wake = 1;
+        if (::write(m_wakeFd, &wake, sizeof(wake)) < 0) {
+            qWarning() << "Failed to wake evdev capture thread:" << strerror(errno);
+        }
+        m_captureThread->wait();
+        m_captureThread.reset();
+        emit captureStopped();
+    }
+
+    m_running = false;
+    closeDevices();
+}
+
+bool EvdevInputSource::isRunning() const
+{
+    return m_running.load(std::memory_order_acquire);
+}
+
+void EvdevInputSource::setSuppressedRepeatKeys(const QSet<int> &vkCodes)
+{
+    m_captureFilter.setSuppressedRepeatKeys(vkCodes);
+}
+
+void EvdevInputSource::setConsumedKeys(const QSet<int> &vkCodes)
+{
+    m_captureFilter.setConsumedKeys(vkCodes);
+}
+
+void EvdevInputSource::setExclusiveGrab(bool grab)
+{
+    m_exclusiveGrab = grab;
+}
+
+void EvdevInputSource::setDispatcher(KeyEventDispatcher *dispatcher)
+{
+    m_dispatcher.store(dispatcher, std::memory_order_release);
+}
+
+bool EvdevInputSource::openDevice(const QString &path)
+{
+    const QByteArray nativePath = QFile::encodeName(path);
+
+    struct stat info;
+    if (::stat(nativePath.constData(), &info) < 0) {
+        qCritical() << "Cannot access input source" << path << ":" << strerror(errno);
+        return false;
+    }
+
+    auto device = std::make_unique<Device>();
+    device->path = path;
+    device->isRegularFile = S_ISREG(info.st_mode);
+
+    // Pipes are opened non-blocking so a missing writer does not stall start()
+    const int flags = O_RDONLY | O_CLOEXEC | (device->isRegularFile ? 0 : O_NONBLOCK);
+    device->fd = ::open(nativePath.constData(), flags);
+    if (device->fd < 0) {
+        qCritical() << "Failed to open input source" << path << ":" << strerror(errno);
+        return false;
+    }
+
+    if (S_ISCHR(info.st_mode)) {
+        device->isLiveDevice = true;
+        // Kernel timestamps then share a clock with EngineClock, so capture latency includes the kernel hop
+        int clockId = CLOCK_MONOTONIC;
+        if (ioctl(device->fd, EVIOCSCLOCKID, &clockId) == 0) {
+            device->monotonicTimestamps = true;
+        } else {
+            qWarning() << "Failed to select monotonic clock for" << path << ":" << strerror(errno);
+        }
+    }
+
+    if (!device->isRegularFile) {
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.ptr = device.get();
+        if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, device->fd, &event) < 0) {
+            qCritical() << "Failed to poll input source" << path << ":" << strerror(errno);
+            ::close(device->fd);
+            return false;
+        }
+    }
+
+    m_devices.push_back(std::move(device));
+    return true;
+}
+
+bool EvdevInputSource::openPassthroughDevice()
+{
+    m_passthroughFd = ::open("/dev/uinput", O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+    if (m_passthroughFd < 0) {
+        qCritical() << "Failed to open /dev/uinput for key passthrough:" << strerror(errno);
+        return false;
+    }
+
+    ioctl(m_passthroughFd, UI_SET_EVBIT, EV_SYN);
+    ioctl(m_passthroughFd, UI_SET_EVBIT, EV_KEY);
+    ioctl(m_passthroughFd, UI_SET_EVBIT, EV_MSC);
+    ioctl(m_passthroughFd, UI_SET_MSCBIT, MSC_SCAN);
+
+    // Advertise the union of the grabbed devices' keys so the passthrough looks like them
+    KeyBits keyBits = {};
+    for (const std::unique_ptr<Device> &device : m_devices) {
+        KeyBits deviceBits = {};
+        if (device->isLiveDevice && ioctl(device->fd, EVIOCGBIT(EV_KEY, sizeof(deviceBits)), deviceBits) >= 0) {
+            for (std::size_t i = 0; i < sizeof(keyBits) / sizeof(keyBits[0]); ++i) {
+                keyBits[i] |= deviceBits[i];
+            }
+        }
+    }
+    for (int code = 0; code <= KEY_MAX; ++code) {
+        if (testBit(keyBits, code)) {
+            ioctl(m_passthroughFd, UI_SET_KEYBIT, code);
+        }
+    }
+
+    uinput_setup setup{};
+    setup.id.bustype = BUS_VIRTUAL;
+    std::strncpy(setup.name, PASSTHROUGH_DEVICE_NAME, UINPUT_MAX_NAME_SIZE - 1);
+
+    if (ioctl(m_passthroughFd, UI_DEV_SETUP, &setup) < 0 || ioctl(m_passthroughFd, UI_DEV_CREATE) < 0) {
+        qCritical() << "Failed to create uinput passthrough device:" << strerror(errno);
+        ::close(m_passthroughFd);
+        m_passthroughFd = -1;
+        return false;
+    }
+    return true;
+}
+
+bool EvdevInputSource::grabDevice(Device &device)
+{
+    // Grabbing while a key is down would strand its release on the other side of the grab
+    for (int waited = 0; waited < GRAB_RELEASE_WAIT_MS && anyKeyHeld(device.fd); waited += GRAB_RELEASE_POLL_MS) {
+        QThread::msleep(GRAB_RELEASE_POLL_MS);
+    }
+
+    if (ioctl(device.fd, EVIOCGRAB, 1) < 0) {
+        qCritical() << "Failed to grab" << device.path << ":" << strerror(errno);
+        return false;
+    }
+
+    device.grabbed = true;
+    return true;
+}
+
+void EvdevInputSource::closeDevices()
+{
+    for (const std::unique_ptr<Device> &device : m_devices) {
+        if (device->fd >= 0) {
+            ::close(device->fd);
+        }
+    }
+    m_devices.clear();
+
+    if (m_passthroughFd >= 0) {
+        ioctl(m_passthroughFd, UI_DEV_DESTROY);
+        ::close(m_passthroughFd);
+        m_passthroughFd = -1;
+    }
+    if (m_wakeFd >= 0) {
+        ::close(m_wakeFd);
+        m_wakeFd = -1;
+    }
+    if (m_epollFd >= 0) {
+        ::close(m_epollFd);
+        m_epollFd = -1;
+    }
+}
+
+void EvdevInputSource::run()
+{
+    int openStreams = 0;
+
+    for (const std::unique_ptr<Device> &device : m_devices) {
+        if (device->isRegularFile) {
+            readRegularFile(*device);
+        } else {
+            ++openStreams;
+        }
+    }
+
+    epoll_event events[MAX_EPOLL_EVENTS];
+
+    while (openStreams > 0 && m_running.load(std::memory_order_acquire)) {
+        const int ready = epoll_wait(m_epollFd, events, MAX_EPOLL_EVENTS, -1);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            qCritical() << "evdev poll failed:" << strerror(errno);
+            break;
+        }
+
+        for (int i = 0; i < ready; ++i) {
+            Device *device = static_cast<Device*>(events[i].data.ptr);
+            if (device == nullptr) {
+                continue;
+            }
+
+            if (!readAvailable(*device)) {
+                epoll_ctl(m_epollFd, EPOLL_CTL_DEL, device->fd, nullptr);
+                ::close(device->fd);
+                device->fd = -1;
+                --openStreams;
+            }
+        }
+    }
+
+    if (m_running.exchange(false)) {
+        emit finished();
+    }
+}
+
+void EvdevInputSource::readRegularFile(Device &device)
+{
+    while (m_running.load(std::memory_order_acquire)) {
+        const ssize_t count = ::read(device.fd, device.buffer.data() + device.buffered,
+                                     device.buffer.size() - device.buffered);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            if (count < 0) {
+                qWarning() << "Failed to read" << device.path << ":" << strerror(errno);
+            }
+            break;
+        }
+
+        device.buffered += static_cast<std::size_t>(count);
+        consumeBuffer(device);
+    }
+
+    ::close(device.fd);
+    device.fd = -1;
+}
+
+bool EvdevInputSource::readAvailable(Device &device)
+{
+    for (;;) {
+        const ssize_t count = ::read(device.fd, device.buffer.data() + device.buffered,
+                                     device.buffer.size() - device.buffered);
+        if (count > 0) {
+            device.buffered += static_cast<std::size_t>(count);
+            consumeBuffer(device);
+            continue;
+        }
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count < 0 && errno == EAGAIN) {
+            return true;
+        }
+
+        if (count < 0) {
+            qWarning() << "Input source" << device.path << "failed:" << strerror(errno);
+        }
+        return false;
+    }
+}
+
+void EvdevInputSource::consumeBuffer(Device &device)
+{
+    const std::size_t complete = device.buffered / sizeof(input_event);
+    std::array<input_event, READ_BATCH_EVENTS> forwarded;
+    std::size_t forwardedCount = 0;
+
+    for (std::size_t i = 0; i < complete; ++i) {
+        input_event event;
+        std::memcpy(&event, device.buffer.data() + i * sizeof(input_event), sizeof(input_event));
+        if (processEvent(event, device) && device.grabbed) {
+            forwarded[forwardedCount++] = event;
+        }
+    }
+
+    if (forwardedCount > 0) {
+        const std::size_t bytes = forwardedCount * sizeof(input_event);
+        if (::write(m_passthroughFd, forwarded.data(), bytes) != static_cast<ssize_t>(bytes)) {
+            qWarning() << "Failed to forward input from" << device.path << ":" << strerror(errno);
+        }
+    }
+
+    // Pipes may split a record across reads; keep the tail for the next batch
+    const std::size_t consumed = complete * sizeof(input_event);
+    device.buffered -= consumed;
+    if (device.buffered > 0) {
+        std::memmove(device.buffer.data(), device.buffer.data() + consumed, device.buffered);
+    }
+}
+
+bool EvdevInputSource::processEvent(const input_event &event, const Device &device)
+{
+    if (event.type != EV_KEY) {
+        return true;
+    }
+
+    const int vkCode = virtualKeyFromEvdev(event.code);
+    if (vkCode == 0) {
+        return true;
+    }
+
+    // Value 2 (autorepeat) follows a press, so the pressed-key state already reports it as a repeat
+    const bool isKeyDown = event.value != 0;
+    const KeyCaptureFilter::Decision decision = m_captureFilter.onKey(vkCode, isKeyDown);
+
+    const std::int64_t eventTimeNs = static_cast<std::int64_t>(event.input_event_sec) * 1000000000
+                                   + static_cast<std::int64_t>(event.input_event_usec) * 1000;
+
+    KeyEvent keyEvent(vkCode, isKeyDown, decision.isRepeat, static_cast<std::uint32_t>(eventTimeNs / 1000000));
+    if (device.monotonicTimestamps) {
+        keyEvent.timestampNs = eventTimeNs;
+    }
+
+    // Only live devices can lose events under load; recordings and pipes wait for queue space
+    const KeyEventDispatcher::PostMode mode = device.isLiveDevice
+        ? KeyEventDispatcher::DropWhenFull : KeyEventDispatcher::WaitWhenFull;
+    if (KeyEventDispatcher *dispatcher = m_dispatcher.load(std::memory_order_acquire)) {
+        dispatcher->postEvent(keyEvent, mode);
+    }
+
+    return !decision.suppress;
+}
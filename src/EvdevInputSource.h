@@ -0,0 +1,83 @@
+#pragma once
+
+#include "InputSource.h"
+#include "KeyCaptureFilter.h"
+#include <QString>
+#include <QStringList>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <linux/input.h>
+#include <memory>
+#include <vector>
+
+class QThread;
+
+// Linux evdev backend. Reads struct input_event records from /dev/input/event* devices,
+// named pipes or recorded event files and translates evdev key codes to virtual-key codes.
+// With an exclusive grab, device input is re-emitted through a uinput passthrough device
+// minus consumed keys and suppressed repeats, mirroring what KeyHook swallows on Windows.
+class EvdevInputSource : public InputSource
+{
+    Q_OBJECT
+
+public:
+    // An empty path list selects every keyboard found under /dev/input
+    explicit EvdevInputSource(const QStringList &paths = QStringList(), QObject *parent = nullptr);
+    ~EvdevInputSource() override;
+
+    bool start() override;
+
+    void stop() override;
+
+    bool isRunning() const override;
+
+    // Suppression and consumption only take effect with an exclusive grab
+    void setSuppressedRepeatKeys(const QSet<int> &vkCodes) override;
+
+    void setConsumedKeys(const QSet<int> &vkCodes) override;
+
+    // Takes effect on the next start(); requires write access to /dev/uinput
+    void setExclusiveGrab(bool grab);
+
+    void setDispatcher(KeyEventDispatcher *dispatcher) override;
+
+    static QStringList detectKeyboards();
+
+    static int virtualKeyFromEvdev(int code);
+
+private:
+    static constexpr std::size_t READ_BATCH_EVENTS = 64;
+
+    struct Device {
+        QString path;
+        int fd = -1;
+        bool isLiveDevice = false;
+        bool monotonicTimestamps = false;
+        bool isRegularFile = false;
+        bool grabbed = false;
+        std::size_t buffered = 0;
+        std::array<unsigned char, READ_BATCH_EVENTS * sizeof(input_event)> buffer;
+    };
+
+    bool openDevice(const QString &path);
+    bool openPassthroughDevice();
+    bool grabDevice(Device &device);
+    void closeDevices();
+    void run();
+    void readRegularFile(Device &device);
+    bool readAvailable(Device &device);
+    void consumeBuffer(Device &device);
+    bool processEvent(const input_event &event, const Device &device);
+
+    QStringList m_paths;
+    std::vector<std::unique_ptr<Device>> m_devices;
+    int m_epollFd;
+    int m_wakeFd;
+    int m_passthroughFd;
+    bool m_exclusiveGrab;
+    std::unique_ptr<QThread> m_captureThread;
+    std::atomic<bool> m_running;
+    std::atomic<KeyEventDispatcher*> m_dispatcher;
+    KeyCaptureFilter m_captureFilter;
+};
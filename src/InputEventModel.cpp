@@ -0,0 +1,84 @@
+#include "InputEventModel.h"
+#include "KeyUtils.h"
+#include <QDateTime>
+
+InputEventModel::InputEventModel(int capacity, QObject *parent)
+    : QAbstractListModel(parent)
+    , m_records(qMax(1, capacity))
+    , m_start(0)
+    , m_count(0)
+{
+}
+
+int InputEventModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : m_count;
+}
+
+QVariant InputEventModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= m_count || role != Qt::DisplayRole) {
+        return QVariant();
+    }
+
+    return formatRecord(recordAt(index.row()));
+}
+
+void InputEventModel::append(const QVector<MonitorRecord> &records)
+{
+    if (records.isEmpty()) {
+        return;
+    }
+
+    const int capacity = m_records.size();
+    const int incoming = qMin(static_cast<int>(records.size()), capacity);
+    const int firstIncoming = static_cast<int>(records.size()) - incoming;
+
+    const int overflow = m_count + incoming - capacity;
+    if (overflow > 0) {
+        beginRemoveRows(QModelIndex(), 0, overflow - 1);
+        m_start = (m_start + overflow) % capacity;
+        m_count -= overflow;
+        endRemoveRows();
+    }
+
+    beginInsertRows(QModelIndex(), m_count, m_count + incoming - 1);
+    for (int i = 0; i < incoming; ++i) {
+        m_records[(m_start + m_count + i) % capacity] = records.at(firstIncoming + i);
+    }
+    m_count += incoming;
+    endInsertRows();
+}
+
+void InputEventModel::clear()
+{
+    beginResetModel();
+    m_start = 0;
+    m_count = 0;
+    endResetModel();
+}
+
+int InputEventModel::capacity() const
+{
+    return m_records.size();
+}
+
+const MonitorRecord &InputEventModel::recordAt(int row) const
+{
+    return m_records.at((m_start + row) % m_records.size());
+}
+
+QString InputEventModel::formatRecord(const MonitorRecord &record) const
+{
+    const int vkCode = record.vkCode;
+    const bool isKeyDown = record.flags & MonitorRecord::KeyDown;
+    const bool isRepeat = record.flags & MonitorRecord::Repeat;
+
+    return QString("[%1] VK_%2 (0x%3) %4%5 - %6")
+           .arg(QDateTime::fromMSecsSinceEpoch(record.timestampMs).toString("hh:mm:ss.zzz"))
+           .arg(vkCode, 3, 10, QChar('0'))
+           .arg(QString::number(vkCode, 16).toUpper().rightJustified(2, '0'))
+           .arg(isKeyDown ? "DOWN" : "UP")
+           .arg(isRepeat ? " [REPEAT]" : "")
+           .arg(KeyUtils::getKeyName(vkCode));
+}
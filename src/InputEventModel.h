@@ -0,0 +1,44 @@
+#pragma once
+
+#include <QAbstractListModel>
+#include <QVector>
+
+struct MonitorRecord {
+    enum Flags : quint8 {
+        KeyDown = 0x01,
+        Repeat  = 0x02
+    };
+
+    qint64 timestampMs;
+    quint16 vkCode;
+    quint8 flags;
+
+    MonitorRecord() : timestampMs(0), vkCode(0), flags(0) {}
+};
+
+class InputEventModel : public QAbstractListModel
+{
+    Q_OBJECT
+
+public:
+    explicit InputEventModel(int capacity, QObject *parent = nullptr);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+
+    void append(const QVector<MonitorRecord> &records);
+    
+    void clear();
+    
+    int capacity() const;
+
+private:
+    const MonitorRecord &recordAt(int row) const;
+    
+    QString formatRecord(const MonitorRecord &record) const;
+
+    QVector<MonitorRecord> m_records;
+    int m_start;
+    int m_count;
+};
@@ -1,33 +1,54 @@
 #include "InputMonitor.h"
+#include "KeyEventDispatcher.h"
 #include "KeyUtils.h"
+#include "SequenceMatcher.h"
 #include <QDateTime>
+#include <QScreen>
 #include <QScrollBar>
 #include <QApplication>
 #include <QHBoxLayout>
 #include <QMainWindow>
+#include <QStringList>
 #include <QTabWidget>
-#include <windows.h>
+#include <algorithm>
 
 namespace {
     constexpr int CONSOLE_FONT_SIZE = 9;
     constexpr int STATUS_MESSAGE_TIMEOUT_MS = 3000;
+    constexpr int MONITOR_CAPACITY = 10000;
+    constexpr int DEFAULT_REFRESH_INTERVAL_MS = 16;
+    constexpr int MAX_EVENTS_PER_SAMPLE = 4096;
     const QString STATUS_READY_STYLE = "font-weight: bold; color: green;";
     const QString STATUS_PAUSED_STYLE = "font-weight: bold; color: orange;";
     const QString STATUS_DISABLED_STYLE = "font-weight: bold; color: red;";
+    const QString SEQUENCE_IDLE_TEXT = "Sequence: -";
 }
 
 InputMonitor::InputMonitor(QWidget *parent)
     : QWidget(parent)
     , m_layout(nullptr)
     , m_console(nullptr)
+    , m_model(nullptr)
     , m_clearButton(nullptr)
     , m_ignoreRepeatsCheckBox(nullptr)
     , m_statusLabel(nullptr)
+    , m_eventCountLabel(nullptr)
+    , m_sequenceLabel(nullptr)
+    , m_refreshTimer(nullptr)
+    , m_dispatcher(nullptr)
     , m_ignoreRepeats(false)
     , m_loggingEnabled(true)
     , m_eventCount(0)
+    , m_shownSequenceProgress(0)
 {
     setupUI();
+    
+    m_sampledEvents.reserve(MAX_EVENTS_PER_SAMPLE);
+    m_pendingRecords.reserve(MAX_EVENTS_PER_SAMPLE);
+    
+    m_refreshTimer = new QTimer(this);
+    m_refreshTimer->setTimerType(Qt::PreciseTimer);
+    connect(m_refreshTimer, &QTimer::timeout, this, &InputMonitor::sampleObservedEvents);
 }
 
 InputMonitor::~InputMonitor()
@@ -42,10 +63,14 @@ void InputMonitor::setupUI()
     m_statusLabel->setStyleSheet(STATUS_READY_STYLE);
     m_layout->addWidget(m_statusLabel);
     
-    m_console = new QTextEdit(this);
-    m_console->setReadOnly(true);
+    m_model = new InputEventModel(MONITOR_CAPACITY, this);
+    
+    m_console = new QListView(this);
+    m_console->setModel(m_model);
+    m_console->setUniformItemSizes(true);
+    m_console->setEditTriggers(QAbstractItemView::NoEditTriggers);
     m_console->setFont(QFont("Consolas", CONSOLE_FONT_SIZE));
-    m_console->setPlaceholderText("Key events will appear here when this tab is active and the application is focused...");
+    m_console->setToolTip("Key events appear here when this tab is active and the application is focused");
     m_layout->addWidget(m_console);
     
     QWidget *controlPanel = new QWidget(this);
@@ -62,72 +87,145 @@ void InputMonitor::setupUI()
     
     controlLayout->addStretch();
     
-    QLabel *eventCountLabel = new QLabel("Events: 0", controlPanel);
-    eventCountLabel->setObjectName("eventCountLabel");
-    controlLayout->addWidget(eventCountLabel);
+    m_sequenceLabel = new QLabel(SEQUENCE_IDLE_TEXT, controlPanel);
+    m_sequenceLabel->setToolTip("Keys of the sequence mapping typed so far and the time left for the next one");
+    controlLayout->addWidget(m_sequenceLabel);
+    
+    m_eventCountLabel = new QLabel("Events: 0", controlPanel);
+    controlLayout->addWidget(m_eventCountLabel);
     
     m_layout->addWidget(controlPanel);
     
     setLayout(m_layout);
 }
 
-void InputMonitor::logKeyEvent(int vkCode, bool isKeyDown, bool isRepeat)
+void InputMonitor::setEventSource(KeyEventDispatcher *dispatcher)
 {
-    if (!shouldLogEvents()) {
-        return;
+    if (m_dispatcher) {
+        m_dispatcher->setObserverEnabled(false);
+    }
+    m_dispatcher = dispatcher;
+    updateSampling();
+}
+
+void InputMonitor::updateSampling()
+{
+    const bool active = m_dispatcher && m_loggingEnabled && isVisible();
+    
+    if (m_dispatcher) {
+        m_dispatcher->setObserverEnabled(active);
     }
     
-    if (m_ignoreRepeats && isRepeat) {
+    if (active) {
+        m_refreshTimer->start(refreshIntervalMs());
+    } else {
+        m_refreshTimer->stop();
+    }
+}
+
+void InputMonitor::showEvent(QShowEvent *event)
+{
+    QWidget::showEvent(event);
+    updateSampling();
+}
+
+void InputMonitor::hideEvent(QHideEvent *event)
+{
+    QWidget::hideEvent(event);
+    updateSampling();
+}
+
+void InputMonitor::sampleObservedEvents()
+{
+    updateSequenceLabel();
+    
+    m_sampledEvents.clear();
+    m_dispatcher->takeObservedEvents(m_sampledEvents, MAX_EVENTS_PER_SAMPLE);
+    
+    // Events are always drained so nothing stale shows up once the window is focused again
+    if (m_sampledEvents.isEmpty() || !shouldLogEvents()) {
         return;
     }
     
-    QString eventText = formatKeyEvent(vkCode, isKeyDown, isRepeat);
-    m_console->append(eventText);
+    // Map the dispatcher's monotonic capture time onto wall-clock time for display
+    const qint64 wallNowMs = QDateTime::currentMSecsSinceEpoch();
+    const std::int64_t nowNs = EngineClock::nowNs();
+    
+    m_pendingRecords.clear();
+    for (const KeyEvent &event : m_sampledEvents) {
+        if (m_ignoreRepeats && event.isRepeat) {
+            continue;
+        }
+        
+        MonitorRecord record;
+        record.timestampMs = wallNowMs - (nowNs - event.timestampNs) / 1000000;
+        record.vkCode = event.vkCode;
+        record.flags = static_cast<quint8>((event.isKeyDown ? MonitorRecord::KeyDown : 0)
+                                           | (event.isRepeat ? MonitorRecord::Repeat : 0));
+        m_pendingRecords.append(record);
+    }
+    
+    if (m_pendingRecords.isEmpty()) {
+        return;
+    }
     
     QScrollBar *scrollBar = m_console->verticalScrollBar();
-    scrollBar->setValue(scrollBar->maximum());
+    const bool followTail = scrollBar->value() == scrollBar->maximum();
+    
+    m_model->append(m_pendingRecords);
+    m_eventCount += m_pendingRecords.size();
     
-    m_eventCount++;
-    QLabel *eventCountLabel = findChild<QLabel*>("eventCountLabel");
-    if (eventCountLabel) {
-        eventCountLabel->setText(QString("Events: %1").arg(m_eventCount));
+    if (followTail) {
+        m_console->scrollToBottom();
     }
+    
+    m_eventCountLabel->setText(QString("Events: %1 | MIDI sent: %2 | Monitor drops: %3")
+                               .arg(m_eventCount)
+                               .arg(m_dispatcher->sentMessageCount())
+                               .arg(m_dispatcher->droppedObservationCount()));
 }
 
-QString InputMonitor::formatKeyEvent(int vkCode, bool isKeyDown, bool isRepeat)
+void InputMonitor::updateSequenceLabel()
 {
-    QString timestamp = QDateTime::currentDateTime().toString("hh:mm:ss.zzz");
-    QString keyName = getKeyName(vkCode);
-    QString eventType = isKeyDown ? "DOWN" : "UP";
-    QString repeatFlag = isRepeat ? " [REPEAT]" : "";
+    const std::uint64_t progress = m_dispatcher->sequenceProgress();
+    const int depth = SequenceMatcher::progressDepth(progress);
+    if (depth == 0) {
+        if (m_shownSequenceProgress != 0) {
+            m_sequenceLabel->setText(SEQUENCE_IDLE_TEXT);
+            m_shownSequenceProgress = 0;
+        }
+        return;
+    }
     
-    return QString("[%1] VK_%2 (0x%3) %4%5 - %6")
-           .arg(timestamp)
-           .arg(QString::number(vkCode).rightJustified(3, '0'))
-           .arg(QString::number(vkCode, 16).toUpper().rightJustified(2, '0'))
-           .arg(eventType)
-           .arg(repeatFlag)
-           .arg(keyName);
+    QStringList keys;
+    for (int step = 0; step < depth; ++step) {
+        keys.append(KeyUtils::getKeyName(SequenceMatcher::progressKey(progress, step)));
+    }
+    const std::int64_t remainingMs = std::max<std::int64_t>(0, (m_dispatcher->sequenceDeadlineNs() - EngineClock::nowNs()) / 1000000);
+    m_sequenceLabel->setText(QString("Sequence: %1 (%2 ms left)").arg(keys.join(" > ")).arg(remainingMs));
+    m_shownSequenceProgress = progress;
 }
 
-QString InputMonitor::getKeyName(int vkCode) const
+int InputMonitor::refreshIntervalMs() const
 {
-    return KeyUtils::getKeyName(vkCode);
+    const QScreen *currentScreen = screen();
+    if (currentScreen && currentScreen->refreshRate() > 0) {
+        return qMax(1, qRound(1000.0 / currentScreen->refreshRate()));
+    }
+    return DEFAULT_REFRESH_INTERVAL_MS;
 }
 
 void InputMonitor::clearConsole()
 {
-    m_console->clear();
+    m_model->clear();
     m_eventCount = 0;
-    QLabel *eventCountLabel = findChild<QLabel*>("eventCountLabel");
-    if (eventCountLabel) {
-        eventCountLabel->setText("Events: 0");
-    }
+    m_eventCountLabel->setText("Events: 0");
 }
 
 void InputMonitor::setLoggingEnabled(bool enabled)
 {
     m_loggingEnabled = enabled;
+    updateSampling();
     
     if (enabled) {
         m_statusLabel->setText("Input Monitor - Active");
@@ -157,4 +255,4 @@ bool InputMonitor::shouldLogEvents() const
 void InputMonitor::onIgnoreRepeatsToggled(bool checked)
 {
     m_ignoreRepeats = checked;
-}
\ No newline at end of file
+}
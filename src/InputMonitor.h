@@ -2,11 +2,17 @@
 
 #include <QWidget>
 #include <QVBoxLayout>
-#include <QTextEdit>
+#include <QListView>
 #include <QPushButton>
 #include <QCheckBox>
 #include <QLabel>
 #include <QString>
+#include <QTimer>
+#include <QVector>
+#include "InputEventModel.h"
+#include "KeyEvent.h"
+
+class KeyEventDispatcher;
 
 class InputMonitor : public QWidget
 {
@@ -16,7 +22,7 @@ public:
     explicit InputMonitor(QWidget *parent = nullptr);
     ~InputMonitor();
 
-    void logKeyEvent(int vkCode, bool isKeyDown, bool isRepeat = false);
+    void setEventSource(KeyEventDispatcher *dispatcher);
     
     void setIgnoreRepeats(bool ignore);
     
@@ -27,23 +33,39 @@ public slots:
     
     void setLoggingEnabled(bool enabled);
 
+protected:
+    void showEvent(QShowEvent *event) override;
+    void hideEvent(QHideEvent *event) override;
+
 private slots:
     void onIgnoreRepeatsToggled(bool checked);
+    
+    void sampleObservedEvents();
 
 private:
     void setupUI();
     
-    QString formatKeyEvent(int vkCode, bool isKeyDown, bool isRepeat);
+    int refreshIntervalMs() const;
+    
+    void updateSampling();
     
-    QString getKeyName(int vkCode) const;
+    void updateSequenceLabel();
 
     QVBoxLayout *m_layout;
-    QTextEdit *m_console;
+    QListView *m_console;
+    InputEventModel *m_model;
     QPushButton *m_clearButton;
     QCheckBox *m_ignoreRepeatsCheckBox;
     QLabel *m_statusLabel;
+    QLabel *m_eventCountLabel;
+    QLabel *m_sequenceLabel;
+    QTimer *m_refreshTimer;
+    KeyEventDispatcher *m_dispatcher;
+    QVector<KeyEvent> m_sampledEvents;
+    QVector<MonitorRecord> m_pendingRecords;
     
     bool m_ignoreRepeats;
     bool m_loggingEnabled;
     int m_eventCount;
-};
\ No newline at end of file
+    std::uint64_t m_shownSequenceProgress;
+};
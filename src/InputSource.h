@@ -0,0 +1,37 @@
+#pragma once
+
+#include <QObject>
+#include <QSet>
+
+class KeyEventDispatcher;
+
+// Platform input backend that captures key events and posts them to the dispatcher
+// from its own capture thread. Key codes are Windows virtual-key codes on every platform.
+class InputSource : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit InputSource(QObject *parent = nullptr) : QObject(parent) {}
+    ~InputSource() override = default;
+
+    virtual bool start() = 0;
+
+    virtual void stop() = 0;
+
+    virtual bool isRunning() const = 0;
+
+    virtual void setSuppressedRepeatKeys(const QSet<int> &vkCodes) = 0;
+
+    // Consumed keys still reach the dispatcher but are hidden from other applications
+    virtual void setConsumedKeys(const QSet<int> &vkCodes) = 0;
+
+    virtual void setDispatcher(KeyEventDispatcher *dispatcher) = 0;
+
+signals:
+    // Emitted from the capture thread when a finite source (file or pipe) is exhausted
+    void finished();
+
+    // Emitted by stop(); keys held at that point never report their release
+    void captureStopped();
+};
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// Immutable 256-bit set of virtual-key codes. Built once, then published
+// (e.g. through RcuCell) and read without synchronisation.
+class KeyMask
+{
+public:
+    static constexpr int KEY_COUNT = 256;
+
+    KeyMask() : m_words{} {}
+
+    void insert(int vkCode)
+    {
+        if (isValid(vkCode)) {
+            m_words[vkCode >> 6] |= bit(vkCode);
+        }
+    }
+
+    bool contains(int vkCode) const
+    {
+        return isValid(vkCode) && (m_words[vkCode >> 6] & bit(vkCode)) != 0;
+    }
+
+    bool isEmpty() const
+    {
+        return (m_words[0] | m_words[1] | m_words[2] | m_words[3]) == 0;
+    }
+
+private:
+    static bool isValid(int vkCode) { return vkCode >= 0 && vkCode < KEY_COUNT; }
+    static std::uint64_t bit(int vkCode) { return std::uint64_t(1) << (vkCode & 63); }
+
+    std::array<std::uint64_t, KEY_COUNT / 64> m_words;
+};
+
+// 256-bit set of virtual-key codes with wait-free per-key updates.
+// set()/reset() return the previous state so callers can detect transitions.
+class KeyBitset
+{
+public:
+    static constexpr int KEY_COUNT = 256;
+
+    KeyBitset()
+    {
+        clear();
+    }
+
+    KeyBitset(const KeyBitset &) = delete;
+    KeyBitset &operator=(const KeyBitset &) = delete;
+
+    bool test(int vkCode) const
+    {
+        return isValid(vkCode)
+            && (m_words[vkCode >> 6].load(std::memory_order_relaxed) & bit(vkCode)) != 0;
+    }
+
+    bool set(int vkCode)
+    {
+        return isValid(vkCode)
+            && (m_words[vkCode >> 6].fetch_or(bit(vkCode), std::memory_order_relaxed) & bit(vkCode)) != 0;
+    }
+
+    bool reset(int vkCode)
+    {
+        return isValid(vkCode)
+            && (m_words[vkCode >> 6].fetch_and(~bit(vkCode), std::memory_order_relaxed) & bit(vkCode)) != 0;
+    }
+
+    void clear()
+    {
+        for (std::atomic<std::uint64_t> &word : m_words) {
+            word.store(0, std::memory_order_relaxed);
+        }
+    }
+
+private:
+    static bool isValid(int vkCode) { return vkCode >= 0 && vkCode < KEY_COUNT; }
+    static std::uint64_t bit(int vkCode) { return std::uint64_t(1) << (vkCode & 63); }
+
+    std::array<std::atomic<std::uint64_t>, KEY_COUNT / 64> m_words;
+};
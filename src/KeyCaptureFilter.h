@@ -0,0 +1,83 @@
+#pragma once
+
+#include <QSet>
+#include <memory>
+#include "KeyBitset.h"
+#include "RcuCell.h"
+
+// Per-event decisions made inside the capture callback: auto-repeat detection,
+// repeat suppression and key consumption. onKey() is wait-free so it is safe in
+// a low-level hook, where Windows silently removes callbacks that run too long.
+class KeyCaptureFilter
+{
+public:
+    struct Decision {
+        bool isRepeat;
+        bool suppress;
+    };
+
+    Decision onKey(int vkCode, bool isKeyDown)
+    {
+        if (!isKeyDown) {
+            m_pressedKeys.reset(vkCode);
+            // A release follows the decision made at press time, so rule changes
+            // while a key is held never leave other applications with a stuck key
+            return {false, m_consumedPresses.reset(vkCode)};
+        }
+
+        const bool isRepeat = m_pressedKeys.set(vkCode);
+        if (isRepeat && m_consumedPresses.test(vkCode)) {
+            return {true, true};
+        }
+
+        const auto rules = m_rules.read();
+        if (isRepeat) {
+            return {true, rules->suppressedRepeats.contains(vkCode)};
+        }
+        if (rules->consumed.contains(vkCode)) {
+            m_consumedPresses.set(vkCode);
+            return {false, true};
+        }
+        return {false, false};
+    }
+
+    // Writer side; call from one thread at a time
+    void setSuppressedRepeatKeys(const QSet<int> &vkCodes)
+    {
+        auto rules = std::make_unique<Rules>(*m_rules.read());
+        rules->suppressedRepeats = toMask(vkCodes);
+        m_rules.publish(std::move(rules));
+    }
+
+    void setConsumedKeys(const QSet<int> &vkCodes)
+    {
+        auto rules = std::make_unique<Rules>(*m_rules.read());
+        rules->consumed = toMask(vkCodes);
+        m_rules.publish(std::move(rules));
+    }
+
+    void resetPressedKeys()
+    {
+        m_pressedKeys.clear();
+        m_consumedPresses.clear();
+    }
+
+private:
+    struct Rules {
+        KeyMask suppressedRepeats;
+        KeyMask consumed;
+    };
+
+    static KeyMask toMask(const QSet<int> &vkCodes)
+    {
+        KeyMask mask;
+        for (int vkCode : vkCodes) {
+            mask.insert(vkCode);
+        }
+        return mask;
+    }
+
+    KeyBitset m_pressedKeys;
+    KeyBitset m_consumedPresses;
+    RcuCell<Rules> m_rules;
+};
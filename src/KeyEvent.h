@@ -0,0 +1,31 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+namespace EngineClock {
+
+inline std::int64_t nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+}
+
+struct KeyEvent {
+    std::int64_t timestampNs;
+    std::uint32_t osTimeMs;
+    std::uint16_t vkCode;
+    bool isKeyDown;
+    bool isRepeat;
+
+    KeyEvent() : timestampNs(0), osTimeMs(0), vkCode(0), isKeyDown(false), isRepeat(false) {}
+    KeyEvent(int vk, bool keyDown, bool repeat, std::uint32_t osTime = 0)
+        : timestampNs(EngineClock::nowNs())
+        , osTimeMs(osTime)
+        , vkCode(static_cast<std::uint16_t>(vk))
+        , isKeyDown(keyDown)
+        , isRepeat(repeat)
+    {}
+};
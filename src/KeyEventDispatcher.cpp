@@ -0,0 +1,308 @@
+#include "KeyEventDispatcher.h"
+#include "KeyEventRecorder.h"
+#include "KeyMapping.h"
+#include "MidiEngine.h"
+#include <QDebug>
+#include <QThread>
+#include <algorithm>
+
+namespace {
+    constexpr int IDLE_WAIT_TIMEOUT_MS = 100;
+    constexpr std::int64_t NS_PER_MS = 1000000;
+    constexpr std::int64_t SPIN_THRESHOLD_NS = 1000000;
+}
+
+KeyEventDispatcher::KeyEventDispatcher(KeyMapping *keyMapping, MidiEngine *midiEngine, QObject *parent)
+    : QObject(parent)
+    , m_keyMapping(keyMapping)
+    , m_midiEngine(midiEngine)
+    , m_macroPlayer([this](const MidiBytes &message) {
+          if (m_midiEngine->isPortOpen()) {
+              m_midiEngine->sendMidiBytes(message);
+              m_sentMessages.fetch_add(1, std::memory_order_relaxed);
+          }
+      })
+    , m_running(false)
+    , m_keyDetectionActive(false)
+    , m_recorder(nullptr)
+    , m_droppedEvents(0)
+    , m_observerEnabled(false)
+    , m_processedEvents(0)
+    , m_sentMessages(0)
+    , m_droppedObservations(0)
+    , m_sequenceProgress(0)
+    , m_sequenceDeadlineNs(KeyEventTranslator::NO_DEADLINE)
+{
+    // A key held across a mapping change releases through the new mapping, which
+    // need not turn off what the old one started. Macros of the old mapping stop too.
+    connect(m_keyMapping, &KeyMapping::mappingUpdated, this, &KeyEventDispatcher::silenceAfterMappingChange);
+    connect(m_keyMapping, &KeyMapping::mappingRemoved, this, &KeyEventDispatcher::silenceAfterMappingChange);
+    connect(m_keyMapping, &KeyMapping::mappingsReset, this, &KeyEventDispatcher::silenceAfterMappingChange);
+    connect(m_keyMapping, &KeyMapping::chordMappingsChanged, this, &KeyEventDispatcher::silenceAfterMappingChange);
+    connect(m_keyMapping, &KeyMapping::sequenceMappingsChanged, this, &KeyEventDispatcher::silenceAfterMappingChange);
+    connect(m_keyMapping, &KeyMapping::macroMappingsChanged, this, &KeyEventDispatcher::silenceAfterMappingChange);
+}
+
+KeyEventDispatcher::~KeyEventDispatcher()
+{
+    stop();
+}
+
+void KeyEventDispatcher::start()
+{
+    if (m_running.exchange(true)) {
+        return;
+    }
+
+    m_macroPlayer.start();
+    m_thread.reset(QThread::create([this] { run(); }));
+    m_thread->setObjectName("KeyEventDispatcher");
+    m_thread->start(QThread::TimeCriticalPriority);
+}
+
+void KeyEventDispatcher::stop()
+{
+    if (!m_running.exchange(false)) {
+        return;
+    }
+
+    m_pendingEvents.release();
+    m_thread->wait();
+    m_thread.reset();
+    m_macroPlayer.stop();
+}
+
+bool KeyEventDispatcher::isRunning() const
+{
+    return m_running.load(std::memory_order_acquire);
+}
+
+bool KeyEventDispatcher::postEvent(const KeyEvent &event, PostMode mode)
+{
+    if (mode == WaitWhenFull) {
+        while (!m_queue.tryPush(event)) {
+            if (!m_running.load(std::memory_order_acquire)) {
+                return false;
+            }
+            QThread::yieldCurrentThread();
+        }
+        m_pendingEvents.release();
+        return true;
+    }
+
+    if (!m_queue.tryPush(event)) {
+        m_droppedEvents.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    m_pendingEvents.release();
+    return true;
+}
+
+void KeyEventDispatcher::setKeyDetectionActive(bool active)
+{
+    m_keyDetectionActive.store(active, std::memory_order_release);
+}
+
+void KeyEventDispatcher::setRecorder(KeyEventRecorder *recorder)
+{
+    m_recorder.store(recorder, std::memory_order_release);
+}
+
+quint64 KeyEventDispatcher::droppedEventCount() const
+{
+    return m_droppedEvents.load(std::memory_order_relaxed);
+}
+
+const PipelineLatency &KeyEventDispatcher::latency() const
+{
+    return m_midiEngine->latency();
+}
+
+void KeyEventDispatcher::setObserverEnabled(bool enabled)
+{
+    m_observerEnabled.store(enabled, std::memory_order_release);
+}
+
+int KeyEventDispatcher::takeObservedEvents(QVector<KeyEvent> &events, int maxEvents)
+{
+    int taken = 0;
+    KeyEvent event;
+    while (taken < maxEvents && m_observedEvents.tryPop(event)) {
+        events.append(event);
+        ++taken;
+    }
+    return taken;
+}
+
+quint64 KeyEventDispatcher::processedEventCount() const
+{
+    return m_processedEvents.load(std::memory_order_relaxed);
+}
+
+quint64 KeyEventDispatcher::sentMessageCount() const
+{
+    return m_sentMessages.load(std::memory_order_relaxed);
+}
+
+quint64 KeyEventDispatcher::droppedObservationCount() const
+{
+    return m_droppedObservations.load(std::memory_order_relaxed);
+}
+
+std::uint64_t KeyEventDispatcher::sequenceProgress() const
+{
+    return m_sequenceProgress.load(std::memory_order_relaxed);
+}
+
+std::int64_t KeyEventDispatcher::sequenceDeadlineNs() const
+{
+    return m_sequenceDeadlineNs.load(std::memory_order_relaxed);
+}
+
+void KeyEventDispatcher::stopMacros()
+{
+    m_macroPlayer.stopAll();
+}
+
+const MacroPlayer &KeyEventDispatcher::macroPlayer() const
+{
+    return m_macroPlayer;
+}
+
+void KeyEventDispatcher::run()
+{
+    KeyEvent event;
+
+    while (m_running.load(std::memory_order_acquire)) {
+        // Wake up in time for hold thresholds, chord windows and sequence steps. A
+        // semaphore wait is only good to about a millisecond, so the last one is
+        // spent polling the queue instead.
+        int waitMs = IDLE_WAIT_TIMEOUT_MS;
+        const std::int64_t deadlineNs = m_translator.nextDeadlineNs();
+        if (deadlineNs != KeyEventTranslator::NO_DEADLINE) {
+            const std::int64_t remainingNs = deadlineNs - EngineClock::nowNs();
+            waitMs = static_cast<int>(std::clamp<std::int64_t>((remainingNs - SPIN_THRESHOLD_NS) / NS_PER_MS,
+                                                               0, IDLE_WAIT_TIMEOUT_MS));
+        }
+
+        if (m_pendingEvents.tryAcquire(1, waitMs)) {
+            while (m_queue.tryPop(event)) {
+                handleEvent(event);
+            }
+        } else if (waitMs == 0) {
+            QThread::yieldCurrentThread();
+        }
+        expireTimeouts();
+    }
+
+    // Events captured before stop() still get translated
+    while (m_queue.tryPop(event)) {
+        handleEvent(event);
+    }
+    m_translator.expire(KeyEventTranslator::NO_DEADLINE);
+    sendTranslatorOutput(false);
+    publishSequenceState();
+}
+
+void KeyEventDispatcher::handleEvent(const KeyEvent &event)
+{
+    const int vkCode = event.vkCode;
+    
+    if (KeyEventRecorder *recorder = m_recorder.load(std::memory_order_acquire)) {
+        recorder->record(event);
+    }
+
+    if (event.isKeyDown && !event.isRepeat
+        && m_keyDetectionActive.load(std::memory_order_relaxed)
+        && m_keyDetectionActive.exchange(false)) {
+        emit keyDetected(vkCode);
+        observe(event);
+        return;
+    }
+
+    const std::int64_t lookupNs = EngineClock::nowNs();
+    PipelineLatency &latency = m_midiEngine->latency();
+    latency.record(PipelineLatency::CaptureToLookup, lookupNs - event.timestampNs);
+    
+    {
+        const auto table = m_keyMapping->compiledTable();
+        m_translator.process(*table, event);
+        handleMacro(*table, event);
+    }
+    // The output worker records CaptureToSend once the driver has the messages
+    if (sendTranslatorOutput(event.isRepeat, event.timestampNs)) {
+        latency.record(PipelineLatency::LookupToEnqueue, EngineClock::nowNs() - lookupNs);
+    }
+    publishSequenceState();
+    observe(event);
+}
+
+void KeyEventDispatcher::handleMacro(const CompiledMappingTable &table, const KeyEvent &event)
+{
+    if (event.vkCode <= 0 || event.vkCode >= CompiledMappingTable::SLOT_COUNT) {
+        return;
+    }
+
+    const CompiledMacro &macro = table.macros[event.vkCode];
+    if (macro.eventCount == 0 || event.isRepeat) {
+        return;
+    }
+
+    // The player copies the events, so the macro plays on after the table is replaced
+    if (event.isKeyDown) {
+        m_macroPlayer.play(event.vkCode, table.macroEvents.data() + macro.eventStart, macro.eventCount,
+                           event.timestampNs);
+    } else if (macro.flags & CompiledMacro::CancelOnRelease) {
+        m_macroPlayer.stopKey(event.vkCode);
+    }
+}
+
+void KeyEventDispatcher::expireTimeouts()
+{
+    const std::int64_t nowNs = EngineClock::nowNs();
+    if (m_translator.nextDeadlineNs() <= nowNs) {
+        m_translator.expire(nowNs);
+        for (int i = 0; i < m_translator.resolvedHoldCount(); ++i) {
+            m_midiEngine->latency().record(PipelineLatency::ThresholdToHold, nowNs - m_translator.resolvedHoldDeadlines()[i]);
+        }
+        sendTranslatorOutput(false);
+        publishSequenceState();
+    }
+}
+
+bool KeyEventDispatcher::sendTranslatorOutput(bool isRepeat, std::int64_t captureNs)
+{
+    const int count = m_translator.messageCount();
+    if (count == 0 || !m_midiEngine->isPortOpen()) {
+        return false;
+    }
+
+    const MidiBytes *messages = m_translator.messages();
+    for (int i = 0; i < count; ++i) {
+        m_midiEngine->sendMidiBytes(messages[i], isRepeat, captureNs);
+    }
+    m_sentMessages.fetch_add(static_cast<quint64>(count), std::memory_order_relaxed);
+    return true;
+}
+
+void KeyEventDispatcher::publishSequenceState()
+{
+    m_sequenceProgress.store(m_translator.sequenceProgress(), std::memory_order_relaxed);
+    m_sequenceDeadlineNs.store(m_translator.sequenceDeadlineNs(), std::memory_order_relaxed);
+}
+
+void KeyEventDispatcher::silenceAfterMappingChange()
+{
+    stopMacros();
+    m_midiEngine->releaseAllNotes();
+}
+
+void KeyEventDispatcher::observe(const KeyEvent &event)
+{
+    m_processedEvents.fetch_add(1, std::memory_order_relaxed);
+
+    if (m_observerEnabled.load(std::memory_order_relaxed) && !m_observedEvents.tryPush(event)) {
+        m_droppedObservations.fetch_add(1, std::memory_order_relaxed);
+    }
+}
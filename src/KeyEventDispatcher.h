@@ -0,0 +1,116 @@
+#pragma once
+
+#include <QObject>
+#include <QSemaphore>
+#include <QVector>
+#include <atomic>
+#include <memory>
+#include "KeyEvent.h"
+#include "KeyEventTranslator.h"
+#include "LatencyStats.h"
+#include "MacroPlayer.h"
+#include "SpscRing.h"
+
+class QThread;
+class KeyEventRecorder;
+class KeyMapping;
+class MidiEngine;
+
+class KeyEventDispatcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit KeyEventDispatcher(KeyMapping *keyMapping, MidiEngine *midiEngine, QObject *parent = nullptr);
+    ~KeyEventDispatcher();
+
+    void start();
+    
+    void stop();
+    
+    bool isRunning() const;
+
+    enum PostMode {
+        DropWhenFull,   // Live capture: never block the producer
+        WaitWhenFull    // Finite sources (files, pipes): apply backpressure instead of losing events
+    };
+
+    bool postEvent(const KeyEvent &event, PostMode mode = DropWhenFull);
+    
+    void setKeyDetectionActive(bool active);
+    
+    void setRecorder(KeyEventRecorder *recorder);
+    
+    quint64 droppedEventCount() const;
+    
+    // The engine's; its output worker records the send end of each key event
+    const PipelineLatency &latency() const;
+
+    // Observers (the input monitor) sample processed events and counters on their
+    // own schedule; the dispatcher never signals per event or waits for a reader.
+    void setObserverEnabled(bool enabled);
+    
+    // Single consumer. Appends up to maxEvents observed events and returns how many were taken.
+    int takeObservedEvents(QVector<KeyEvent> &events, int maxEvents);
+    
+    quint64 processedEventCount() const;
+    
+    quint64 sentMessageCount() const;
+    
+    quint64 droppedObservationCount() const;
+    
+    // The sequence typed so far, in SequenceMatcher::progress() form, and when its next
+    // step times out. Updated after every event and timeout; 0 when no sequence is open.
+    std::uint64_t sequenceProgress() const;
+    
+    std::int64_t sequenceDeadlineNs() const;
+
+    // Silences every macro still playing. Any thread.
+    void stopMacros();
+
+    const MacroPlayer &macroPlayer() const;
+
+signals:
+    void keyDetected(int vkCode);
+
+private:
+    static constexpr std::size_t QUEUE_CAPACITY = 1024;
+    static constexpr std::size_t OBSERVER_CAPACITY = 4096;
+
+    void run();
+    
+    void handleEvent(const KeyEvent &event);
+
+    void handleMacro(const CompiledMappingTable &table, const KeyEvent &event);
+    
+    void expireTimeouts();
+    
+    // Sends what the translator produced; false if nothing went out
+    // captureNs is 0 for messages no key event caused, such as resolved holds
+    bool sendTranslatorOutput(bool isRepeat, std::int64_t captureNs = 0);
+    
+    void publishSequenceState();
+
+    void silenceAfterMappingChange();
+    
+    void observe(const KeyEvent &event);
+
+    KeyMapping *m_keyMapping;
+    MidiEngine *m_midiEngine;
+    SpscRing<KeyEvent, QUEUE_CAPACITY> m_queue;
+    SpscRing<KeyEvent, OBSERVER_CAPACITY> m_observedEvents;
+    KeyEventTranslator m_translator;
+    MacroPlayer m_macroPlayer;
+    QSemaphore m_pendingEvents;
+    std::unique_ptr<QThread> m_thread;
+    std::atomic<bool> m_running;
+    std::atomic<bool> m_keyDetectionActive;
+    std::atomic<KeyEventRecorder *> m_recorder;
+    std::atomic<quint64> m_droppedEvents;
+    std::atomic<bool> m_observerEnabled;
+    std::atomic<quint64> m_processedEvents;
+    std::atomic<quint64> m_sentMessages;
+    std::atomic<quint64> m_droppedObservations;
+    std::atomic<std::uint64_t> m_sequenceProgress;
+    std::atomic<std::int64_t> m_sequenceDeadlineNs;
+};
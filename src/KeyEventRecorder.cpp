@@ -0,0 +1,175 @@
+#include "KeyEventRecorder.h"
+#include <QDebug>
+#include <QThread>
+#include <QtEndian>
+#include <cstring>
+
+namespace {
+    constexpr char FILE_MAGIC[4] = {'K', 'T', 'M', 'R'};
+    constexpr int WRITER_POLL_INTERVAL_MS = 10;
+
+    constexpr quint8 FLAG_KEY_DOWN = 0x01;
+    constexpr quint8 FLAG_REPEAT = 0x02;
+
+    void encodeEvent(const KeyEvent &event, uchar *out)
+    {
+        qToLittleEndian<qint64>(event.timestampNs, out);
+        qToLittleEndian<quint32>(event.osTimeMs, out + 8);
+        qToLittleEndian<quint16>(event.vkCode, out + 12);
+        out[14] = static_cast<uchar>((event.isKeyDown ? FLAG_KEY_DOWN : 0) | (event.isRepeat ? FLAG_REPEAT : 0));
+        out[15] = 0;
+    }
+
+    KeyEvent decodeEvent(const uchar *in)
+    {
+        KeyEvent event;
+        event.timestampNs = qFromLittleEndian<qint64>(in);
+        event.osTimeMs = qFromLittleEndian<quint32>(in + 8);
+        event.vkCode = qFromLittleEndian<quint16>(in + 12);
+        event.isKeyDown = in[14] & FLAG_KEY_DOWN;
+        event.isRepeat = in[14] & FLAG_REPEAT;
+        return event;
+    }
+}
+
+KeyEventRecorder::KeyEventRecorder()
+    : m_recording(false)
+    , m_droppedEvents(0)
+{
+}
+
+KeyEventRecorder::~KeyEventRecorder()
+{
+    stop();
+}
+
+bool KeyEventRecorder::start(const QString &filename)
+{
+    if (m_recording.load(std::memory_order_acquire)) {
+        stop();
+    }
+
+    m_file.setFileName(filename);
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "Failed to open recording file:" << filename << m_file.errorString();
+        return false;
+    }
+
+    uchar header[HEADER_SIZE] = {};
+    std::memcpy(header, FILE_MAGIC, sizeof(FILE_MAGIC));
+    qToLittleEndian<quint16>(FORMAT_VERSION, header + 4);
+    qToLittleEndian<quint16>(RECORD_SIZE, header + 6);
+    m_file.write(reinterpret_cast<const char *>(header), HEADER_SIZE);
+
+    KeyEvent discarded;
+    while (m_queue.tryPop(discarded)) {
+    }
+    m_droppedEvents.store(0, std::memory_order_relaxed);
+
+    m_recording.store(true, std::memory_order_release);
+    m_thread.reset(QThread::create([this] { run(); }));
+    m_thread->setObjectName("KeyEventRecorder");
+    m_thread->start(QThread::LowPriority);
+    return true;
+}
+
+void KeyEventRecorder::stop()
+{
+    if (!m_recording.exchange(false)) {
+        return;
+    }
+
+    m_thread->wait();
+    m_thread.reset();
+    m_file.close();
+}
+
+bool KeyEventRecorder::isRecording() const
+{
+    return m_recording.load(std::memory_order_acquire);
+}
+
+void KeyEventRecorder::record(const KeyEvent &event)
+{
+    if (!m_recording.load(std::memory_order_relaxed)) {
+        return;
+    }
+
+    if (!m_queue.tryPush(event)) {
+        m_droppedEvents.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+quint64 KeyEventRecorder::droppedEventCount() const
+{
+    return m_droppedEvents.load(std::memory_order_relaxed);
+}
+
+void KeyEventRecorder::run()
+{
+    QByteArray buffer;
+    buffer.reserve(static_cast<int>(QUEUE_CAPACITY) * RECORD_SIZE);
+
+    while (m_recording.load(std::memory_order_acquire)) {
+        writePending(buffer);
+        QThread::msleep(WRITER_POLL_INTERVAL_MS);
+    }
+
+    writePending(buffer);
+    m_file.flush();
+}
+
+void KeyEventRecorder::writePending(QByteArray &buffer)
+{
+    buffer.clear();
+
+    KeyEvent event;
+    uchar encoded[RECORD_SIZE];
+    while (m_queue.tryPop(event)) {
+        encodeEvent(event, encoded);
+        buffer.append(reinterpret_cast<const char *>(encoded), RECORD_SIZE);
+    }
+
+    if (!buffer.isEmpty() && m_file.write(buffer) != buffer.size()) {
+        qWarning() << "Failed to write key event recording:" << m_file.errorString();
+    }
+}
+
+bool KeyEventRecorder::readFile(const QString &filename, QVector<KeyEvent> &events, QString *error)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly)) {
+        if (error) {
+            *error = QString("Cannot open %1: %2").arg(filename, file.errorString());
+        }
+        return false;
+    }
+
+    const QByteArray data = file.readAll();
+    const uchar *bytes = reinterpret_cast<const uchar *>(data.constData());
+
+    if (data.size() < HEADER_SIZE || std::memcmp(bytes, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0) {
+        if (error) {
+            *error = QString("%1 is not a KtoMIDI key event recording").arg(filename);
+        }
+        return false;
+    }
+
+    const quint16 version = qFromLittleEndian<quint16>(bytes + 4);
+    const quint16 recordSize = qFromLittleEndian<quint16>(bytes + 6);
+    if (version != FORMAT_VERSION || recordSize != RECORD_SIZE) {
+        if (error) {
+            *error = QString("Unsupported recording format version %1").arg(version);
+        }
+        return false;
+    }
+
+    const int recordCount = (data.size() - HEADER_SIZE) / RECORD_SIZE;
+    events.clear();
+    events.reserve(recordCount);
+    for (int i = 0; i < recordCount; ++i) {
+        events.append(decodeEvent(bytes + HEADER_SIZE + i * RECORD_SIZE));
+    }
+
+    return true;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <QFile>
+#include <QString>
+#include <QVector>
+#include <atomic>
+#include <memory>
+#include "KeyEvent.h"
+#include "SpscRing.h"
+
+class QThread;
+
+class KeyEventRecorder
+{
+public:
+    static constexpr quint16 FORMAT_VERSION = 1;
+    static constexpr int HEADER_SIZE = 16;
+    static constexpr int RECORD_SIZE = 16;
+
+    KeyEventRecorder();
+    ~KeyEventRecorder();
+
+    bool start(const QString &filename);
+    
+    void stop();
+    
+    bool isRecording() const;
+
+    void record(const KeyEvent &event);
+    
+    quint64 droppedEventCount() const;
+
+    static bool readFile(const QString &filename, QVector<KeyEvent> &events, QString *error = nullptr);
+
+private:
+    static constexpr std::size_t QUEUE_CAPACITY = 4096;
+
+    void run();
+    
+    void writePending(QByteArray &buffer);
+
+    SpscRing<KeyEvent, QUEUE_CAPACITY> m_queue;
+    QFile m_file;
+    std::unique_ptr<QThread> m_thread;
+    std::atomic<bool> m_recording;
+    std::atomic<quint64> m_droppedEvents;
+};
@@ -0,0 +1,64 @@
+#include "KeyEventTranslator.h"
+#include "KeyMapping.h"
+#include <algorithm>
+
+KeyEventTranslator::KeyEventTranslator()
+    : m_outputCount(0)
+{
+}
+
+void KeyEventTranslator::reset()
+{
+    m_tapHoldResolver.reset();
+    m_chordMatcher.reset();
+    m_sequenceMatcher.reset();
+    m_outputCount = 0;
+}
+
+void KeyEventTranslator::process(const CompiledMappingTable &table, const KeyEvent &event)
+{
+    m_outputCount = 0;
+
+    // A tap goes out on release, ahead of the key's own key-up message
+    const bool dualRole = m_tapHoldResolver.process(table, event.vkCode, event.isKeyDown, event.isRepeat,
+                                                    event.timestampNs);
+    append(m_tapHoldResolver.messages(), m_tapHoldResolver.messageCount());
+
+    MidiBytes message;
+    const bool hasMessage = !dualRole
+        && KeyMapping::lookup(table, event.vkCode, event.isKeyDown, event.isRepeat, message);
+    m_chordMatcher.process(table, event.vkCode, event.isKeyDown, event.isRepeat, event.timestampNs,
+                           hasMessage ? &message : nullptr);
+    append(m_chordMatcher.messages(), m_chordMatcher.messageCount());
+
+    m_sequenceMatcher.process(table, event.vkCode, event.isKeyDown, event.isRepeat, event.timestampNs);
+    append(m_sequenceMatcher.messages(), m_sequenceMatcher.messageCount());
+}
+
+void KeyEventTranslator::expire(std::int64_t nowNs)
+{
+    m_outputCount = 0;
+
+    m_tapHoldResolver.expire(nowNs);
+    append(m_tapHoldResolver.messages(), m_tapHoldResolver.messageCount());
+
+    m_chordMatcher.expire(nowNs);
+    append(m_chordMatcher.messages(), m_chordMatcher.messageCount());
+
+    m_sequenceMatcher.expire(nowNs);
+    append(m_sequenceMatcher.messages(), m_sequenceMatcher.messageCount());
+}
+
+std::int64_t KeyEventTranslator::nextDeadlineNs() const
+{
+    return std::min({m_tapHoldResolver.nextDeadlineNs(), m_chordMatcher.nextDeadlineNs(),
+                     m_sequenceMatcher.nextDeadlineNs()});
+}
+
+void KeyEventTranslator::append(const MidiBytes *messages, int count)
+{
+    const int room = static_cast<int>(m_output.size()) - m_outputCount;
+    const int taken = std::min(count, room);
+    std::copy(messages, messages + taken, m_output.begin() + m_outputCount);
+    m_outputCount += taken;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include "ChordMatcher.h"
+#include "KeyEvent.h"
+#include "SequenceMatcher.h"
+#include "TapHoldResolver.h"
+
+// Turns key events into MIDI messages against one compiled table: tap-or-hold keys,
+// the key's own mapping, then chords, then sequences. Shared by the dispatcher and the replay
+// tool so both produce the same output. Single-threaded and allocation-free.
+class KeyEventTranslator
+{
+public:
+    static constexpr std::int64_t NO_DEADLINE = INT64_MAX;
+
+    KeyEventTranslator();
+
+    // The messages to send are available from messages() until the next call
+    void process(const CompiledMappingTable &table, const KeyEvent &event);
+
+    // Runs every timeout due by nowNs
+    void expire(std::int64_t nowNs);
+
+    // When expire() next has work to do
+    std::int64_t nextDeadlineNs() const;
+
+    const MidiBytes *messages() const { return m_output.data(); }
+    int messageCount() const { return m_outputCount; }
+
+    std::uint64_t sequenceProgress() const { return m_sequenceMatcher.progress(); }
+    std::int64_t sequenceDeadlineNs() const { return m_sequenceMatcher.nextDeadlineNs(); }
+
+    // Thresholds of the holds the last expire() resolved
+    const std::int64_t *resolvedHoldDeadlines() const { return m_tapHoldResolver.resolvedDeadlines(); }
+    int resolvedHoldCount() const { return m_tapHoldResolver.resolvedCount(); }
+
+    void reset();
+
+private:
+    void append(const MidiBytes *messages, int count);
+
+    TapHoldResolver m_tapHoldResolver;
+    ChordMatcher m_chordMatcher;
+    SequenceMatcher m_sequenceMatcher;
+    std::array<MidiBytes, TapHoldResolver::KEY_COUNT + ChordMatcher::KEY_COUNT + 4
+                          + CompiledSequenceNode::MAX_MESSAGES * 2> m_output;
+    int m_outputCount;
+};
@@ -1,42 +1,78 @@
 #include "KeyHook.h"
+#include "KeyEventDispatcher.h"
 #include <QDebug>
-#include <QMutex>
-#include <QMutexLocker>
+#include <QThread>
 
-namespace {
-    QMutex s_instanceMutex;
-}
-
-KeyHook* KeyHook::s_instance = nullptr;
+std::atomic<KeyHook*> KeyHook::s_instance{nullptr};
 
 KeyHook::KeyHook(QObject *parent)
-    : QObject(parent)
+    : InputSource(parent)
     , m_keyboardHook(nullptr)
     , m_hookInstalled(false)
+    , m_captureThreadId(0)
+    , m_dispatcher(nullptr)
 {
-    QMutexLocker locker(&s_instanceMutex);
-    if (s_instance != nullptr) {
+    if (s_instance.exchange(this) != nullptr) {
         qWarning() << "Multiple KeyHook instances detected - this may cause issues";
     }
-    s_instance = this;
 }
 
 KeyHook::~KeyHook()
 {
-    uninstallHook();
+    stop();
     
-    QMutexLocker locker(&s_instanceMutex);
-    if (s_instance == this) {
-        s_instance = nullptr;
-    }
+    KeyHook *expected = this;
+    s_instance.compare_exchange_strong(expected, nullptr);
 }
 
-bool KeyHook::installHook()
+bool KeyHook::start()
 {
     if (m_hookInstalled) {
         return true;
     }
 
+    std::promise<bool> installed;
+    std::future<bool> result = installed.get_future();
+
+    m_captureThread.reset(QThread::create([this, &installed] { runCaptureLoop(installed); }));
+    m_captureThread->setObjectName("KeyHookCapture");
+    m_captureThread->start(QThread::TimeCriticalPriority);
+
+    if (!result.get()) {
+        m_captureThread->wait();
+        m_captureThread.reset();
+        m_captureThreadId = 0;
+        return false;
+    }
+
+    m_hookInstalled = true;
+    return true;
+}
+
+void KeyHook::stop()
+{
+    if (m_hookInstalled && m_captureThread) {
+        if (!PostThreadMessage(m_captureThreadId, WM_QUIT, 0, 0)) {
+            const DWORD error = GetLastError();
+            qWarning() << "Failed to stop keyboard capture thread. Error code:" << error;
+        }
+
+        m_captureThread->wait();
+        m_captureThread.reset();
+        m_captureThreadId = 0;
+        m_hookInstalled = false;
+        emit captureStopped();
+    }
+
+    m_captureFilter.resetPressedKeys();
+}
+
+void KeyHook::runCaptureLoop(std::promise<bool> &installed)
+{
+    MSG msg;
+    PeekMessage(&msg, nullptr, WM_USER, WM_USER, PM_NOREMOVE);
+    m_captureThreadId = GetCurrentThreadId();
+
     m_keyboardHook = SetWindowsHookEx(
         WH_KEYBOARD_LL,
         LowLevelKeyboardProc,
@@ -44,43 +80,45 @@ bool KeyHook::installHook()
         0
     );
 
-    if (m_keyboardHook != nullptr) {
-        m_hookInstalled = true;
-        return true;
-    } else {
+    if (m_keyboardHook == nullptr) {
         const DWORD error = GetLastError();
         qCritical() << "Failed to install keyboard hook. Error code:" << error;
-        return false;
+        installed.set_value(false);
+        return;
     }
-}
 
-void KeyHook::uninstallHook()
-{
-    if (m_hookInstalled && m_keyboardHook != nullptr) {
-        if (!UnhookWindowsHookEx(m_keyboardHook)) {
-            const DWORD error = GetLastError();
-            qWarning() << "Failed to uninstall keyboard hook. Error code:" << error;
-        }
-        
-        m_keyboardHook = nullptr;
-        m_hookInstalled = false;
+    installed.set_value(true);
+
+    while (GetMessage(&msg, nullptr, 0, 0) > 0) {
+        TranslateMessage(&msg);
+        DispatchMessage(&msg);
     }
 
-    {
-        QMutexLocker locker(&m_stateMutex);
-        m_pressedKeys.clear();
+    if (!UnhookWindowsHookEx(m_keyboardHook)) {
+        const DWORD error = GetLastError();
+        qWarning() << "Failed to uninstall keyboard hook. Error code:" << error;
     }
+    m_keyboardHook = nullptr;
 }
 
-bool KeyHook::isHookInstalled() const
+bool KeyHook::isRunning() const
 {
     return m_hookInstalled;
 }
 
 void KeyHook::setSuppressedRepeatKeys(const QSet<int> &vkCodes)
 {
-    QMutexLocker locker(&m_stateMutex);
-    m_suppressedRepeatKeys = vkCodes;
+    m_captureFilter.setSuppressedRepeatKeys(vkCodes);
+}
+
+void KeyHook::setConsumedKeys(const QSet<int> &vkCodes)
+{
+    m_captureFilter.setConsumedKeys(vkCodes);
+}
+
+void KeyHook::setDispatcher(KeyEventDispatcher *dispatcher)
+{
+    m_dispatcher.store(dispatcher, std::memory_order_release);
 }
 
 LRESULT CALLBACK KeyHook::LowLevelKeyboardProc(int nCode, WPARAM wParam, LPARAM lParam)
@@ -90,9 +128,8 @@ LRESULT CALLBACK KeyHook::LowLevelKeyboardProc(int nCode, WPARAM wParam, LPARAM
     if (nCode == HC_ACTION) {
         const KBDLLHOOKSTRUCT* pkbhs = reinterpret_cast<KBDLLHOOKSTRUCT*>(lParam);
 
-        QMutexLocker locker(&s_instanceMutex);
-        if (s_instance != nullptr) {
-            suppressEvent = s_instance->handleHookEvent(wParam, pkbhs);
+        if (KeyHook *instance = s_instance.load(std::memory_order_acquire)) {
+            suppressEvent = instance->handleHookEvent(wParam, pkbhs);
         }
     }
 
@@ -103,54 +140,19 @@ LRESULT CALLBACK KeyHook::LowLevelKeyboardProc(int nCode, WPARAM wParam, LPARAM
     return CallNextHookEx(nullptr, nCode, wParam, lParam);
 }
 
-bool KeyHook::shouldSuppressKey(int vkCode, bool isRepeat) const
+void KeyHook::processKeyEvent(int vkCode, bool isKeyDown, bool isRepeat, DWORD osTimeMs)
 {
-    QMutexLocker locker(&m_stateMutex);
-    return isRepeat && m_suppressedRepeatKeys.contains(vkCode);
-}
-
-void KeyHook::processKeyEvent(int vkCode, bool isKeyDown, bool isRepeat)
-{
-    QMetaObject::invokeMethod(this, "emitKeyPressed",
-                              Qt::QueuedConnection,
-                              Q_ARG(int, vkCode),
-                              Q_ARG(bool, isKeyDown),
-                              Q_ARG(bool, isRepeat));
-}
-
-void KeyHook::emitKeyPressed(int vkCode, bool isKeyDown, bool isRepeat)
-{
-    emit keyPressed(vkCode, isKeyDown, isRepeat);
-}
-
-bool KeyHook::updateRepeatState(int vkCode, bool isKeyDown)
-{
-    QMutexLocker locker(&m_stateMutex);
-    if (isKeyDown) {
-        if (m_pressedKeys.contains(vkCode)) {
-            return true;
-        }
-        m_pressedKeys.insert(vkCode);
-    } else {
-        m_pressedKeys.remove(vkCode);
+    if (KeyEventDispatcher *dispatcher = m_dispatcher.load(std::memory_order_acquire)) {
+        dispatcher->postEvent(KeyEvent(vkCode, isKeyDown, isRepeat, osTimeMs));
     }
-
-    return false;
 }
 
 bool KeyHook::handleHookEvent(WPARAM wParam, const KBDLLHOOKSTRUCT *pkbhs)
 {
     const int vkCode = static_cast<int>(pkbhs->vkCode);
     const bool isKeyDown = (wParam == WM_KEYDOWN || wParam == WM_SYSKEYDOWN);
-    bool isRepeat = false;
 
-    if (isKeyDown) {
-        isRepeat = updateRepeatState(vkCode, true);
-    } else if (wParam == WM_KEYUP || wParam == WM_SYSKEYUP) {
-        updateRepeatState(vkCode, false);
-    }
-
-    const bool suppress = shouldSuppressKey(vkCode, isRepeat);
-    processKeyEvent(vkCode, isKeyDown, isRepeat);
-    return suppress;
-}
\ No newline at end of file
+    const KeyCaptureFilter::Decision decision = m_captureFilter.onKey(vkCode, isKeyDown);
+    processKeyEvent(vkCode, isKeyDown, decision.isRepeat, pkbhs->time);
+    return decision.suppress;
+}
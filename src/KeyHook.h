@@ -1,44 +1,48 @@
 #pragma once
 
-#include <QObject>
-#include <QSet>
-#include <QMutex>
+#include "InputSource.h"
+#include "KeyCaptureFilter.h"
+#include <atomic>
+#include <future>
+#include <memory>
 #include <windows.h>
 
-class KeyHook : public QObject
+class QThread;
+class KeyEventDispatcher;
+
+class KeyHook : public InputSource
 {
     Q_OBJECT
 
 public:
     explicit KeyHook(QObject *parent = nullptr);
-    ~KeyHook();
+    ~KeyHook() override;
 
-    bool installHook();
+    bool start() override;
     
-    void uninstallHook();
+    void stop() override;
     
-    bool isHookInstalled() const;
+    bool isRunning() const override;
     
-    void setSuppressedRepeatKeys(const QSet<int> &vkCodes);
-
-signals:
-    void keyPressed(int vkCode, bool isKeyDown, bool isRepeat);
+    void setSuppressedRepeatKeys(const QSet<int> &vkCodes) override;
+    
+    void setConsumedKeys(const QSet<int> &vkCodes) override;
+    
+    void setDispatcher(KeyEventDispatcher *dispatcher) override;
 
 private:
     static LRESULT CALLBACK LowLevelKeyboardProc(int nCode, WPARAM wParam, LPARAM lParam);
     
-    static KeyHook* s_instance;
+    static std::atomic<KeyHook*> s_instance;
     
-    void processKeyEvent(int vkCode, bool isKeyDown, bool isRepeat);
-
-    Q_INVOKABLE void emitKeyPressed(int vkCode, bool isKeyDown, bool isRepeat);
+    void runCaptureLoop(std::promise<bool> &installed);
+    void processKeyEvent(int vkCode, bool isKeyDown, bool isRepeat, DWORD osTimeMs);
     bool handleHookEvent(WPARAM wParam, const KBDLLHOOKSTRUCT *pkbhs);
-    bool updateRepeatState(int vkCode, bool isKeyDown);
-    bool shouldSuppressKey(int vkCode, bool isRepeat) const;
 
     HHOOK m_keyboardHook;
     bool m_hookInstalled;
-    QSet<int> m_suppressedRepeatKeys;
-    QSet<int> m_pressedKeys;
-    mutable QMutex m_stateMutex;
-};
\ No newline at end of file
+    std::unique_ptr<QThread> m_captureThread;
+    DWORD m_captureThreadId;
+    std::atomic<KeyEventDispatcher*> m_dispatcher;
+    KeyCaptureFilter m_captureFilter;
+};
@@ -1,12 +1,23 @@
 #include "KeyMapping.h"
 #include <QDebug>
 #include <QFile>
+#include <QSaveFile>
 #include <QJsonArray>
 #include <QStandardPaths>
 #include <QDir>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+namespace {
+    std::atomic<std::uint64_t> g_nextTableGeneration(1);
+}
 
 KeyMapping::KeyMapping(QObject *parent)
     : QObject(parent)
+    , m_chordWindowMs(DEFAULT_CHORD_WINDOW_MS)
+    , m_updateDepth(0)
+    , m_hasPendingChanges(false)
 {
 }
 
@@ -16,7 +27,12 @@ KeyMapping::~KeyMapping()
 
 void KeyMapping::addMapping(const KeyMappingEntry &entry)
 {
-    m_mappings[entry.vkCode] = entry;
+    m_mappings[entry.vkCode] = validatedEntry(entry);
+    if (deferChange()) {
+        return;
+    }
+    
+    publishCompiledTable();
     emit mappingAdded(entry);
 }
 
@@ -24,6 +40,11 @@ void KeyMapping::removeMapping(int vkCode)
 {
     if (m_mappings.contains(vkCode)) {
         m_mappings.remove(vkCode);
+        if (deferChange()) {
+            return;
+        }
+        
+        publishCompiledTable();
         emit mappingRemoved(vkCode);
     }
 }
@@ -31,19 +52,29 @@ void KeyMapping::removeMapping(int vkCode)
 void KeyMapping::updateMapping(const KeyMappingEntry &entry)
 {
     if (m_mappings.contains(entry.vkCode)) {
-        m_mappings[entry.vkCode] = entry;
+        m_mappings[entry.vkCode] = validatedEntry(entry);
+        if (deferChange()) {
+            return;
+        }
+        
+        publishCompiledTable();
         emit mappingUpdated(entry);
     }
 }
 
 void KeyMapping::replaceMapping(int oldVkCode, const KeyMappingEntry &newEntry)
 {
-    if (m_mappings.contains(oldVkCode)) {
-        m_mappings.remove(oldVkCode);
-        emit mappingRemoved(oldVkCode);
+    const bool removed = m_mappings.remove(oldVkCode) > 0;
+    m_mappings[newEntry.vkCode] = validatedEntry(newEntry);
+    if (deferChange()) {
+        return;
     }
     
-    m_mappings[newEntry.vkCode] = newEntry;
+    publishCompiledTable();
+    
+    if (removed) {
+        emit mappingRemoved(oldVkCode);
+    }
     emit mappingAdded(newEntry);
 }
 
@@ -62,42 +93,446 @@ QList<KeyMappingEntry> KeyMapping::getAllMappings() const
     return m_mappings.values();
 }
 
+QSet<int> KeyMapping::suppressedRepeatKeys() const
+{
+    QSet<int> vkCodes;
+    for (const KeyMappingEntry &entry : m_mappings) {
+        if (entry.suppressRepeats) {
+            vkCodes.insert(entry.vkCode);
+        }
+    }
+    return vkCodes;
+}
+
+QSet<int> KeyMapping::consumedKeys() const
+{
+    QSet<int> vkCodes;
+    for (const KeyMappingEntry &entry : m_mappings) {
+        if (entry.consumeKey) {
+            vkCodes.insert(entry.vkCode);
+        }
+    }
+    return vkCodes;
+}
+
+void KeyMapping::addChordMapping(const ChordMappingEntry &entry)
+{
+    ChordMappingEntry validated = entry;
+    if (!validateChord(validated)) {
+        qWarning() << "Ignoring chord mapping with fewer than two distinct keys";
+        return;
+    }
+    
+    auto existing = std::find_if(m_chords.begin(), m_chords.end(), [&validated](const ChordMappingEntry &chord) {
+        return chord.vkCodes == validated.vkCodes;
+    });
+    if (existing != m_chords.end()) {
+        *existing = validated;
+    } else {
+        m_chords.append(validated);
+    }
+    if (deferChange()) {
+        return;
+    }
+    
+    publishCompiledTable();
+    emit chordMappingsChanged();
+}
+
+void KeyMapping::removeChordMapping(const QList<int> &vkCodes)
+{
+    QList<int> sorted = vkCodes;
+    std::sort(sorted.begin(), sorted.end());
+    sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+    
+    const auto removed = m_chords.removeIf([&sorted](const ChordMappingEntry &chord) {
+        return chord.vkCodes == sorted;
+    });
+    if (removed == 0 || deferChange()) {
+        return;
+    }
+    
+    publishCompiledTable();
+    emit chordMappingsChanged();
+}
+
+QList<ChordMappingEntry> KeyMapping::getChordMappings() const
+{
+    return m_chords;
+}
+
+void KeyMapping::setChordWindowMs(int windowMs)
+{
+    m_chordWindowMs = std::clamp(windowMs, 0, MAX_CHORD_WINDOW_MS);
+    if (deferChange()) {
+        return;
+    }
+    
+    publishCompiledTable();
+    emit chordMappingsChanged();
+}
+
+int KeyMapping::chordWindowMs() const
+{
+    return m_chordWindowMs;
+}
+
+void KeyMapping::addSequenceMapping(const SequenceMappingEntry &entry)
+{
+    SequenceMappingEntry validated = entry;
+    if (!validateSequence(validated)) {
+        qWarning() << "Ignoring sequence mapping without 2 to" << CompiledSequenceNode::MAX_STEPS
+                   << "keys and a message";
+        return;
+    }
+    
+    auto existing = std::find_if(m_sequences.begin(), m_sequences.end(), [&validated](const SequenceMappingEntry &sequence) {
+        return sequence.vkCodes == validated.vkCodes;
+    });
+    if (existing != m_sequences.end()) {
+        *existing = validated;
+    } else {
+        m_sequences.append(validated);
+    }
+    if (deferChange()) {
+        return;
+    }
+    
+    publishCompiledTable();
+    emit sequenceMappingsChanged();
+}
+
+void KeyMapping::removeSequenceMapping(const QList<int> &vkCodes)
+{
+    const auto removed = m_sequences.removeIf([&vkCodes](const SequenceMappingEntry &sequence) {
+        return sequence.vkCodes == vkCodes;
+    });
+    if (removed == 0 || deferChange()) {
+        return;
+    }
+    
+    publishCompiledTable();
+    emit sequenceMappingsChanged();
+}
+
+QList<SequenceMappingEntry> KeyMapping::getSequenceMappings() const
+{
+    return m_sequences;
+}
+
+void KeyMapping::addMacroMapping(const MacroMappingEntry &entry)
+{
+    MacroMappingEntry validated = entry;
+    if (!validateMacro(validated)) {
+        qWarning() << "Ignoring macro mapping without 1 to" << CompiledMacro::MAX_EVENTS << "events";
+        return;
+    }
+    
+    m_macros[validated.vkCode] = validated;
+    if (deferChange()) {
+        return;
+    }
+    
+    publishCompiledTable();
+    emit macroMappingsChanged();
+}
+
+void KeyMapping::removeMacroMapping(int vkCode)
+{
+    if (m_macros.remove(vkCode) == 0 || deferChange()) {
+        return;
+    }
+    
+    publishCompiledTable();
+    emit macroMappingsChanged();
+}
+
+QList<MacroMappingEntry> KeyMapping::getMacroMappings() const
+{
+    return m_macros.values();
+}
+
 void KeyMapping::clearAllMappings()
 {
     const QList<int> vkCodes = m_mappings.keys();
+    const bool hadChords = !m_chords.isEmpty();
+    const bool hadSequences = !m_sequences.isEmpty();
+    const bool hadMacros = !m_macros.isEmpty();
     m_mappings.clear();
+    m_chords.clear();
+    m_sequences.clear();
+    m_macros.clear();
+    if (deferChange()) {
+        return;
+    }
+    
+    publishCompiledTable();
     
     for (int vkCode : vkCodes) {
         emit mappingRemoved(vkCode);
     }
+    if (hadChords) {
+        emit chordMappingsChanged();
+    }
+    if (hadSequences) {
+        emit sequenceMappingsChanged();
+    }
+    if (hadMacros) {
+        emit macroMappingsChanged();
+    }
+}
+
+void KeyMapping::beginUpdate()
+{
+    ++m_updateDepth;
 }
 
-void KeyMapping::processKeyEvent(int vkCode, bool isKeyDown, bool isRepeat)
+void KeyMapping::endUpdate()
 {
-    if (!hasMapping(vkCode)) {
+    if (m_updateDepth == 0) {
+        qWarning() << "KeyMapping::endUpdate called without matching beginUpdate";
         return;
     }
     
-    KeyMappingEntry entry = getMapping(vkCode);
-    
-    if (isRepeat && entry.filterRepeats) {
+    if (--m_updateDepth > 0 || !m_hasPendingChanges) {
         return;
     }
     
-    MidiMessage message;
-    bool shouldSend = false;
+    m_hasPendingChanges = false;
+    publishCompiledTable();
+    emit mappingsReset();
+}
+
+bool KeyMapping::deferChange()
+{
+    if (m_updateDepth == 0) {
+        return false;
+    }
+    
+    m_hasPendingChanges = true;
+    return true;
+}
+
+bool KeyMapping::processKeyEvent(int vkCode, bool isKeyDown, bool isRepeat, MidiBytes &message) const
+{
+    const auto table = m_compiledTable.read();
+    return lookup(*table, vkCode, isKeyDown, isRepeat, message);
+}
+
+RcuCell<CompiledMappingTable>::ReadGuard KeyMapping::compiledTable() const
+{
+    return m_compiledTable.read();
+}
+
+bool KeyMapping::lookup(const CompiledMappingTable &table, int vkCode, bool isKeyDown, bool isRepeat,
+                        MidiBytes &message)
+{
+    if (static_cast<unsigned int>(vkCode) >= CompiledMappingTable::SLOT_COUNT) {
+        return false;
+    }
+    
+    const CompiledMapping &slot = table.mappings[vkCode];
+    const unsigned int edge = isKeyDown ? 1u : 0u;
+    
+    if (!(slot.flags & (CompiledMapping::KeyUpEnabled << edge))) {
+        return false;
+    }
+    
+    if (isRepeat && (slot.flags & CompiledMapping::FilterRepeats)) {
+        return false;
+    }
+    
+    message = slot.messages[edge];
+    return true;
+}
+
+KeyMappingEntry KeyMapping::validatedEntry(const KeyMappingEntry &entry)
+{
+    KeyMappingEntry validated = entry;
+    validated.keyDownMessage.validate();
+    validated.keyUpMessage.validate();
+    validated.holdMessage.validate();
+    validated.holdThresholdMs = std::clamp(validated.holdThresholdMs, MIN_HOLD_THRESHOLD_MS, MAX_HOLD_THRESHOLD_MS);
+    return validated;
+}
+
+bool KeyMapping::validateChord(ChordMappingEntry &entry)
+{
+    QList<int> vkCodes;
+    for (int vkCode : entry.vkCodes) {
+        if (vkCode > 0 && vkCode < CompiledMappingTable::SLOT_COUNT) {
+            vkCodes.append(vkCode);
+        }
+    }
+    std::sort(vkCodes.begin(), vkCodes.end());
+    vkCodes.erase(std::unique(vkCodes.begin(), vkCodes.end()), vkCodes.end());
     
-    if (isKeyDown && entry.enableKeyDown) {
-        message = entry.keyDownMessage;
-        shouldSend = true;
-    } else if (!isKeyDown && entry.enableKeyUp) {
-        message = entry.keyUpMessage;
-        shouldSend = true;
+    entry.vkCodes = vkCodes;
+    entry.keyDownMessage.validate();
+    entry.keyUpMessage.validate();
+    return vkCodes.size() >= 2;
+}
+
+bool KeyMapping::validateSequence(SequenceMappingEntry &entry)
+{
+    for (int vkCode : entry.vkCodes) {
+        if (vkCode <= 0 || vkCode >= CompiledMappingTable::SLOT_COUNT) {
+            return false;
+        }
+    }
+    for (MidiMessage &message : entry.messages) {
+        message.validate();
+    }
+    entry.stepTimeoutMs = std::max(1, entry.stepTimeoutMs);
+    return entry.vkCodes.size() >= 2 && entry.vkCodes.size() <= CompiledSequenceNode::MAX_STEPS
+        && !entry.messages.isEmpty() && entry.messages.size() <= CompiledSequenceNode::MAX_MESSAGES;
+}
+
+bool KeyMapping::validateMacro(MacroMappingEntry &entry)
+{
+    for (MacroEvent &event : entry.events) {
+        event.atMs = std::clamp(event.atMs, 0.0, static_cast<double>(MAX_MACRO_LENGTH_MS));
+        event.message.validate();
+    }
+    std::stable_sort(entry.events.begin(), entry.events.end(), [](const MacroEvent &a, const MacroEvent &b) {
+        return a.atMs < b.atMs;
+    });
+    return entry.vkCode > 0 && entry.vkCode < CompiledMappingTable::SLOT_COUNT
+        && !entry.events.isEmpty() && entry.events.size() <= CompiledMacro::MAX_EVENTS;
+}
+
+void KeyMapping::publishCompiledTable()
+{
+    auto table = std::make_unique<CompiledMappingTable>();
+    
+    for (auto it = m_mappings.constBegin(); it != m_mappings.constEnd(); ++it) {
+        const KeyMappingEntry &entry = it.value();
+        if (entry.vkCode <= 0 || entry.vkCode >= CompiledMappingTable::SLOT_COUNT) {
+            continue;
+        }
+        
+        CompiledMapping &slot = table->mappings[entry.vkCode];
+        slot.messages[0] = entry.keyUpMessage.toBytes();
+        slot.messages[1] = entry.keyDownMessage.toBytes();
+        slot.flags = static_cast<std::uint8_t>(
+            (entry.enableKeyUp ? CompiledMapping::KeyUpEnabled : 0)
+            | (entry.enableKeyDown ? CompiledMapping::KeyDownEnabled : 0)
+            | (entry.filterRepeats ? CompiledMapping::FilterRepeats : 0)
+            | (entry.enableHold ? CompiledMapping::HoldEnabled : 0));
+        slot.holdMessage = entry.holdMessage.toBytes();
+        slot.holdThresholdMs = static_cast<std::uint16_t>(entry.holdThresholdMs);
+    }
+    
+    compileChords(*table);
+    compileSequences(*table);
+    compileMacros(*table);
+    table->generation = g_nextTableGeneration.fetch_add(1, std::memory_order_relaxed);
+    m_compiledTable.publish(std::move(table));
+}
+
+void KeyMapping::compileMacros(CompiledMappingTable &table) const
+{
+    for (const MacroMappingEntry &entry : m_macros) {
+        CompiledMacro &macro = table.macros[entry.vkCode];
+        macro.eventStart = static_cast<std::uint32_t>(table.macroEvents.size());
+        macro.eventCount = static_cast<std::uint16_t>(entry.events.size());
+        macro.flags = entry.cancelOnRelease ? CompiledMacro::CancelOnRelease : 0;
+        
+        for (const MacroEvent &event : entry.events) {
+            CompiledMacroEvent compiled;
+            compiled.offsetUs = static_cast<std::uint32_t>(std::llround(event.atMs * 1000.0));
+            compiled.message = event.message.toBytes();
+            table.macroEvents.push_back(compiled);
+        }
+    }
+}
+
+void KeyMapping::compileSequences(CompiledMappingTable &table) const
+{
+    if (m_sequences.isEmpty()) {
+        return;
+    }
+    
+    constexpr int MAX_NODES = 65536;
+    table.sequenceNodes.resize(1);
+    table.sequenceTransitions.assign(CompiledMappingTable::SLOT_COUNT, 0);
+    
+    for (const SequenceMappingEntry &entry : m_sequences) {
+        const std::int64_t stepTimeoutNs = static_cast<std::int64_t>(entry.stepTimeoutMs) * 1000000;
+        int state = 0;
+        
+        for (int vkCode : entry.vkCodes) {
+            const std::size_t edge = static_cast<std::size_t>(state) * CompiledMappingTable::SLOT_COUNT + vkCode;
+            int next = table.sequenceTransitions[edge];
+            if (next == 0) {
+                if (static_cast<int>(table.sequenceNodes.size()) == MAX_NODES) {
+                    qWarning() << "Too many sequence mappings; ignoring the rest";
+                    return;
+                }
+                next = static_cast<int>(table.sequenceNodes.size());
+                table.sequenceTransitions[edge] = static_cast<std::uint16_t>(next);
+                table.sequenceTransitions.resize(table.sequenceTransitions.size() + CompiledMappingTable::SLOT_COUNT, 0);
+                
+                CompiledSequenceNode node;
+                node.depth = static_cast<std::uint8_t>(table.sequenceNodes[state].depth + 1);
+                table.sequenceNodes.push_back(node);
+                table.sequenceNodes[state].flags |= CompiledSequenceNode::HasChildren;
+            }
+            
+            // Shared prefixes wait as long as the most patient sequence through them
+            table.sequenceNodes[state].timeoutNs = std::max(table.sequenceNodes[state].timeoutNs, stepTimeoutNs);
+            state = next;
+        }
+        
+        CompiledSequenceNode &end = table.sequenceNodes[state];
+        end.flags |= CompiledSequenceNode::Accepting;
+        end.messageStart = static_cast<std::uint32_t>(table.sequenceMessages.size());
+        end.messageCount = static_cast<std::uint8_t>(entry.messages.size());
+        end.timeoutNs = std::max(end.timeoutNs, stepTimeoutNs);
+        for (const MidiMessage &message : entry.messages) {
+            table.sequenceMessages.push_back(message.toBytes());
+        }
+    }
+}
+
+void KeyMapping::compileChords(CompiledMappingTable &table) const
+{
+    table.chordWindowNs = static_cast<std::int64_t>(m_chordWindowMs) * 1000000;
+    
+    std::vector<CompiledChord> chords;
+    chords.reserve(m_chords.size());
+    for (const ChordMappingEntry &entry : m_chords) {
+        CompiledChord chord;
+        for (int vkCode : entry.vkCodes) {
+            chord.keys[vkCode >> 6] |= std::uint64_t(1) << (vkCode & 63);
+            if (entry.withholdKeys) {
+                table.withheldKeys.insert(vkCode);
+            }
+        }
+        chord.messages[0] = entry.keyUpMessage.toBytes();
+        chord.messages[1] = entry.keyDownMessage.toBytes();
+        chord.flags = static_cast<std::uint8_t>(
+            (entry.enableKeyUp ? CompiledChord::KeyUpEnabled : 0)
+            | (entry.withholdKeys ? CompiledChord::WithholdKeys : 0));
+        chord.keyCount = static_cast<std::uint8_t>(entry.vkCodes.size());
+        chords.push_back(chord);
     }
     
-    if (shouldSend) {
-        emit midiMessageTriggered(message, vkCode, isKeyDown);
+    // A key press that completes both A+B and A+B+C should fire the more specific chord
+    std::stable_sort(chords.begin(), chords.end(), [](const CompiledChord &a, const CompiledChord &b) {
+        return a.keyCount > b.keyCount;
+    });
+    
+    for (int vkCode = 0; vkCode < CompiledMappingTable::SLOT_COUNT; ++vkCode) {
+        table.chordStart[vkCode] = static_cast<std::uint32_t>(table.chordsByKey.size());
+        const std::uint64_t bit = std::uint64_t(1) << (vkCode & 63);
+        for (const CompiledChord &chord : chords) {
+            if (chord.keys[vkCode >> 6] & bit) {
+                table.chordsByKey.push_back(chord);
+            }
+        }
     }
+    table.chordStart[CompiledMappingTable::SLOT_COUNT] = static_cast<std::uint32_t>(table.chordsByKey.size());
 }
 
 QJsonDocument KeyMapping::toJson() const
@@ -112,6 +547,31 @@ QJsonDocument KeyMapping::toJson() const
     rootObject["version"] = "1.0";
     rootObject["mappings"] = mappingsArray;
     
+    if (!m_chords.isEmpty()) {
+        QJsonArray chordsArray;
+        for (const ChordMappingEntry &chord : m_chords) {
+            chordsArray.append(chordToJson(chord));
+        }
+        rootObject["chords"] = chordsArray;
+    }
+    rootObject["chordWindowMs"] = m_chordWindowMs;
+    
+    if (!m_sequences.isEmpty()) {
+        QJsonArray sequencesArray;
+        for (const SequenceMappingEntry &sequence : m_sequences) {
+            sequencesArray.append(sequenceToJson(sequence));
+        }
+        rootObject["sequences"] = sequencesArray;
+    }
+    
+    if (!m_macros.isEmpty()) {
+        QJsonArray macrosArray;
+        for (const MacroMappingEntry &macro : m_macros) {
+            macrosArray.append(macroToJson(macro));
+        }
+        rootObject["macros"] = macrosArray;
+    }
+    
     return QJsonDocument(rootObject);
 }
 
@@ -127,6 +587,7 @@ bool KeyMapping::fromJson(const QJsonDocument &doc)
         return false;
     }
     
+    beginUpdate();
     clearAllMappings();
     
     QJsonArray mappingsArray = rootObject["mappings"].toArray();
@@ -140,6 +601,29 @@ bool KeyMapping::fromJson(const QJsonDocument &doc)
         }
     }
     
+    setChordWindowMs(rootObject["chordWindowMs"].toInt(DEFAULT_CHORD_WINDOW_MS));
+    const QJsonArray chordsArray = rootObject["chords"].toArray();
+    for (const QJsonValue &value : chordsArray) {
+        if (value.isObject()) {
+            addChordMapping(jsonToChord(value.toObject()));
+        }
+    }
+    
+    const QJsonArray sequencesArray = rootObject["sequences"].toArray();
+    for (const QJsonValue &value : sequencesArray) {
+        if (value.isObject()) {
+            addSequenceMapping(jsonToSequence(value.toObject()));
+        }
+    }
+    
+    const QJsonArray macrosArray = rootObject["macros"].toArray();
+    for (const QJsonValue &value : macrosArray) {
+        if (value.isObject()) {
+            addMacroMapping(jsonToMacro(value.toObject()));
+        }
+    }
+    
+    endUpdate();
     return true;
 }
 
@@ -147,15 +631,17 @@ bool KeyMapping::saveToFile(const QString &filename) const
 {
     QJsonDocument doc = toJson();
     
-    QFile file(filename);
+    QSaveFile file(filename);
     if (!file.open(QIODevice::WriteOnly)) {
         return false;
     }
     
-    qint64 bytesWritten = file.write(doc.toJson());
-    file.close();
+    if (file.write(doc.toJson()) <= 0) {
+        file.cancelWriting();
+        return false;
+    }
     
-    return bytesWritten > 0;
+    return file.commit();
 }
 
 bool KeyMapping::loadFromFile(const QString &filename)
@@ -188,6 +674,7 @@ KeyMappingEntry KeyMapping::jsonToEntry(const QJsonObject &obj) const
     entry.enableKeyUp = obj["enableKeyUp"].toBool(false);
     entry.filterRepeats = obj["filterRepeats"].toBool(true);
     entry.suppressRepeats = obj["suppressRepeats"].toBool(false);
+    entry.consumeKey = obj["consumeKey"].toBool(false);
     
     if (obj.contains("keyDownMessage") && obj["keyDownMessage"].isObject()) {
         entry.keyDownMessage = jsonToMidiMessage(obj["keyDownMessage"].toObject());
@@ -197,6 +684,12 @@ KeyMappingEntry KeyMapping::jsonToEntry(const QJsonObject &obj) const
         entry.keyUpMessage = jsonToMidiMessage(obj["keyUpMessage"].toObject());
     }
     
+    entry.enableHold = obj["enableHold"].toBool(false);
+    entry.holdThresholdMs = obj["holdThresholdMs"].toInt(entry.holdThresholdMs);
+    if (obj["holdMessage"].isObject()) {
+        entry.holdMessage = jsonToMidiMessage(obj["holdMessage"].toObject());
+    }
+    
     return entry;
 }
 
@@ -210,9 +703,127 @@ QJsonObject KeyMapping::entryToJson(const KeyMappingEntry &entry) const
     obj["enableKeyUp"] = entry.enableKeyUp;
     obj["filterRepeats"] = entry.filterRepeats;
     obj["suppressRepeats"] = entry.suppressRepeats;
+    obj["consumeKey"] = entry.consumeKey;
     obj["keyDownMessage"] = midiMessageToJson(entry.keyDownMessage);
     obj["keyUpMessage"] = midiMessageToJson(entry.keyUpMessage);
     
+    if (entry.enableHold) {
+        obj["enableHold"] = true;
+        obj["holdThresholdMs"] = entry.holdThresholdMs;
+        obj["holdMessage"] = midiMessageToJson(entry.holdMessage);
+    }
+    
+    return obj;
+}
+
+ChordMappingEntry KeyMapping::jsonToChord(const QJsonObject &obj) const
+{
+    ChordMappingEntry entry;
+    
+    for (const QJsonValue &vkCode : obj["vkCodes"].toArray()) {
+        entry.vkCodes.append(vkCode.toInt());
+    }
+    entry.enableKeyUp = obj["enableKeyUp"].toBool(false);
+    entry.withholdKeys = obj["withholdKeys"].toBool(true);
+    
+    if (obj.contains("keyDownMessage") && obj["keyDownMessage"].isObject()) {
+        entry.keyDownMessage = jsonToMidiMessage(obj["keyDownMessage"].toObject());
+    }
+    
+    if (obj.contains("keyUpMessage") && obj["keyUpMessage"].isObject()) {
+        entry.keyUpMessage = jsonToMidiMessage(obj["keyUpMessage"].toObject());
+    }
+    
+    return entry;
+}
+
+QJsonObject KeyMapping::chordToJson(const ChordMappingEntry &entry) const
+{
+    QJsonObject obj;
+    
+    QJsonArray vkCodes;
+    for (int vkCode : entry.vkCodes) {
+        vkCodes.append(vkCode);
+    }
+    obj["vkCodes"] = vkCodes;
+    obj["enableKeyUp"] = entry.enableKeyUp;
+    obj["withholdKeys"] = entry.withholdKeys;
+    obj["keyDownMessage"] = midiMessageToJson(entry.keyDownMessage);
+    obj["keyUpMessage"] = midiMessageToJson(entry.keyUpMessage);
+    
+    return obj;
+}
+
+SequenceMappingEntry KeyMapping::jsonToSequence(const QJsonObject &obj) const
+{
+    SequenceMappingEntry entry;
+    
+    for (const QJsonValue &vkCode : obj["vkCodes"].toArray()) {
+        entry.vkCodes.append(vkCode.toInt());
+    }
+    entry.stepTimeoutMs = obj["stepTimeoutMs"].toInt(entry.stepTimeoutMs);
+    for (const QJsonValue &message : obj["messages"].toArray()) {
+        if (message.isObject()) {
+            entry.messages.append(jsonToMidiMessage(message.toObject()));
+        }
+    }
+    
+    return entry;
+}
+
+QJsonObject KeyMapping::sequenceToJson(const SequenceMappingEntry &entry) const
+{
+    QJsonObject obj;
+    
+    QJsonArray vkCodes;
+    for (int vkCode : entry.vkCodes) {
+        vkCodes.append(vkCode);
+    }
+    obj["vkCodes"] = vkCodes;
+    obj["stepTimeoutMs"] = entry.stepTimeoutMs;
+    
+    QJsonArray messages;
+    for (const MidiMessage &message : entry.messages) {
+        messages.append(midiMessageToJson(message));
+    }
+    obj["messages"] = messages;
+    
+    return obj;
+}
+
+MacroMappingEntry KeyMapping::jsonToMacro(const QJsonObject &obj) const
+{
+    MacroMappingEntry entry;
+    
+    entry.vkCode = obj["vkCode"].toInt();
+    entry.cancelOnRelease = obj["cancelOnRelease"].toBool(entry.cancelOnRelease);
+    for (const QJsonValue &value : obj["events"].toArray()) {
+        if (value.isObject()) {
+            MacroEvent event;
+            event.atMs = value.toObject()["atMs"].toDouble(0.0);
+            event.message = jsonToMidiMessage(value.toObject());
+            entry.events.append(event);
+        }
+    }
+    
+    return entry;
+}
+
+QJsonObject KeyMapping::macroToJson(const MacroMappingEntry &entry) const
+{
+    QJsonObject obj;
+    
+    obj["vkCode"] = entry.vkCode;
+    obj["cancelOnRelease"] = entry.cancelOnRelease;
+    
+    QJsonArray events;
+    for (const MacroEvent &event : entry.events) {
+        QJsonObject eventObject = midiMessageToJson(event.message);
+        eventObject["atMs"] = event.atMs;
+        events.append(eventObject);
+    }
+    obj["events"] = events;
+    
     return obj;
 }
 
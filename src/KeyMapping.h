@@ -2,9 +2,12 @@
 
 #include <QObject>
 #include <QMap>
+#include <QSet>
 #include <QJsonObject>
 #include <QJsonDocument>
 #include "MidiEngine.h"
+#include "CompiledMappingTable.h"
+#include "RcuCell.h"
 
 struct KeyMappingEntry {
     int vkCode;
@@ -13,10 +16,56 @@ struct KeyMappingEntry {
     bool enableKeyUp;
     bool filterRepeats;
     bool suppressRepeats;
+    bool consumeKey;
     MidiMessage keyDownMessage;
     MidiMessage keyUpMessage;
     
-    KeyMappingEntry() : vkCode(0), enableKeyDown(true), enableKeyUp(false), filterRepeats(true), suppressRepeats(false) {}
+    // Dual role: a key released within holdThresholdMs sends keyDownMessage on release,
+    // one held longer sends holdMessage instead once the threshold passes
+    bool enableHold;
+    int holdThresholdMs;
+    MidiMessage holdMessage;
+    
+    KeyMappingEntry() : vkCode(0), enableKeyDown(true), enableKeyUp(false), filterRepeats(true), suppressRepeats(false), consumeKey(false),
+                        enableHold(false), holdThresholdMs(200) {}
+};
+
+// Keys pressed together within the chord window send keyDownMessage. With withholdKeys
+// the keys' own mappings wait for the window to pass and are dropped if the chord completes.
+struct ChordMappingEntry {
+    QList<int> vkCodes;
+    bool enableKeyUp;       // keyUpMessage goes out when the first chord key is released
+    bool withholdKeys;
+    MidiMessage keyDownMessage;
+    MidiMessage keyUpMessage;
+    
+    ChordMappingEntry() : enableKeyUp(false), withholdKeys(true) {}
+};
+
+// Keys pressed one after another, each within stepTimeoutMs of the last, send the
+// messages as one burst. The keys' own mappings still fire.
+struct SequenceMappingEntry {
+    QList<int> vkCodes;
+    int stepTimeoutMs;
+    QList<MidiMessage> messages;
+    
+    SequenceMappingEntry() : stepTimeoutMs(1000) {}
+};
+
+struct MacroEvent {
+    double atMs;            // Time after the key press
+    MidiMessage message;
+    
+    MacroEvent() : atMs(0.0) {}
+};
+
+// Pressing the key plays the events on their own schedule, alongside the key's own mapping
+struct MacroMappingEntry {
+    int vkCode;
+    bool cancelOnRelease;   // Releasing the key stops the macro and turns off the notes it left on
+    QList<MacroEvent> events;
+    
+    MacroMappingEntry() : vkCode(0), cancelOnRelease(true) {}
 };
 
 class KeyMapping : public QObject
@@ -24,6 +73,12 @@ class KeyMapping : public QObject
     Q_OBJECT
 
 public:
+    static constexpr int DEFAULT_CHORD_WINDOW_MS = 50;
+    static constexpr int MAX_CHORD_WINDOW_MS = 1000;
+    static constexpr int MIN_HOLD_THRESHOLD_MS = 1;
+    static constexpr int MAX_HOLD_THRESHOLD_MS = 10000;
+    static constexpr int MAX_MACRO_LENGTH_MS = 60000;
+
     explicit KeyMapping(QObject *parent = nullptr);
     ~KeyMapping();
 
@@ -41,9 +96,48 @@ public:
     
     QList<KeyMappingEntry> getAllMappings() const;
     
+    QSet<int> suppressedRepeatKeys() const;
+    
+    QSet<int> consumedKeys() const;
+    
+    // Replaces any chord with the same key set; needs at least two distinct keys
+    void addChordMapping(const ChordMappingEntry &entry);
+    
+    void removeChordMapping(const QList<int> &vkCodes);
+    
+    QList<ChordMappingEntry> getChordMappings() const;
+    
+    void setChordWindowMs(int windowMs);
+    
+    int chordWindowMs() const;
+    
+    // Replaces any sequence with the same keys; needs two to seven keys and at least one message
+    void addSequenceMapping(const SequenceMappingEntry &entry);
+    
+    void removeSequenceMapping(const QList<int> &vkCodes);
+    
+    QList<SequenceMappingEntry> getSequenceMappings() const;
+    
+    // Replaces the key's macro; needs one to CompiledMacro::MAX_EVENTS events
+    void addMacroMapping(const MacroMappingEntry &entry);
+    
+    void removeMacroMapping(int vkCode);
+    
+    QList<MacroMappingEntry> getMacroMappings() const;
+    
     void clearAllMappings();
+    
+    void beginUpdate();
+    
+    void endUpdate();
+
+    bool processKeyEvent(int vkCode, bool isKeyDown, bool isRepeat, MidiBytes &message) const;
 
-    void processKeyEvent(int vkCode, bool isKeyDown, bool isRepeat);
+    // Pins the current compiled table for a caller that consults it more than once per event
+    RcuCell<CompiledMappingTable>::ReadGuard compiledTable() const;
+    
+    static bool lookup(const CompiledMappingTable &table, int vkCode, bool isKeyDown, bool isRepeat,
+                       MidiBytes &message);
 
     QJsonDocument toJson() const;
     
@@ -60,16 +154,60 @@ signals:
     
     void mappingUpdated(const KeyMappingEntry &entry);
     
-    void midiMessageTriggered(const MidiMessage &message, int vkCode, bool isKeyDown);
+    void mappingsReset();
+    
+    void chordMappingsChanged();
+    
+    void sequenceMappingsChanged();
+    
+    void macroMappingsChanged();
+
 
 private:
+    static KeyMappingEntry validatedEntry(const KeyMappingEntry &entry);
+    
+    static bool validateChord(ChordMappingEntry &entry);
+    
+    void compileChords(CompiledMappingTable &table) const;
+    
+    static bool validateSequence(SequenceMappingEntry &entry);
+    
+    void compileSequences(CompiledMappingTable &table) const;
+    
+    static bool validateMacro(MacroMappingEntry &entry);
+    
+    void compileMacros(CompiledMappingTable &table) const;
+    
+    bool deferChange();
+    
+    void publishCompiledTable();
+    
     KeyMappingEntry jsonToEntry(const QJsonObject &obj) const;
     
     QJsonObject entryToJson(const KeyMappingEntry &entry) const;
     
+    ChordMappingEntry jsonToChord(const QJsonObject &obj) const;
+    
+    QJsonObject chordToJson(const ChordMappingEntry &entry) const;
+    
+    SequenceMappingEntry jsonToSequence(const QJsonObject &obj) const;
+    
+    QJsonObject sequenceToJson(const SequenceMappingEntry &entry) const;
+    
+    MacroMappingEntry jsonToMacro(const QJsonObject &obj) const;
+    
+    QJsonObject macroToJson(const MacroMappingEntry &entry) const;
+    
     MidiMessage jsonToMidiMessage(const QJsonObject &obj) const;
     
     QJsonObject midiMessageToJson(const MidiMessage &message) const;
 
     QMap<int, KeyMappingEntry> m_mappings;
+    QList<ChordMappingEntry> m_chords;
+    QList<SequenceMappingEntry> m_sequences;
+    QMap<int, MacroMappingEntry> m_macros;
+    int m_chordWindowMs;
+    RcuCell<CompiledMappingTable> m_compiledTable;
+    int m_updateDepth;
+    bool m_hasPendingChanges;
 };
\ No newline at end of file
@@ -0,0 +1,162 @@
+#include "KeyNameCache.h"
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+namespace {
+    QString unknownKeyName(int vkCode)
+    {
+        return QString("Unknown Key (VK_%1)").arg(vkCode);
+    }
+}
+
+quintptr FallbackKeyNameProvider::layoutId() const
+{
+    return 0;
+}
+
+QString FallbackKeyNameProvider::keyName(int vkCode) const
+{
+    if (vkCode >= 0x30 && vkCode <= 0x39) {
+        return QString(QChar('0' + (vkCode - 0x30)));
+    }
+    if (vkCode >= 0x41 && vkCode <= 0x5A) {
+        return QString(QChar('A' + (vkCode - 0x41)));
+    }
+    if (vkCode >= 0x60 && vkCode <= 0x69) {
+        return QString("Num %1").arg(vkCode - 0x60);
+    }
+    if (vkCode >= 0x70 && vkCode <= 0x87) {
+        return QString("F%1").arg(vkCode - 0x70 + 1);
+    }
+
+    switch (vkCode) {
+        case 0x01: return "Left Mouse Button";
+        case 0x02: return "Right Mouse Button";
+        case 0x04: return "Middle Mouse Button";
+        case 0x05: return "X1 Mouse Button";
+        case 0x06: return "X2 Mouse Button";
+        case 0x08: return "Backspace";
+        case 0x09: return "Tab";
+        case 0x0D: return "Enter";
+        case 0x10: return "Shift";
+        case 0x11: return "Ctrl";
+        case 0x12: return "Alt";
+        case 0x13: return "Pause";
+        case 0x14: return "Caps Lock";
+        case 0x1B: return "Esc";
+        case 0x20: return "Space";
+        case 0x21: return "Page Up";
+        case 0x22: return "Page Down";
+        case 0x23: return "End";
+        case 0x24: return "Home";
+        case 0x25: return "Left";
+        case 0x26: return "Up";
+        case 0x27: return "Right";
+        case 0x28: return "Down";
+        case 0x2C: return "Print Screen";
+        case 0x2D: return "Insert";
+        case 0x2E: return "Delete";
+        case 0x5B: return "Left Windows";
+        case 0x5C: return "Right Windows";
+        case 0x5D: return "Applications";
+        case 0x6A: return "Num *";
+        case 0x6B: return "Num +";
+        case 0x6D: return "Num -";
+        case 0x6E: return "Num Del";
+        case 0x6F: return "Num /";
+        case 0x90: return "Num Lock";
+        case 0x91: return "Scroll Lock";
+        case 0xA0: return "Left Shift";
+        case 0xA1: return "Right Shift";
+        case 0xA2: return "Left Ctrl";
+        case 0xA3: return "Right Ctrl";
+        case 0xA4: return "Left Alt";
+        case 0xA5: return "Right Alt";
+        case 0xBA: return ";";
+        case 0xBB: return "=";
+        case 0xBC: return ",";
+        case 0xBD: return "-";
+        case 0xBE: return ".";
+        case 0xBF: return "/";
+        case 0xC0: return "`";
+        case 0xDB: return "[";
+        case 0xDC: return "\\";
+        case 0xDD: return "]";
+        case 0xDE: return "'";
+        default: return unknownKeyName(vkCode);
+    }
+}
+
+#ifdef _WIN32
+quintptr WindowsKeyNameProvider::layoutId() const
+{
+    return reinterpret_cast<quintptr>(GetKeyboardLayout(0));
+}
+
+QString WindowsKeyNameProvider::keyName(int vkCode) const
+{
+    UINT scanCode = MapVirtualKey(vkCode, MAPVK_VK_TO_VSC);
+    
+    if (vkCode == VK_LEFT || vkCode == VK_UP || vkCode == VK_RIGHT || vkCode == VK_DOWN ||
+        vkCode == VK_PRIOR || vkCode == VK_NEXT || vkCode == VK_END || vkCode == VK_HOME ||
+        vkCode == VK_INSERT || vkCode == VK_DELETE || vkCode == VK_DIVIDE || vkCode == VK_NUMLOCK) {
+        scanCode |= 0x100;
+    }
+    
+    wchar_t keyNameBuffer[256];
+    int result = GetKeyNameTextW(scanCode << 16, keyNameBuffer, 256);
+    
+    if (result > 0) {
+        return QString::fromWCharArray(keyNameBuffer, result);
+    }
+    
+    return m_fallback.keyName(vkCode);
+}
+#endif
+
+KeyNameCache::KeyNameCache(std::unique_ptr<KeyNameProvider> provider)
+    : m_provider(std::move(provider))
+    , m_layoutId(0)
+    , m_valid(false)
+{
+}
+
+QString KeyNameCache::name(int vkCode)
+{
+    if (vkCode < 0 || vkCode >= KEY_COUNT) {
+        return unknownKeyName(vkCode);
+    }
+
+    const quintptr layoutId = m_provider->layoutId();
+    if (!m_valid || layoutId != m_layoutId) {
+        rebuild(layoutId);
+    }
+
+    return m_names[vkCode];
+}
+
+void KeyNameCache::invalidate()
+{
+    m_valid = false;
+}
+
+KeyNameCache &KeyNameCache::instance()
+{
+#ifdef _WIN32
+    static KeyNameCache cache(std::make_unique<WindowsKeyNameProvider>());
+#else
+    static KeyNameCache cache(std::make_unique<FallbackKeyNameProvider>());
+#endif
+    return cache;
+}
+
+void KeyNameCache::rebuild(quintptr layoutId)
+{
+    for (int vkCode = 0; vkCode < KEY_COUNT; ++vkCode) {
+        m_names[vkCode] = m_provider->keyName(vkCode);
+    }
+
+    m_layoutId = layoutId;
+    m_valid = true;
+}
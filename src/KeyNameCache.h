@@ -0,0 +1,60 @@
+#pragma once
+
+#include <QString>
+#include <QtGlobal>
+#include <array>
+#include <memory>
+
+class KeyNameProvider
+{
+public:
+    virtual ~KeyNameProvider() = default;
+
+    virtual quintptr layoutId() const = 0;
+    
+    virtual QString keyName(int vkCode) const = 0;
+};
+
+class FallbackKeyNameProvider : public KeyNameProvider
+{
+public:
+    quintptr layoutId() const override;
+    
+    QString keyName(int vkCode) const override;
+};
+
+#ifdef _WIN32
+class WindowsKeyNameProvider : public KeyNameProvider
+{
+public:
+    quintptr layoutId() const override;
+    
+    QString keyName(int vkCode) const override;
+
+private:
+    FallbackKeyNameProvider m_fallback;
+};
+#endif
+
+// Not thread-safe; the shared instance is meant for the GUI thread.
+class KeyNameCache
+{
+public:
+    static constexpr int KEY_COUNT = 256;
+
+    explicit KeyNameCache(std::unique_ptr<KeyNameProvider> provider);
+
+    QString name(int vkCode);
+    
+    void invalidate();
+
+    static KeyNameCache &instance();
+
+private:
+    void rebuild(quintptr layoutId);
+
+    std::unique_ptr<KeyNameProvider> m_provider;
+    std::array<QString, KEY_COUNT> m_names;
+    quintptr m_layoutId;
+    bool m_valid;
+};
@@ -0,0 +1,179 @@
+#include "LatencyStats.h"
+#include <QStringList>
+#include <cmath>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace {
+    int highestBit(std::uint64_t value)
+    {
+#ifdef _MSC_VER
+        unsigned long index = 0;
+        _BitScanReverse64(&index, value);
+        return static_cast<int>(index);
+#else
+        return 63 - __builtin_clzll(value);
+#endif
+    }
+
+    QString formatNs(std::int64_t valueNs)
+    {
+        return QString::number(valueNs / 1000.0, 'f', 1);
+    }
+}
+
+LatencyHistogram::LatencyHistogram()
+    : m_count(0)
+    , m_max(0)
+{
+    for (auto &bucket : m_buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+void LatencyHistogram::record(std::int64_t valueNs)
+{
+    const std::uint64_t value = valueNs > 0 ? static_cast<std::uint64_t>(valueNs) : 0;
+
+    m_buckets[bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+
+    std::int64_t currentMax = m_max.load(std::memory_order_relaxed);
+    while (valueNs > currentMax
+           && !m_max.compare_exchange_weak(currentMax, valueNs, std::memory_order_relaxed)) {
+    }
+}
+
+void LatencyHistogram::reset()
+{
+    for (auto &bucket : m_buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    m_count.store(0, std::memory_order_relaxed);
+    m_max.store(0, std::memory_order_relaxed);
+}
+
+std::uint64_t LatencyHistogram::count() const
+{
+    return m_count.load(std::memory_order_relaxed);
+}
+
+std::int64_t LatencyHistogram::max() const
+{
+    return m_max.load(std::memory_order_relaxed);
+}
+
+std::int64_t LatencyHistogram::percentile(double percent) const
+{
+    std::uint64_t total = 0;
+    for (const auto &bucket : m_buckets) {
+        total += bucket.load(std::memory_order_relaxed);
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    const double clamped = percent < 0.0 ? 0.0 : (percent > 100.0 ? 100.0 : percent);
+    std::uint64_t target = static_cast<std::uint64_t>(std::ceil(clamped / 100.0 * static_cast<double>(total)));
+    if (target == 0) {
+        target = 1;
+    }
+
+    std::uint64_t cumulative = 0;
+    for (int i = 0; i < BUCKET_COUNT; ++i) {
+        cumulative += m_buckets[i].load(std::memory_order_relaxed);
+        if (cumulative >= target) {
+            const std::int64_t upperBound = static_cast<std::int64_t>(bucketUpperBound(i));
+            const std::int64_t maxValue = max();
+            return upperBound < maxValue ? upperBound : maxValue;
+        }
+    }
+
+    return max();
+}
+
+LatencySummary LatencyHistogram::summary() const
+{
+    LatencySummary result;
+    result.count = count();
+    result.p50Ns = percentile(50.0);
+    result.p99Ns = percentile(99.0);
+    result.p999Ns = percentile(99.9);
+    result.maxNs = max();
+    return result;
+}
+
+int LatencyHistogram::bucketIndex(std::uint64_t value)
+{
+    if (value < static_cast<std::uint64_t>(SUB_BUCKET_COUNT)) {
+        return static_cast<int>(value);
+    }
+
+    const int msb = highestBit(value);
+    const int shift = msb - SUB_BUCKET_BITS;
+    const int subBucket = static_cast<int>((value >> shift) & (SUB_BUCKET_COUNT - 1));
+    return (msb - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT + subBucket;
+}
+
+std::uint64_t LatencyHistogram::bucketUpperBound(int index)
+{
+    if (index < SUB_BUCKET_COUNT) {
+        return static_cast<std::uint64_t>(index);
+    }
+
+    const int msb = index / SUB_BUCKET_COUNT + SUB_BUCKET_BITS - 1;
+    const int subBucket = index % SUB_BUCKET_COUNT;
+    const int shift = msb - SUB_BUCKET_BITS;
+    const std::uint64_t lower = static_cast<std::uint64_t>(SUB_BUCKET_COUNT + subBucket) << shift;
+    return lower + ((std::uint64_t(1) << shift) - 1);
+}
+
+void PipelineLatency::record(Stage stage, std::int64_t valueNs)
+{
+    m_histograms[stage].record(valueNs);
+}
+
+void PipelineLatency::reset()
+{
+    for (auto &histogram : m_histograms) {
+        histogram.reset();
+    }
+}
+
+LatencySummary PipelineLatency::summary(Stage stage) const
+{
+    return m_histograms[stage].summary();
+}
+
+QString PipelineLatency::report() const
+{
+    QStringList lines;
+    lines << "Key-to-MIDI latency (us):";
+
+    for (int i = 0; i < STAGE_COUNT; ++i) {
+        const Stage stage = static_cast<Stage>(i);
+        const LatencySummary s = summary(stage);
+        lines << QString("  %1: n=%2 p50=%3 p99=%4 p999=%5 max=%6")
+                 .arg(stageName(stage), -16)
+                 .arg(s.count)
+                 .arg(formatNs(s.p50Ns))
+                 .arg(formatNs(s.p99Ns))
+                 .arg(formatNs(s.p999Ns))
+                 .arg(formatNs(s.maxNs));
+    }
+
+    return lines.join('\n');
+}
+
+QString PipelineLatency::stageName(Stage stage)
+{
+    switch (stage) {
+        case CaptureToLookup: return "capture->lookup";
+        case LookupToEnqueue: return "lookup->enqueue";
+        case CaptureToSend: return "capture->send";
+        case ThresholdToHold: return "threshold->hold";
+        case STAGE_COUNT: break;
+    }
+    return "unknown";
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <QString>
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+struct LatencySummary {
+    std::uint64_t count;
+    std::int64_t p50Ns;
+    std::int64_t p99Ns;
+    std::int64_t p999Ns;
+    std::int64_t maxNs;
+
+    LatencySummary() : count(0), p50Ns(0), p99Ns(0), p999Ns(0), maxNs(0) {}
+};
+
+// Log-linear histogram in the style of HdrHistogram: 16 sub-buckets per
+// power of two (about 6% relative precision) over the full int64 range.
+// record() only touches relaxed atomics, so any thread may record.
+class LatencyHistogram
+{
+public:
+    LatencyHistogram();
+
+    void record(std::int64_t valueNs);
+    
+    void reset();
+
+    std::uint64_t count() const;
+    
+    std::int64_t max() const;
+    
+    std::int64_t percentile(double percent) const;
+    
+    LatencySummary summary() const;
+
+private:
+    static constexpr int SUB_BUCKET_BITS = 4;
+    static constexpr int SUB_BUCKET_COUNT = 1 << SUB_BUCKET_BITS;
+    static constexpr int BUCKET_COUNT = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT;
+
+    static int bucketIndex(std::uint64_t value);
+    static std::uint64_t bucketUpperBound(int index);
+
+    std::array<std::atomic<std::uint64_t>, BUCKET_COUNT> m_buckets;
+    std::atomic<std::uint64_t> m_count;
+    std::atomic<std::int64_t> m_max;
+};
+
+class PipelineLatency
+{
+public:
+    enum Stage {
+        CaptureToLookup,
+        LookupToEnqueue,    // Translation and handing the messages to the output queue
+        CaptureToSend,      // Up to the return of the driver call, recorded by the output worker
+        ThresholdToHold,    // How late a hold was resolved after its threshold passed
+        STAGE_COUNT
+    };
+
+    void record(Stage stage, std::int64_t valueNs);
+    
+    void reset();
+
+    LatencySummary summary(Stage stage) const;
+    
+    QString report() const;
+
+    static QString stageName(Stage stage);
+
+private:
+    std::array<LatencyHistogram, STAGE_COUNT> m_histograms;
+};
@@ -0,0 +1,267 @@
+#include "MacroPlayer.h"
+#include "KeyEvent.h"
+#include <QThread>
+#include <algorithm>
+
+namespace {
+    constexpr int IDLE_WAIT_TIMEOUT_MS = 100;
+    constexpr std::int64_t NS_PER_US = 1000;
+    constexpr std::int64_t NS_PER_MS = 1000000;
+    constexpr std::int64_t SPIN_THRESHOLD_NS = 1000000;
+    constexpr std::int64_t NO_EVENT = INT64_MAX;
+}
+
+MacroPlayer::MacroPlayer(Sink sink)
+    : m_sink(std::move(sink))
+    , m_voices(std::make_unique<std::array<Voice, VOICE_COUNT>>())
+    , m_activeCount(0)
+    , m_running(false)
+    , m_playedEvents(0)
+    , m_droppedMacros(0)
+    , m_maxActiveVoices(0)
+{
+    for (Voice &voice : *m_voices) {
+        voice.startNs = 0;
+        voice.count = 0;
+        voice.next = 0;
+        voice.vkCode = 0;
+        voice.state.store(VoiceFree, std::memory_order_relaxed);
+    }
+    m_active.fill(false);
+}
+
+MacroPlayer::~MacroPlayer()
+{
+    stop();
+}
+
+void MacroPlayer::start()
+{
+    if (m_running.load(std::memory_order_acquire)) {
+        return;
+    }
+
+    // A play() that lost a race with the last stop() left its voice claimed
+    Command stale;
+    while (m_commands.tryPop(stale)) {
+        if (stale.type == PlayVoice) {
+            (*m_voices)[stale.value].state.store(VoiceFree, std::memory_order_release);
+        }
+    }
+    while (m_pendingCommands.tryAcquire()) {
+    }
+
+    m_running.store(true, std::memory_order_release);
+    m_thread.reset(QThread::create([this] { run(); }));
+    m_thread->setObjectName("MacroPlayer");
+    m_thread->start(QThread::TimeCriticalPriority);
+}
+
+void MacroPlayer::stop()
+{
+    if (!m_running.exchange(false)) {
+        return;
+    }
+
+    m_pendingCommands.release();
+    m_thread->wait();
+    m_thread.reset();
+}
+
+bool MacroPlayer::isRunning() const
+{
+    return m_running.load(std::memory_order_acquire);
+}
+
+bool MacroPlayer::play(int vkCode, const CompiledMacroEvent *events, int count, std::int64_t startNs)
+{
+    if (count <= 0 || !m_running.load(std::memory_order_acquire)) {
+        return false;
+    }
+
+    // Only the player thread frees voices and only this thread claims them, so the
+    // first free voice found stays free until it is claimed here
+    for (int index = 0; index < VOICE_COUNT; ++index) {
+        Voice &voice = (*m_voices)[index];
+        if (voice.state.load(std::memory_order_acquire) != VoiceFree) {
+            continue;
+        }
+
+        voice.state.store(VoiceLoading, std::memory_order_relaxed);
+        voice.count = std::min(count, CompiledMacro::MAX_EVENTS);
+        std::copy(events, events + voice.count, voice.events.begin());
+        voice.startNs = startNs;
+        voice.next = 0;
+        voice.vkCode = vkCode;
+        voice.state.store(VoicePlaying, std::memory_order_release);
+
+        if (!pushCommand({PlayVoice, index})) {
+            voice.state.store(VoiceFree, std::memory_order_release);
+            break;
+        }
+        return true;
+    }
+
+    m_droppedMacros.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+void MacroPlayer::stopKey(int vkCode)
+{
+    if (m_running.load(std::memory_order_acquire)) {
+        pushCommand({StopKey, vkCode});
+    }
+}
+
+void MacroPlayer::stopAll()
+{
+    if (m_running.load(std::memory_order_acquire)) {
+        pushCommand({StopAll, 0});
+    }
+}
+
+LatencySummary MacroPlayer::lateness() const
+{
+    return m_lateness.summary();
+}
+
+std::uint64_t MacroPlayer::playedEventCount() const
+{
+    return m_playedEvents.load(std::memory_order_relaxed);
+}
+
+std::uint64_t MacroPlayer::droppedMacroCount() const
+{
+    return m_droppedMacros.load(std::memory_order_relaxed);
+}
+
+int MacroPlayer::maxActiveVoices() const
+{
+    return m_maxActiveVoices.load(std::memory_order_relaxed);
+}
+
+bool MacroPlayer::pushCommand(const Command &command)
+{
+    // Commands are tiny and rare next to the queue size, so a full queue means the
+    // player is stuck; dropping keeps the caller from stalling with it
+    if (!m_commands.tryPush(command)) {
+        return false;
+    }
+    m_pendingCommands.release();
+    return true;
+}
+
+void MacroPlayer::run()
+{
+    while (m_running.load(std::memory_order_acquire)) {
+        handleCommands();
+        playDueEvents(EngineClock::nowNs());
+
+        // Sleep until the last millisecond before the next event, then poll
+        int waitMs = IDLE_WAIT_TIMEOUT_MS;
+        const std::int64_t nextNs = nextEventNs();
+        if (nextNs != NO_EVENT) {
+            const std::int64_t remainingNs = nextNs - EngineClock::nowNs();
+            waitMs = static_cast<int>(std::clamp<std::int64_t>((remainingNs - SPIN_THRESHOLD_NS) / NS_PER_MS,
+                                                               0, IDLE_WAIT_TIMEOUT_MS));
+        }
+
+        if (!m_pendingCommands.tryAcquire(1, waitMs) && waitMs == 0) {
+            QThread::yieldCurrentThread();
+        }
+    }
+
+    // Nothing may keep sounding once the player is gone
+    handleCommands();
+    for (int index = 0; index < VOICE_COUNT; ++index) {
+        if (m_active[index]) {
+            stopVoice((*m_voices)[index]);
+            m_active[index] = false;
+        }
+    }
+    m_activeCount = 0;
+}
+
+void MacroPlayer::handleCommands()
+{
+    Command command;
+    while (m_commands.tryPop(command)) {
+        switch (command.type) {
+            case PlayVoice:
+                m_active[command.value] = true;
+                ++m_activeCount;
+                if (m_activeCount > m_maxActiveVoices.load(std::memory_order_relaxed)) {
+                    m_maxActiveVoices.store(m_activeCount, std::memory_order_relaxed);
+                }
+                break;
+            case StopKey:
+            case StopAll:
+                for (int index = 0; index < VOICE_COUNT; ++index) {
+                    Voice &voice = (*m_voices)[index];
+                    if (m_active[index] && (command.type == StopAll || voice.vkCode == command.value)) {
+                        stopVoice(voice);
+                        m_active[index] = false;
+                        --m_activeCount;
+                    }
+                }
+                break;
+        }
+    }
+}
+
+void MacroPlayer::playDueEvents(std::int64_t nowNs)
+{
+    for (int index = 0; index < VOICE_COUNT && m_activeCount > 0; ++index) {
+        if (!m_active[index]) {
+            continue;
+        }
+
+        Voice &voice = (*m_voices)[index];
+        while (voice.next < voice.count) {
+            const CompiledMacroEvent &event = voice.events[voice.next];
+            const std::int64_t dueNs = voice.startNs + static_cast<std::int64_t>(event.offsetUs) * NS_PER_US;
+            if (dueNs > nowNs) {
+                break;
+            }
+
+            m_lateness.record(EngineClock::nowNs() - dueNs);
+            voice.notes.track(event.message);
+            m_sink(event.message);
+            m_playedEvents.fetch_add(1, std::memory_order_relaxed);
+            ++voice.next;
+        }
+
+        if (voice.next >= voice.count) {
+            freeVoice(voice);
+            m_active[index] = false;
+            --m_activeCount;
+        }
+    }
+}
+
+std::int64_t MacroPlayer::nextEventNs() const
+{
+    std::int64_t nextNs = NO_EVENT;
+    for (int index = 0; index < VOICE_COUNT && m_activeCount > 0; ++index) {
+        if (m_active[index]) {
+            const Voice &voice = (*m_voices)[index];
+            nextNs = std::min(nextNs, voice.startNs + static_cast<std::int64_t>(voice.events[voice.next].offsetUs) * NS_PER_US);
+        }
+    }
+    return nextNs;
+}
+
+void MacroPlayer::stopVoice(Voice &voice)
+{
+    voice.notes.releaseAll([this](int channel, int note) {
+        m_sink({static_cast<std::uint8_t>(0x80 | channel), static_cast<std::uint8_t>(note), 0});
+    });
+    freeVoice(voice);
+}
+
+void MacroPlayer::freeVoice(Voice &voice)
+{
+    // A finished macro's notes are its own business, like a key mapping's note-on
+    voice.notes.clear();
+    voice.state.store(VoiceFree, std::memory_order_release);
+}
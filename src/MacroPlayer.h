@@ -0,0 +1,113 @@
+#pragma once
+
+#include <QSemaphore>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include "CompiledMappingTable.h"
+#include "LatencyStats.h"
+#include "MidiNoteState.h"
+#include "MpscQueue.h"
+
+class QThread;
+
+// Plays macro mappings on a thread of its own. Each playing macro takes one of a
+// fixed set of voices, which hold a copy of the macro's events, so voices overlap
+// freely and outlive any change to the mappings. The thread sleeps until about a
+// millisecond before the next event and polls from there, so events go out well
+// within a millisecond of their time. A stopped voice turns off the notes it left on.
+class MacroPlayer
+{
+public:
+    // Called on the player thread for every message, in time order
+    using Sink = std::function<void(const MidiBytes &message)>;
+
+    static constexpr int VOICE_COUNT = 64;
+    static constexpr std::size_t COMMAND_CAPACITY = 256;
+
+    explicit MacroPlayer(Sink sink);
+    ~MacroPlayer();
+
+    void start();
+
+    // Stops every voice before returning
+    void stop();
+
+    bool isRunning() const;
+
+    // Plays events timed from startNs. Only one thread may call play(); false when
+    // every voice is busy or the player is not running.
+    bool play(int vkCode, const CompiledMacroEvent *events, int count, std::int64_t startNs);
+
+    // Stops the voices started for vkCode. Any thread.
+    void stopKey(int vkCode);
+
+    // Stops every voice. Any thread.
+    void stopAll();
+
+    // How late each event was handed to the sink
+    LatencySummary lateness() const;
+
+    std::uint64_t playedEventCount() const;
+
+    std::uint64_t droppedMacroCount() const;
+
+    int maxActiveVoices() const;
+
+private:
+    enum VoiceState {
+        VoiceFree,
+        VoiceLoading,   // Claimed by play(), events being copied
+        VoicePlaying
+    };
+
+    struct Voice {
+        std::array<CompiledMacroEvent, CompiledMacro::MAX_EVENTS> events;
+        std::int64_t startNs;
+        int count;
+        int next;
+        int vkCode;
+        std::atomic<int> state;
+        MidiNoteState notes;
+    };
+
+    enum CommandType {
+        PlayVoice,
+        StopKey,
+        StopAll
+    };
+
+    struct Command {
+        CommandType type;
+        int value;      // Voice index or key
+    };
+
+    void run();
+
+    void handleCommands();
+
+    void playDueEvents(std::int64_t nowNs);
+
+    std::int64_t nextEventNs() const;
+
+    void stopVoice(Voice &voice);
+
+    void freeVoice(Voice &voice);
+
+    bool pushCommand(const Command &command);
+
+    Sink m_sink;
+    std::unique_ptr<std::array<Voice, VOICE_COUNT>> m_voices;
+    std::array<bool, VOICE_COUNT> m_active;    // Player thread only
+    int m_activeCount;
+    MpscQueue<Command, COMMAND_CAPACITY> m_commands;
+    QSemaphore m_pendingCommands;
+    std::unique_ptr<QThread> m_thread;
+    std::atomic<bool> m_running;
+    LatencyHistogram m_lateness;
+    std::atomic<std::uint64_t> m_playedEvents;
+    std::atomic<std::uint64_t> m_droppedMacros;
+    std::atomic<int> m_maxActiveVoices;
+};
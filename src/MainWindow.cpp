@@ -17,6 +17,7 @@
 #include <QJsonDocument>
 #include <QFile>
 #include <QSettings>
+#include <algorithm>
 #include <windows.h>
 #if __has_include("version.h")
 #include "version.h"
@@ -30,6 +31,9 @@
 namespace {
     constexpr int STATUS_MESSAGE_TIMEOUT_MS = 3000;
     constexpr int TRAY_MESSAGE_TIMEOUT_MS = 5000;
+    constexpr int OUTPUT_STATS_INTERVAL_MS = 1000;
+    constexpr int MAX_CC_WINDOW_MS = 100;
+    constexpr const char *DEFAULT_VIRTUAL_PORT_NAME = "KtoMIDI";
 }
 
 MainWindow::MainWindow(QWidget *parent)
@@ -37,27 +41,39 @@ MainWindow::MainWindow(QWidget *parent)
     , m_keyHook(nullptr)
     , m_midiEngine(nullptr)
     , m_keyMapping(nullptr)
+    , m_dispatcher(nullptr)
     , m_inputMonitor(nullptr)
+    , m_persistence(nullptr)
     , m_trayIcon(nullptr)
     , m_currentEditingVkCode(-1)
     , m_isEditingMapping(false)
-    , m_waitingForKeyPress(false)
     , m_currentMappingDialog(nullptr)
     , m_shouldAutoConnect(false)
+    , m_loadingSettings(false)
+    , m_virtualPortName(DEFAULT_VIRTUAL_PORT_NAME)
 {
+    m_persistence = new PersistenceService(this);
+    m_persistence->setSnapshotProvider([this]() { return createSettingsSnapshot(); });
+    
     setupUI();
     setupSystemTray();
-    qApp->installEventFilter(this);
     
     m_keyHook = new KeyHook(this);
     m_midiEngine = new MidiEngine(this);
     m_keyMapping = new KeyMapping(this);
+    m_dispatcher = new KeyEventDispatcher(m_keyMapping, m_midiEngine, this);
+    m_keyHook->setDispatcher(m_dispatcher);
+    connect(m_keyHook, &InputSource::captureStopped, m_dispatcher, &KeyEventDispatcher::stopMacros);
+    connect(m_keyHook, &InputSource::captureStopped, m_midiEngine, &MidiEngine::releaseAllNotes);
+    m_inputMonitor->setEventSource(m_dispatcher);
     
-    connect(m_keyHook, &KeyHook::keyPressed, this, &MainWindow::onKeyPressed);
+    connect(m_dispatcher, &KeyEventDispatcher::keyDetected, this, &MainWindow::onKeyDetected);
     connect(m_midiEngine, &MidiEngine::portOpened, this, &MainWindow::onMidiPortOpened);
     connect(m_midiEngine, &MidiEngine::portClosed, this, &MainWindow::onMidiPortClosed);
+    connect(m_midiEngine, &MidiEngine::portLost, this, &MainWindow::onMidiPortLost);
+    connect(m_midiEngine, &MidiEngine::portReconnected, this, &MainWindow::onMidiPortReconnected);
     connect(m_midiEngine, &MidiEngine::errorOccurred, this, &MainWindow::onMidiError);
-    connect(m_keyMapping, &KeyMapping::midiMessageTriggered, this, &MainWindow::onMidiMessageTriggered);
+    connect(m_midiEngine, &MidiEngine::portsChanged, this, &MainWindow::refreshMidiPorts);
     connect(m_keyMapping, &KeyMapping::mappingAdded, this, [this](const KeyMappingEntry &) { 
         updateSuppressedKeys(); 
         saveSettings();
@@ -70,8 +86,17 @@ MainWindow::MainWindow(QWidget *parent)
         updateSuppressedKeys(); 
         saveSettings();
     });
+    connect(m_keyMapping, &KeyMapping::mappingsReset, this, [this]() { 
+        updateMappingTable();
+        updateSuppressedKeys(); 
+        if (!m_loadingSettings) {
+            saveSettings();
+        }
+    });
+    
+    m_dispatcher->start();
     
-    if (!m_keyHook->installHook()) {
+    if (!m_keyHook->start()) {
         QMessageBox::warning(this, "Keyboard Hook", 
             "Failed to install keyboard hook. Key capture may not work properly.");
     }
@@ -84,11 +109,38 @@ MainWindow::MainWindow(QWidget *parent)
 MainWindow::~MainWindow()
 {
     saveSettings();
+    m_persistence->flush();
+    m_persistence->setSnapshotProvider(nullptr);
     
     if (m_keyHook) {
-        m_keyHook->uninstallHook();
+        m_keyHook->stop();
+    }
+    if (m_dispatcher) {
+        m_dispatcher->stop();
+        m_dispatcher->setRecorder(nullptr);
+        qInfo().noquote() << m_dispatcher->latency().report();
+    }
+    if (m_recorder) {
+        m_recorder->stop();
+    }
+}
+
+bool MainWindow::startInputRecording(const QString &filename)
+{
+    if (!m_recorder) {
+        m_recorder = std::make_unique<KeyEventRecorder>();
+    }
+    
+    m_dispatcher->setRecorder(nullptr);
+    if (!m_recorder->start(filename)) {
+        showMessage("Input Recording", QString("Failed to start recording to %1").arg(filename),
+                    QSystemTrayIcon::Warning);
+        return false;
     }
-    qApp->removeEventFilter(this);
+    
+    m_dispatcher->setRecorder(m_recorder.get());
+    statusBar()->showMessage(QString("Recording input to %1").arg(filename), STATUS_MESSAGE_TIMEOUT_MS);
+    return true;
 }
 
 void MainWindow::setupUI()
@@ -121,6 +173,8 @@ void MainWindow::setupConfigurationTab()
     m_configTab = new QWidget();
     m_tabWidget->addTab(m_configTab, "Configuration");
     
+    m_configTab->installEventFilter(this);
+    
     QVBoxLayout *mainLayout = new QVBoxLayout(m_configTab);
     
     setupMidiControls();
@@ -156,9 +210,26 @@ void MainWindow::setupMidiControls()
     midiLayout->addWidget(m_midiPortCombo);
     
     m_refreshPortsButton = new QPushButton("Refresh");
-    connect(m_refreshPortsButton, &QPushButton::clicked, this, &MainWindow::refreshMidiPorts);
+    connect(m_refreshPortsButton, &QPushButton::clicked, this, [this]() {
+        if (m_midiEngine) {
+            m_midiEngine->rescanPorts();
+        }
+    });
     midiLayout->addWidget(m_refreshPortsButton);
     
+    m_allNotesOffButton = new QPushButton("All Notes Off");
+    m_allNotesOffButton->setToolTip("Stop playing macros and send a note-off for every note still sounding on the MIDI port");
+    connect(m_allNotesOffButton, &QPushButton::clicked, this, [this]() {
+        if (m_dispatcher) {
+            m_dispatcher->stopMacros();
+        }
+        if (m_midiEngine) {
+            const int released = m_midiEngine->releaseAllNotes();
+            statusBar()->showMessage(QString("MIDI: Released %1 held notes").arg(released), STATUS_MESSAGE_TIMEOUT_MS);
+        }
+    });
+    midiLayout->addWidget(m_allNotesOffButton);
+    
     midiLayout->addStretch();
     
     m_midiStatusLabel = new QLabel("No port selected");
@@ -171,6 +242,73 @@ void MainWindow::setupMidiControls()
     m_autoConnectCheck->setChecked(true);
     connect(m_autoConnectCheck, &QCheckBox::toggled, this, &MainWindow::saveSettings);
     midiVerticalLayout->addWidget(m_autoConnectCheck);
+    
+    m_restoreStateCheck = new QCheckBox("Restore held notes and controller values after reconnecting");
+    m_restoreStateCheck->setChecked(true);
+    m_restoreStateCheck->setToolTip("When a lost MIDI port comes back, resend the notes still held and the "
+                                    "last value of every controller");
+    connect(m_restoreStateCheck, &QCheckBox::toggled, this, [this](bool checked) {
+        m_midiEngine->setRestoreStateOnReconnect(checked);
+        saveSettings();
+    });
+    midiVerticalLayout->addWidget(m_restoreStateCheck);
+    
+    QHBoxLayout *outputModeLayout = new QHBoxLayout();
+    outputModeLayout->addWidget(new QLabel("Port connection:"));
+    
+    m_outputModeCombo = new QComboBox();
+    m_outputModeCombo->addItem("USB / virtual (unpaced)", MidiEngine::outputModeName(MidiEngine::DirectOutput));
+    m_outputModeCombo->addItem("5-pin DIN (31,250 baud)", MidiEngine::outputModeName(MidiEngine::DinPacedOutput));
+    m_outputModeCombo->addItem("5-pin DIN with running status",
+                               MidiEngine::outputModeName(MidiEngine::DinRunningStatusOutput));
+    m_outputModeCombo->setToolTip("Pace output to the bandwidth of a DIN MIDI cable so bursts do not "
+                                  "overflow the interface. Remembered for each port.");
+    m_outputModeCombo->setEnabled(false);
+    connect(m_outputModeCombo, QOverload<int>::of(&QComboBox::currentIndexChanged),
+            this, &MainWindow::onOutputModeChanged);
+    outputModeLayout->addWidget(m_outputModeCombo);
+    outputModeLayout->addStretch();
+    
+    midiVerticalLayout->addLayout(outputModeLayout);
+    
+    QHBoxLayout *overflowLayout = new QHBoxLayout();
+    overflowLayout->addWidget(new QLabel("When output falls behind:"));
+    
+    m_overflowPolicyCombo = new QComboBox();
+    m_overflowPolicyCombo->addItem("Wait (deliver everything)",
+                                   MidiOutputWorker::policyName(MidiOutputWorker::Block));
+    m_overflowPolicyCombo->addItem("Drop key repeats",
+                                   MidiOutputWorker::policyName(MidiOutputWorker::DropRepeats));
+    m_overflowPolicyCombo->addItem("Keep latest CC value",
+                                   MidiOutputWorker::policyName(MidiOutputWorker::CoalesceCC));
+    m_overflowPolicyCombo->setToolTip("How queued messages are thinned out when the MIDI port "
+                                      "cannot keep up with incoming key events");
+    connect(m_overflowPolicyCombo, QOverload<int>::of(&QComboBox::currentIndexChanged),
+            this, &MainWindow::onOverflowPolicyChanged);
+    overflowLayout->addWidget(m_overflowPolicyCombo);
+    
+    overflowLayout->addWidget(new QLabel("CC coalescing:"));
+    
+    m_ccWindowSpin = new QSpinBox();
+    m_ccWindowSpin->setRange(0, MAX_CC_WINDOW_MS);
+    m_ccWindowSpin->setSuffix(" ms");
+    m_ccWindowSpin->setSpecialValueText("Off");
+    m_ccWindowSpin->setToolTip("Control changes for the same controller within this window are merged "
+                               "and only the latest value is sent");
+    connect(m_ccWindowSpin, QOverload<int>::of(&QSpinBox::valueChanged),
+            this, &MainWindow::onCcCoalesceWindowChanged);
+    overflowLayout->addWidget(m_ccWindowSpin);
+    overflowLayout->addStretch();
+    
+    midiVerticalLayout->addLayout(overflowLayout);
+    
+    m_outputStatsLabel = new QLabel();
+    midiVerticalLayout->addWidget(m_outputStatsLabel);
+    
+    m_outputStatsTimer = new QTimer(this);
+    m_outputStatsTimer->setInterval(OUTPUT_STATS_INTERVAL_MS);
+    connect(m_outputStatsTimer, &QTimer::timeout, this, &MainWindow::updateOutputStats);
+    m_outputStatsTimer->start();
 }
 
 void MainWindow::setupSystemControls()
@@ -284,31 +422,13 @@ void MainWindow::changeEvent(QEvent *event)
 
 void MainWindow::onMappingDialogKeyDetectionRequested()
 {
-    m_waitingForKeyPress = true;
+    m_dispatcher->setKeyDetectionActive(true);
 }
 
-void MainWindow::onKeyPressed(int vkCode, bool isKeyDown, bool isRepeat)
+void MainWindow::onKeyDetected(int vkCode)
 {
-    if (m_inputMonitor) {
-        m_inputMonitor->logKeyEvent(vkCode, isKeyDown, isRepeat);
-    }
-    
-    if (m_waitingForKeyPress && m_currentMappingDialog && isKeyDown && !isRepeat) {
-        m_waitingForKeyPress = false;
+    if (m_currentMappingDialog) {
         m_currentMappingDialog->setDetectedVkCode(vkCode);
-        return;
-    }
-    
-    m_keyMapping->processKeyEvent(vkCode, isKeyDown, isRepeat);
-}
-
-void MainWindow::onMidiMessageTriggered(const MidiMessage &message, int vkCode, bool isKeyDown)
-{
-    Q_UNUSED(vkCode)
-    Q_UNUSED(isKeyDown)
-    
-    if (m_midiEngine && m_midiEngine->isPortOpen()) {
-        m_midiEngine->sendMidiMessage(message);
     }
 }
 
@@ -343,16 +463,29 @@ void MainWindow::refreshMidiPorts()
 {
     if (!m_midiEngine) return;
     
-    QStringList ports = m_midiEngine->getAvailablePorts();
+    const QStringList ports = m_midiEngine->getAvailablePorts();
     
+    // Repopulating must not look like a selection change, or it would close the open port
+    m_midiPortCombo->blockSignals(true);
     m_midiPortCombo->clear();
     m_midiPortCombo->addItem("Select MIDI Port...");
-    m_midiPortCombo->addItems(ports);
+    for (const QString &port : ports) {
+        m_midiPortCombo->addItem(port, port);
+    }
+    // Listed after the hardware ports so combo index - 1 stays the engine's port index
+    if (m_midiEngine->supportsVirtualPorts()) {
+        m_midiPortCombo->addItem(QString("Virtual port: %1").arg(m_virtualPortName),
+                                 MidiEngine::virtualPortSpec(m_virtualPortName));
+    }
+    if (m_midiEngine->isPortOpen()) {
+        m_midiPortCombo->setCurrentIndex(std::max(0, m_midiPortCombo->findData(m_midiEngine->getCurrentPortName())));
+    }
+    m_midiPortCombo->blockSignals(false);
     
     updateMidiPortStatus();
     
     if (m_shouldAutoConnect && !m_pendingAutoConnectPort.isEmpty()) {
-        int index = m_midiPortCombo->findText(m_pendingAutoConnectPort);
+        int index = m_midiPortCombo->findData(m_pendingAutoConnectPort);
         if (index > 0) {
             if (m_midiPortCombo->currentIndex() != index) {
                 m_midiPortCombo->setCurrentIndex(index);
@@ -373,7 +506,11 @@ void MainWindow::onMidiPortChanged(int index)
         return;
     }
     
-    if (m_midiEngine->openPort(index - 1)) {
+    const QString portName = m_midiPortCombo->itemData(index).toString();
+    const bool opened = portName.startsWith(MidiEngine::VIRTUAL_PORT_PREFIX)
+                            ? m_midiEngine->openPort(portName)
+                            : m_midiEngine->openPort(index - 1);
+    if (opened) {
         updateMidiPortStatus();
     }
 }
@@ -383,6 +520,7 @@ void MainWindow::onMidiPortOpened(const QString &portName)
     m_midiStatusLabel->setText(QString("Connected: %1").arg(portName));
     m_midiStatusLabel->setStyleSheet("color: green; font-weight: bold;");
     statusBar()->showMessage(QString("MIDI: Connected to %1").arg(portName), STATUS_MESSAGE_TIMEOUT_MS);
+    updateOutputModeCombo();
     saveSettings();
 }
 
@@ -390,15 +528,102 @@ void MainWindow::onMidiPortClosed()
 {
     m_midiStatusLabel->setText("Not connected");
     m_midiStatusLabel->setStyleSheet("color: red; font-weight: bold;");
+    updateOutputModeCombo();
     statusBar()->showMessage("MIDI: Disconnected", STATUS_MESSAGE_TIMEOUT_MS);
     saveSettings();
 }
 
+void MainWindow::onMidiPortLost(const QString &portName)
+{
+    m_midiStatusLabel->setText(QString("Reconnecting: %1").arg(portName));
+    m_midiStatusLabel->setStyleSheet("color: darkorange; font-weight: bold;");
+    statusBar()->showMessage(QString("MIDI: Lost %1, reconnecting").arg(portName), STATUS_MESSAGE_TIMEOUT_MS);
+}
+
+void MainWindow::onMidiPortReconnected(const QString &portName)
+{
+    m_midiStatusLabel->setText(QString("Connected: %1").arg(portName));
+    m_midiStatusLabel->setStyleSheet("color: green; font-weight: bold;");
+    statusBar()->showMessage(QString("MIDI: Reconnected to %1").arg(portName), STATUS_MESSAGE_TIMEOUT_MS);
+}
+
 void MainWindow::onMidiError(const QString &error)
 {
     showMessage("MIDI Error", error, QSystemTrayIcon::Critical);
 }
 
+void MainWindow::onOverflowPolicyChanged(int index)
+{
+    MidiOutputWorker::OverflowPolicy policy;
+    if (MidiOutputWorker::policyFromName(m_overflowPolicyCombo->itemData(index).toString(), policy)) {
+        m_midiEngine->setOverflowPolicy(policy);
+    }
+    saveSettings();
+}
+
+void MainWindow::onOutputModeChanged(int index)
+{
+    MidiEngine::OutputMode mode;
+    if (m_midiEngine->isPortOpen()
+        && MidiEngine::outputModeFromName(m_outputModeCombo->itemData(index).toString(), mode)) {
+        m_midiEngine->setPortOutputMode(m_midiEngine->getCurrentPortName(), mode);
+        saveSettings();
+    }
+}
+
+void MainWindow::updateOutputModeCombo()
+{
+    const bool portOpen = m_midiEngine->isPortOpen();
+    const MidiEngine::OutputMode mode = portOpen
+        ? m_midiEngine->portOutputMode(m_midiEngine->getCurrentPortName())
+        : MidiEngine::DirectOutput;
+    
+    m_outputModeCombo->blockSignals(true);
+    m_outputModeCombo->setCurrentIndex(std::max(0, m_outputModeCombo->findData(MidiEngine::outputModeName(mode))));
+    m_outputModeCombo->setEnabled(portOpen);
+    m_outputModeCombo->blockSignals(false);
+}
+
+void MainWindow::onCcCoalesceWindowChanged(int windowMs)
+{
+    m_midiEngine->setControlCoalesceWindowMs(windowMs);
+    saveSettings();
+}
+
+void MainWindow::updateOutputStats()
+{
+    if (!isVisible() || !m_midiEngine) {
+        return;
+    }
+    
+    const QMap<QString, MidiOutputStats> statsByPort = m_midiEngine->outputStatsByPort();
+    if (statsByPort.isEmpty()) {
+        m_outputStatsLabel->clear();
+        return;
+    }
+    
+    const MidiOutputStats current = m_midiEngine->outputStats();
+    QString text = QString("Sent: %1 | Saved: %2 (%3 coalesced, %4 dropped) | Max queue: %5")
+                   .arg(current.sent)
+                   .arg(current.saved())
+                   .arg(current.coalesced)
+                   .arg(current.dropped)
+                   .arg(current.maxQueueDepth);
+    if (m_midiEngine->isPortOpen()
+        && m_midiEngine->portOutputMode(m_midiEngine->getCurrentPortName()) != MidiEngine::DirectOutput) {
+        text += QString(" | Wire: %1 B/s, queue delay p99 %2 ms")
+                .arg(current.wireBytesPerSecond, 0, 'f', 0)
+                .arg(current.queueDelay.p99Ns / 1e6, 0, 'f', 1);
+    }
+    m_outputStatsLabel->setText(text);
+    
+    QStringList portLines;
+    for (auto it = statsByPort.cbegin(); it != statsByPort.cend(); ++it) {
+        portLines << QString("%1: %2 sent, %3 saved").arg(it.key()).arg(it->sent).arg(it->saved());
+    }
+    m_outputStatsLabel->setToolTip(portLines.join('\n'));
+}
+
 void MainWindow::updateMidiPortStatus()
 {
     if (m_midiEngine->isPortOpen()) {
@@ -457,13 +682,42 @@ void MainWindow::loadSettings()
     restoreState(QByteArray::fromBase64(obj["windowState"].toString().toUtf8()));
     
     m_autoConnectCheck->blockSignals(true);
+    m_restoreStateCheck->blockSignals(true);
     m_autoStartCheck->blockSignals(true);
+    m_overflowPolicyCombo->blockSignals(true);
+    m_ccWindowSpin->blockSignals(true);
     
     bool autoConnect = obj["autoConnectMidi"].toBool(true);
     m_autoConnectCheck->setChecked(autoConnect);
     
     m_shouldAutoConnect = autoConnect;
     m_pendingAutoConnectPort = obj["midiPort"].toString();
+    m_virtualPortName = obj["virtualPortName"].toString(DEFAULT_VIRTUAL_PORT_NAME);
+    if (m_virtualPortName.isEmpty()) {
+        m_virtualPortName = DEFAULT_VIRTUAL_PORT_NAME;
+    }
+    
+    const bool restoreState = obj["restoreMidiStateOnReconnect"].toBool(true);
+    m_restoreStateCheck->setChecked(restoreState);
+    m_midiEngine->setRestoreStateOnReconnect(restoreState);
+    
+    MidiOutputWorker::OverflowPolicy policy = MidiOutputWorker::Block;
+    MidiOutputWorker::policyFromName(obj["midiOverflowPolicy"].toString(), policy);
+    m_midiEngine->setOverflowPolicy(policy);
+    m_overflowPolicyCombo->setCurrentIndex(
+        std::max(0, m_overflowPolicyCombo->findData(MidiOutputWorker::policyName(policy))));
+    
+    const int ccWindowMs = std::clamp(obj["ccCoalesceWindowMs"].toInt(0), 0, MAX_CC_WINDOW_MS);
+    m_midiEngine->setControlCoalesceWindowMs(ccWindowMs);
+    m_ccWindowSpin->setValue(ccWindowMs);
+    
+    const QJsonObject outputModes = obj["portOutputModes"].toObject();
+    for (auto it = outputModes.constBegin(); it != outputModes.constEnd(); ++it) {
+        MidiEngine::OutputMode mode;
+        if (MidiEngine::outputModeFromName(it.value().toString(), mode)) {
+            m_midiEngine->setPortOutputMode(it.key(), mode);
+        }
+    }
     
     if (obj.contains("autoStart")) {
         bool autoStart = obj["autoStart"].toBool(false);
@@ -481,45 +735,56 @@ void MainWindow::loadSettings()
     }
     
     m_autoConnectCheck->blockSignals(false);
+    m_restoreStateCheck->blockSignals(false);
     m_autoStartCheck->blockSignals(false);
+    m_overflowPolicyCombo->blockSignals(false);
+    m_ccWindowSpin->blockSignals(false);
     
     QString mappingsFile = appDataPath + "/mappings.json";
     if (QFile::exists(mappingsFile)) {
+        // The single mappingsReset from the load rebuilds the table and suppressed keys
+        m_loadingSettings = true;
         m_keyMapping->loadFromFile(mappingsFile);
-        updateMappingTable();
-        updateSuppressedKeys();
+        m_loadingSettings = false;
     }
 }
 
 void MainWindow::saveSettings()
+{
+    m_persistence->scheduleSave();
+}
+
+PersistenceService::Snapshot MainWindow::createSettingsSnapshot() const
 {
     QString appDataPath = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
-    QDir().mkpath(appDataPath);
     
     QJsonObject obj;
     obj["geometry"] = QString(saveGeometry().toBase64());
     obj["windowState"] = QString(saveState().toBase64());
     obj["autoConnectMidi"] = m_autoConnectCheck->isChecked();
+    obj["restoreMidiStateOnReconnect"] = m_restoreStateCheck->isChecked();
     obj["autoStart"] = m_autoStartCheck->isChecked();
+    obj["midiOverflowPolicy"] = m_overflowPolicyCombo->currentData().toString();
+    obj["ccCoalesceWindowMs"] = m_ccWindowSpin->value();
+    obj["virtualPortName"] = m_virtualPortName;
+    
+    QJsonObject outputModes;
+    const QMap<QString, MidiEngine::OutputMode> modes = m_midiEngine->portOutputModes();
+    for (auto it = modes.cbegin(); it != modes.cend(); ++it) {
+        if (it.value() != MidiEngine::DirectOutput) {
+            outputModes[it.key()] = MidiEngine::outputModeName(it.value());
+        }
+    }
+    obj["portOutputModes"] = outputModes;
     
     if (m_midiEngine && m_midiEngine->isPortOpen()) {
         obj["midiPort"] = m_midiEngine->getCurrentPortName();
     }
     
-    QString settingsFile = appDataPath + "/settings.json";
-    QFile file(settingsFile);
-    if (file.open(QIODevice::WriteOnly)) {
-        qint64 bytesWritten = file.write(QJsonDocument(obj).toJson());
-        file.close();
-        if (bytesWritten <= 0) {
-            qWarning() << "Failed to write settings to" << settingsFile;
-        }
-    } else {
-        qWarning() << "Failed to open settings file for writing:" << settingsFile;
-    }
-    
-    QString mappingsFile = appDataPath + "/mappings.json";
-    m_keyMapping->saveToFile(mappingsFile);
+    PersistenceService::Snapshot snapshot;
+    snapshot.insert(appDataPath + "/settings.json", QJsonDocument(obj));
+    snapshot.insert(appDataPath + "/mappings.json", m_keyMapping->toJson());
+    return snapshot;
 }
 
 void MainWindow::addKeyMapping()
@@ -558,6 +823,7 @@ void MainWindow::addKeyMapping()
     }
     
     m_currentMappingDialog = nullptr;
+    m_dispatcher->setKeyDetectionActive(false);
     if (dialog) {
         dialog->deleteLater();
     }
@@ -607,6 +873,7 @@ void MainWindow::editKeyMapping()
                     
                     if (reply != QMessageBox::Yes) {
                         m_currentMappingDialog = nullptr;
+                        m_dispatcher->setKeyDetectionActive(false);
                         if (dialog) {
                             dialog->deleteLater();
                         }
@@ -620,6 +887,7 @@ void MainWindow::editKeyMapping()
         }
         
         m_currentMappingDialog = nullptr;
+        m_dispatcher->setKeyDetectionActive(false);
         if (dialog) {
             dialog->deleteLater();
         }
@@ -635,52 +903,36 @@ void MainWindow::onMappingTableSelectionChanged()
 
 bool MainWindow::eventFilter(QObject *watched, QEvent *event)
 {
-    if (m_mappingTable && watched == m_mappingTable->viewport() && event->type() == QEvent::MouseButtonPress) {
+    if (event->type() != QEvent::MouseButtonPress) {
+        return QMainWindow::eventFilter(watched, event);
+    }
+
+    if (m_mappingTable && watched == m_mappingTable->viewport()) {
         QMouseEvent *mouseEvent = static_cast<QMouseEvent*>(event);
-        QModelIndex idx = m_mappingTable->indexAt(mouseEvent->pos());
-        if (!idx.isValid()) {
-            m_mappingTable->clearSelection();
-            m_mappingTable->setCurrentCell(-1, -1);
-            m_mappingTable->clearFocus();
-            onMappingTableSelectionChanged();
+        if (!m_mappingTable->indexAt(mouseEvent->pos()).isValid()) {
+            clearMappingSelection();
             return true;
         }
+    } else if (watched == m_configTab) {
+        // Presses on buttons, combo boxes and the table are accepted before reaching the tab,
+        // so only clicks on empty space end up here
+        clearMappingSelection();
     }
 
-    if (event->type() == QEvent::MouseButtonPress) {
-        QMouseEvent *mouseEvent = static_cast<QMouseEvent*>(event);
-    QPoint globalPos;
-#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
-    globalPos = mouseEvent->globalPosition().toPoint();
-#else
-    globalPos = mouseEvent->globalPos();
-#endif
-        QWidget *clickedWidget = QApplication::widgetAt(globalPos);
-
-        bool clickedInsideMappingTable = false;
-        bool clickedInsideMappingDialog = false;
-
-        if (clickedWidget) {
-            if (m_mappingTable && (m_mappingTable == clickedWidget || m_mappingTable->isAncestorOf(clickedWidget))) {
-                clickedInsideMappingTable = true;
-            }
-            if (m_currentMappingDialog && (m_currentMappingDialog == clickedWidget || m_currentMappingDialog->isAncestorOf(clickedWidget))) {
-                clickedInsideMappingDialog = true;
-            }
-        }
+    return QMainWindow::eventFilter(watched, event);
+}
 
-        if (!clickedInsideMappingTable && !clickedInsideMappingDialog) {
-            if (m_mappingTable && m_mappingTable->selectionModel() && m_mappingTable->selectionModel()->hasSelection()) {
-                m_mappingTable->clearSelection();
-                    m_mappingTable->setCurrentCell(-1, -1);
-                    m_mappingTable->clearFocus();
-                    this->setFocus();
-                    onMappingTableSelectionChanged();
-            }
-        }
+void MainWindow::clearMappingSelection()
+{
+    if (!m_mappingTable->selectionModel() || !m_mappingTable->selectionModel()->hasSelection()) {
+        return;
     }
 
-    return QMainWindow::eventFilter(watched, event);
+    m_mappingTable->clearSelection();
+    m_mappingTable->setCurrentCell(-1, -1);
+    m_mappingTable->clearFocus();
+    setFocus();
+    onMappingTableSelectionChanged();
 }
 
 void MainWindow::updateMappingTable()
@@ -702,17 +954,9 @@ void MainWindow::updateMappingTable()
 
 void MainWindow::updateSuppressedKeys()
 {
-    QSet<int> suppressedKeys;
-    
-    QList<KeyMappingEntry> mappings = m_keyMapping->getAllMappings();
-    for (const KeyMappingEntry &entry : mappings) {
-        if (entry.suppressRepeats) {
-            suppressedKeys.insert(entry.vkCode);
-        }
-    }
-    
     if (m_keyHook) {
-        m_keyHook->setSuppressedRepeatKeys(suppressedKeys);
+        m_keyHook->setSuppressedRepeatKeys(m_keyMapping->suppressedRepeatKeys());
+        m_keyHook->setConsumedKeys(m_keyMapping->consumedKeys());
     }
 }
 
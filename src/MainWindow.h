@@ -16,12 +16,18 @@
 #include <QGroupBox>
 #include <QSplitter>
 #include <QPointer>
+#include <memory>
 
 #include "KeyHook.h"
+#include "KeyEventDispatcher.h"
+#include "KeyEventRecorder.h"
 #include "MidiEngine.h"
 #include "KeyMapping.h"
 #include "InputMonitor.h"
 #include "MappingDialog.h"
+#include "PersistenceService.h"
+
+class QTimer;
 
 class MainWindow : public QMainWindow
 {
@@ -31,13 +37,15 @@ public:
     explicit MainWindow(QWidget *parent = nullptr);
     ~MainWindow();
 
+    bool startInputRecording(const QString &filename);
+
 protected:
     void closeEvent(QCloseEvent *event) override;
     void changeEvent(QEvent *event) override;
     bool eventFilter(QObject *watched, QEvent *event) override;
 
 private slots:
-    void onKeyPressed(int vkCode, bool isKeyDown, bool isRepeat);
+    void onKeyDetected(int vkCode);
     void onTrayIconActivated(QSystemTrayIcon::ActivationReason reason);
     void showMainWindow();
     void quitApplication();
@@ -47,13 +55,18 @@ private slots:
     void onMidiPortChanged(int index);
     void onMidiPortOpened(const QString &portName);
     void onMidiPortClosed();
+    void onMidiPortLost(const QString &portName);
+    void onMidiPortReconnected(const QString &portName);
     void onMidiError(const QString &error);
+    void onOverflowPolicyChanged(int index);
+    void onCcCoalesceWindowChanged(int windowMs);
+    void onOutputModeChanged(int index);
+    void updateOutputStats();
     
     void addKeyMapping();
     void removeKeyMapping();
     void editKeyMapping();
     void onMappingTableSelectionChanged();
-    void onMidiMessageTriggered(const MidiMessage &message, int vkCode, bool isKeyDown);
     
     void onMappingDialogKeyDetectionRequested();
     
@@ -76,6 +89,10 @@ private:
     void updateMappingTable();
     void updateMidiPortStatus();
     void updateSuppressedKeys();
+    void updateOutputModeCombo();
+    void clearMappingSelection();
+    
+    PersistenceService::Snapshot createSettingsSnapshot() const;
     
     QString getKeyName(int vkCode) const;
     void showMessage(const QString &title, const QString &message, QSystemTrayIcon::MessageIcon icon = QSystemTrayIcon::Information);
@@ -86,7 +103,10 @@ private:
     KeyHook *m_keyHook;
     MidiEngine *m_midiEngine;
     KeyMapping *m_keyMapping;
+    KeyEventDispatcher *m_dispatcher;
+    std::unique_ptr<KeyEventRecorder> m_recorder;
     InputMonitor *m_inputMonitor;
+    PersistenceService *m_persistence;
     
     QSystemTrayIcon *m_trayIcon;
     QMenu *m_trayMenu;
@@ -101,8 +121,15 @@ private:
     QLabel *m_midiPortLabel;
     QComboBox *m_midiPortCombo;
     QPushButton *m_refreshPortsButton;
+    QPushButton *m_allNotesOffButton;
     QLabel *m_midiStatusLabel;
     QCheckBox *m_autoConnectCheck;
+    QCheckBox *m_restoreStateCheck;
+    QComboBox *m_outputModeCombo;
+    QComboBox *m_overflowPolicyCombo;
+    QSpinBox *m_ccWindowSpin;
+    QLabel *m_outputStatsLabel;
+    QTimer *m_outputStatsTimer;
     
     QGroupBox *m_systemGroup;
     QCheckBox *m_autoStartCheck;
@@ -115,9 +142,11 @@ private:
     
     int m_currentEditingVkCode;
     bool m_isEditingMapping;
-    bool m_waitingForKeyPress;
     MappingDialog *m_currentMappingDialog;
     
     QString m_pendingAutoConnectPort;
     bool m_shouldAutoConnect;
+    // Set while loadSettings() runs, so the mappings it loads are not saved straight back
+    bool m_loadingSettings;
+    QString m_virtualPortName;
 };
\ No newline at end of file
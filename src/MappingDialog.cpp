@@ -85,6 +85,11 @@ void MappingDialog::setupUI()
     m_suppressRepeatsCheck->setToolTip("Completely block this key from auto-repeating anywhere in the system when held down");
     mainLayout->addWidget(m_suppressRepeatsCheck);
     
+    m_consumeKeyCheck = new QCheckBox("Consume Key (System-Wide)");
+    m_consumeKeyCheck->setChecked(false);
+    m_consumeKeyCheck->setToolTip("Swallow this key so it only triggers MIDI and never reaches other applications");
+    mainLayout->addWidget(m_consumeKeyCheck);
+    
     mainLayout->addWidget(m_keyDownGroup);
     mainLayout->addWidget(m_keyUpGroup);
     
@@ -318,6 +323,7 @@ KeyMappingEntry MappingDialog::getMappingEntry() const
     entry.enableKeyUp = m_enableKeyUpCheck->isChecked();
     entry.filterRepeats = m_filterRepeatsCheck->isChecked();
     entry.suppressRepeats = m_suppressRepeatsCheck->isChecked();
+    entry.consumeKey = m_consumeKeyCheck->isChecked();
     
     entry.keyDownMessage.type = static_cast<MidiMessage::Type>(m_keyDownTypeCombo->currentIndex());
     entry.keyDownMessage.channel = m_keyDownChannelSpin->value() - 1;
@@ -333,11 +339,17 @@ KeyMappingEntry MappingDialog::getMappingEntry() const
     entry.keyUpMessage.controller = m_keyUpControllerSpin->value();
     entry.keyUpMessage.value = m_keyUpValueSpin->value();
     
+    entry.enableHold = m_editedEntry.enableHold;
+    entry.holdThresholdMs = m_editedEntry.holdThresholdMs;
+    entry.holdMessage = m_editedEntry.holdMessage;
+    
     return entry;
 }
 
 void MappingDialog::setMappingEntry(const KeyMappingEntry &entry)
 {
+    m_editedEntry = entry;
+    
     m_vkCodeEdit->blockSignals(true);
     m_enableKeyDownCheck->blockSignals(true);
     m_enableKeyUpCheck->blockSignals(true);
@@ -348,6 +360,7 @@ void MappingDialog::setMappingEntry(const KeyMappingEntry &entry)
     m_enableKeyUpCheck->setChecked(entry.enableKeyUp);
     m_filterRepeatsCheck->setChecked(entry.filterRepeats);
     m_suppressRepeatsCheck->setChecked(entry.suppressRepeats);
+    m_consumeKeyCheck->setChecked(entry.consumeKey);
     
     m_keyDownTypeCombo->setCurrentIndex(static_cast<int>(entry.keyDownMessage.type));
     m_keyDownChannelSpin->setValue(entry.keyDownMessage.channel + 1);
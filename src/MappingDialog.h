@@ -72,6 +72,7 @@ private:
     QCheckBox *m_enableKeyUpCheck;
     QCheckBox *m_filterRepeatsCheck;
     QCheckBox *m_suppressRepeatsCheck;
+    QCheckBox *m_consumeKeyCheck;
     
     QGroupBox *m_keyDownGroup;
     QComboBox *m_keyDownTypeCombo;
@@ -99,6 +100,8 @@ private:
     
     QDialogButtonBox *m_buttonBox;
     
+    KeyMappingEntry m_editedEntry;      // Source of the settings this dialog has no controls for
+    
     bool m_isListening;
     bool m_isEditing;
 };
\ No newline at end of file
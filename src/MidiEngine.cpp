@@ -1,8 +1,30 @@
 #include "MidiEngine.h"
+#include "KeyEvent.h"
+#include "MidiPortWatcher.h"
 #include <QDebug>
+#include <QMutexLocker>
+#include <QThread>
 #include <algorithm>
 #include <rtmidi/RtMidi.h>
 
+namespace {
+    constexpr std::int64_t ERROR_REPORT_INTERVAL_NS = 5000000000LL;
+    constexpr int RECONNECT_INITIAL_BACKOFF_MS = 50;
+    constexpr int RECONNECT_MAX_BACKOFF_MS = 1000;
+    constexpr int SUPERVISOR_IDLE_WAIT_MS = 1000;
+
+    struct OutputModeName {
+        MidiEngine::OutputMode mode;
+        const char *name;
+    };
+
+    constexpr OutputModeName OUTPUT_MODE_NAMES[] = {
+        {MidiEngine::DirectOutput, "direct"},
+        {MidiEngine::DinPacedOutput, "din"},
+        {MidiEngine::DinRunningStatusOutput, "din-running-status"},
+    };
+}
+
 void MidiMessage::validate() {
     if (channel < 0 || channel > 15) {
         qWarning() << "MIDI channel" << channel << "out of range (0-15), get clamped";
@@ -26,15 +48,46 @@ void MidiMessage::validate() {
     }
 }
 
+MidiBytes MidiMessage::toBytes() const
+{
+    switch (type) {
+        case NOTE_OFF:
+            return {static_cast<std::uint8_t>(0x80 | (channel & 0x0F)),
+                    static_cast<std::uint8_t>(note & 0x7F),
+                    static_cast<std::uint8_t>(velocity & 0x7F)};
+            
+        case CONTROL_CHANGE:
+            return {static_cast<std::uint8_t>(0xB0 | (channel & 0x0F)),
+                    static_cast<std::uint8_t>(controller & 0x7F),
+                    static_cast<std::uint8_t>(value & 0x7F)};
+            
+        case NOTE_ON:
+        default:
+            return {static_cast<std::uint8_t>(0x90 | (channel & 0x0F)),
+                    static_cast<std::uint8_t>(note & 0x7F),
+                    static_cast<std::uint8_t>(velocity & 0x7F)};
+    }
+}
+
 MidiEngine::MidiEngine(QObject *parent)
     : QObject(parent)
     , m_midiOut(nullptr)
+    , m_portWatcher(new MidiPortWatcher(this))
     , m_currentPortIndex(-1)
     , m_portOpen(false)
+    , m_portLost(false)
+    , m_restoreState(true)
+    , m_errorLimiter(ERROR_REPORT_INTERVAL_NS)
+    , m_outputWorker(std::make_unique<MidiOutputWorker>(
+          [this](const MidiBytes *messages, int count) { writeToPort(messages, count); }, &m_latency))
 {
+    connect(m_portWatcher, &MidiPortWatcher::portsChanged, this,
+            [this](const QStringList &ports, quint64) { onPortsChanged(ports); });
+    connect(m_portWatcher, &MidiPortWatcher::errorOccurred, this, &MidiEngine::errorOccurred);
+
     try {
         m_midiOut = std::make_unique<RtMidiOut>();
-        refreshPorts();
+        m_portWatcher->start();
     } catch (const RtMidiError &error) {
         const QString errorMsg = QString::fromStdString(error.getMessage());
         qCritical() << "RtMidi initialization failed:" << errorMsg;
@@ -45,44 +98,67 @@ MidiEngine::MidiEngine(QObject *parent)
 MidiEngine::~MidiEngine()
 {
     closePort();
+    m_portWatcher->stop();
 }
 
-QStringList MidiEngine::getAvailablePorts()
+QStringList MidiEngine::getAvailablePorts() const
 {
-    refreshPorts();
-    return m_availablePorts;
+    return m_portWatcher->ports();
 }
 
-void MidiEngine::refreshPorts()
+quint64 MidiEngine::portListVersion() const
 {
-    m_availablePorts.clear();
-    
-    if (!m_midiOut) {
-        qWarning() << "MIDI output not initialized";
-        return;
+    return m_portWatcher->version();
+}
+
+void MidiEngine::rescanPorts()
+{
+    m_portWatcher->rescan();
+}
+
+int MidiEngine::resolvePortIndex(int cachedIndex, const QString &portName)
+{
+    // The cache can trail the system by one poll, so confirm the index still names the
+    // port with a single query and only fall back to a full search when it does not
+    const unsigned int portCount = m_midiOut->getPortCount();
+    if (cachedIndex >= 0 && static_cast<unsigned int>(cachedIndex) < portCount
+        && QString::fromStdString(m_midiOut->getPortName(cachedIndex)) == portName) {
+        return cachedIndex;
     }
-    
-    try {
-        const unsigned int portCount = m_midiOut->getPortCount();
-        
-        for (unsigned int i = 0; i < portCount; ++i) {
-            try {
-                const std::string portName = m_midiOut->getPortName(i);
-                m_availablePorts.append(QString::fromStdString(portName));
-            } catch (const RtMidiError &error) {
-                qWarning() << "Error getting port name for index" << i << ":" 
-                          << QString::fromStdString(error.getMessage());
-            }
+
+    m_portWatcher->rescan();
+    for (unsigned int i = 0; i < portCount; ++i) {
+        if (QString::fromStdString(m_midiOut->getPortName(i)) == portName) {
+            return static_cast<int>(i);
         }
-    } catch (const RtMidiError &error) {
-        const QString errorMsg = QString::fromStdString(error.getMessage());
-        qWarning() << "Error refreshing MIDI ports:" << errorMsg;
-        emit errorOccurred(QString("Failed to enumerate MIDI ports: %1").arg(errorMsg));
     }
+    return -1;
 }
 
 bool MidiEngine::openPort(int portIndex)
 {
+    const QStringList ports = m_portWatcher->ports();
+    if (portIndex < 0 || portIndex >= ports.size()) {
+        const QString errorMsg = QString("Invalid port index: %1 (available: 0-%2)")
+                               .arg(portIndex).arg(ports.size() - 1);
+        qWarning() << errorMsg;
+        emit errorOccurred(errorMsg);
+        return false;
+    }
+    return openPortByName(portIndex, ports.at(portIndex));
+}
+
+bool MidiEngine::openPort(const QString &portName)
+{
+    return openPortByName(m_portWatcher->ports().indexOf(portName), portName);
+}
+
+bool MidiEngine::openPortByName(int cachedIndex, const QString &portName)
+{
+    if (portName.startsWith(VIRTUAL_PORT_PREFIX)) {
+        return openVirtualPort(portName.mid(QString(VIRTUAL_PORT_PREFIX).size()));
+    }
+
     if (!m_midiOut) {
         const QString errorMsg = "MIDI engine not initialized";
         qCritical() << errorMsg;
@@ -92,62 +168,148 @@ bool MidiEngine::openPort(int portIndex)
     
     closePort();
     
+    QMutexLocker locker(&m_portMutex);
     try {
-        refreshPorts();
-        
-        if (portIndex < 0 || portIndex >= m_availablePorts.size()) {
-            const QString errorMsg = QString("Invalid port index: %1 (available: 0-%2)")
-                                   .arg(portIndex).arg(m_availablePorts.size() - 1);
+        const int portIndex = resolvePortIndex(cachedIndex, portName);
+        if (portIndex < 0) {
+            const QString errorMsg = QString("MIDI port not found: %1").arg(portName);
             qWarning() << errorMsg;
+            locker.unlock();
             emit errorOccurred(errorMsg);
             return false;
         }
         
         m_midiOut->openPort(portIndex);
-        m_currentPortIndex = portIndex;
-        m_currentPortName = m_availablePorts.at(portIndex);
-        m_portOpen = true;
+        beginSession(portIndex, portName);
+        locker.unlock();
         
+        startSupervisor(portName);
         emit portOpened(m_currentPortName);
         return true;
         
     } catch (const RtMidiError &error) {
         const QString errorMsg = QString("Failed to open MIDI port %1: %2")
-                              .arg(portIndex)
+                              .arg(portName)
                               .arg(QString::fromStdString(error.getMessage()));
         qWarning() << errorMsg;
+        locker.unlock();
         emit errorOccurred(errorMsg);
         return false;
     }
 }
 
-bool MidiEngine::openPort(const QString &portName)
+bool MidiEngine::supportsVirtualPorts() const
+{
+    if (!m_midiOut) {
+        return false;
+    }
+
+    // Windows MM only warns instead of failing, so ask the backend up front
+    switch (m_midiOut->getCurrentApi()) {
+        case RtMidi::LINUX_ALSA:
+        case RtMidi::UNIX_JACK:
+        case RtMidi::MACOSX_CORE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool MidiEngine::openVirtualPort(const QString &name)
 {
-    refreshPorts();
-    const int index = m_availablePorts.indexOf(portName);
-    if (index >= 0) {
-        return openPort(index);
-    } else {
-        const QString errorMsg = QString("MIDI port not found: %1").arg(portName);
+    if (!supportsVirtualPorts()) {
+        const QString errorMsg = "Virtual MIDI ports are not supported by this MIDI backend";
+        qWarning() << errorMsg;
+        emit errorOccurred(errorMsg);
+        return false;
+    }
+    
+    closePort();
+    
+    QMutexLocker locker(&m_portMutex);
+    try {
+        m_midiOut->openVirtualPort(name.toStdString());
+        // A port we publish ourselves cannot be unplugged, so it needs no supervisor
+        beginSession(-1, virtualPortSpec(name));
+        locker.unlock();
+        
+        emit portOpened(m_currentPortName);
+        return true;
+        
+    } catch (const RtMidiError &error) {
+        const QString errorMsg = QString("Failed to create virtual MIDI port %1: %2")
+                              .arg(name)
+                              .arg(QString::fromStdString(error.getMessage()));
         qWarning() << errorMsg;
+        locker.unlock();
         emit errorOccurred(errorMsg);
         return false;
     }
 }
 
+bool MidiEngine::isVirtualPort() const
+{
+    return m_portOpen && m_currentPortName.startsWith(VIRTUAL_PORT_PREFIX);
+}
+
+QString MidiEngine::virtualPortSpec(const QString &name)
+{
+    return QString(VIRTUAL_PORT_PREFIX) + name;
+}
+
+void MidiEngine::beginSession(int portIndex, const QString &portName)
+{
+    m_currentPortIndex = portIndex;
+    m_currentPortName = portName;
+    m_stateTracker.reset();
+    m_portLost = false;
+    applyOutputMode(portOutputMode(m_currentPortName));
+    m_outputWorker->resetStats();
+    m_outputWorker->start();
+    m_portOpen = true;
+    m_errorLimiter.reset();
+}
+
+void MidiEngine::startSupervisor(const QString &portName)
+{
+    while (m_reconnectWake.tryAcquire()) {
+    }
+    m_supervisorThread.reset(QThread::create([this, portName] { superviseConnection(portName); }));
+    m_supervisorThread->setObjectName("MidiConnectionSupervisor");
+    m_supervisorThread->start(QThread::LowPriority);
+}
+
 void MidiEngine::closePort()
 {
-    if (m_midiOut && m_portOpen) {
+    // Refuse new messages first, then let the worker send what is queued and, last of all,
+    // a note-off for every note still sounding
+    m_portOpen = false;
+    m_outputWorker->stop();
+    if (m_supervisorThread) {
+        m_reconnectWake.release();
+        m_supervisorThread->wait();
+        m_supervisorThread.reset();
+    }
+    m_portLost = false;
+    if (!m_currentPortName.isEmpty()) {
+        m_closedPortStats[m_currentPortName].merge(m_outputWorker->stats());
+    }
+
+    QMutexLocker locker(&m_portMutex);
+    closeDriverPort();
+    if (m_currentPortName.startsWith(VIRTUAL_PORT_PREFIX)) {
+        // RtMidi only withdraws a virtual port when its client goes away
         try {
-            m_midiOut->closePort();
+            m_midiOut = std::make_unique<RtMidiOut>();
         } catch (const RtMidiError &error) {
-            qWarning() << "Error closing MIDI port:" << QString::fromStdString(error.getMessage());
+            qWarning() << "Error recreating MIDI client:" << QString::fromStdString(error.getMessage());
+            m_midiOut.reset();
         }
     }
     
     m_currentPortIndex = -1;
     m_currentPortName.clear();
-    m_portOpen = false;
+    locker.unlock();
     emit portClosed();
 }
 
@@ -156,6 +318,11 @@ bool MidiEngine::isPortOpen() const
     return m_portOpen;
 }
 
+bool MidiEngine::isReconnecting() const
+{
+    return m_portOpen && m_portLost;
+}
+
 QString MidiEngine::getCurrentPortName() const
 {
     return m_currentPortName;
@@ -168,28 +335,293 @@ int MidiEngine::getCurrentPortIndex() const
 
 void MidiEngine::sendMidiMessage(const MidiMessage &message)
 {
-    if (!m_midiOut || !m_portOpen) {
-        const QString errorMsg = "Cannot send MIDI: No port open";
-        qWarning() << errorMsg;
-        emit errorOccurred(errorMsg);
+    sendMidiBytes(message.toBytes());
+}
+
+void MidiEngine::sendMidiBytes(const MidiBytes &message, bool isRepeat, std::int64_t captureNs)
+{
+    if (!m_portOpen) {
+        reportError("Cannot send MIDI: No port open");
         return;
     }
-    
+
+    m_outputWorker->enqueue(message, isRepeat, captureNs);
+}
+
+int MidiEngine::releaseAllNotes()
+{
+    if (!m_portOpen) {
+        return 0;
+    }
+
+    return m_outputWorker->releaseAllNotes();
+}
+
+void MidiEngine::setOverflowPolicy(MidiOutputWorker::OverflowPolicy policy)
+{
+    m_outputWorker->setOverflowPolicy(policy);
+}
+
+MidiOutputWorker::OverflowPolicy MidiEngine::overflowPolicy() const
+{
+    return m_outputWorker->overflowPolicy();
+}
+
+void MidiEngine::setPortOutputMode(const QString &portName, OutputMode mode)
+{
+    m_portOutputModes[portName] = mode;
+    if (m_portOpen && portName == m_currentPortName) {
+        applyOutputMode(mode);
+    }
+}
+
+MidiEngine::OutputMode MidiEngine::portOutputMode(const QString &portName) const
+{
+    return m_portOutputModes.value(portName, DirectOutput);
+}
+
+QMap<QString, MidiEngine::OutputMode> MidiEngine::portOutputModes() const
+{
+    return m_portOutputModes;
+}
+
+QString MidiEngine::outputModeName(OutputMode mode)
+{
+    for (const OutputModeName &entry : OUTPUT_MODE_NAMES) {
+        if (entry.mode == mode) {
+            return entry.name;
+        }
+    }
+    return OUTPUT_MODE_NAMES[0].name;
+}
+
+bool MidiEngine::outputModeFromName(const QString &name, OutputMode &mode)
+{
+    for (const OutputModeName &entry : OUTPUT_MODE_NAMES) {
+        if (name == QLatin1String(entry.name)) {
+            mode = entry.mode;
+            return true;
+        }
+    }
+    return false;
+}
+
+void MidiEngine::applyOutputMode(OutputMode mode)
+{
+    switch (mode) {
+        case DinPacedOutput:
+            m_outputWorker->setWireShaping(MidiWireShaper::DIN_BAUD_RATE, false);
+            break;
+        case DinRunningStatusOutput:
+            m_outputWorker->setWireShaping(MidiWireShaper::DIN_BAUD_RATE, true);
+            break;
+        case DirectOutput:
+        default:
+            m_outputWorker->setWireShaping(0, false);
+            break;
+    }
+}
+
+void MidiEngine::setControlCoalesceWindowMs(int windowMs)
+{
+    m_outputWorker->setControlCoalesceWindowMs(windowMs);
+}
+
+int MidiEngine::controlCoalesceWindowMs() const
+{
+    return m_outputWorker->controlCoalesceWindowMs();
+}
+
+void MidiEngine::setRestoreStateOnReconnect(bool enabled)
+{
+    m_restoreState = enabled;
+}
+
+bool MidiEngine::restoreStateOnReconnect() const
+{
+    return m_restoreState;
+}
+
+bool MidiEngine::waitForOutputIdle(int timeoutMs)
+{
+    return m_outputWorker->waitForIdle(timeoutMs);
+}
+
+PipelineLatency &MidiEngine::latency()
+{
+    return m_latency;
+}
+
+const PipelineLatency &MidiEngine::latency() const
+{
+    return m_latency;
+}
+
+MidiOutputStats MidiEngine::outputStats() const
+{
+    MidiOutputStats stats = m_closedPortStats.value(m_currentPortName);
+    if (m_portOpen) {
+        stats.merge(m_outputWorker->stats());
+    }
+    return stats;
+}
+
+QMap<QString, MidiOutputStats> MidiEngine::outputStatsByPort() const
+{
+    QMap<QString, MidiOutputStats> statsByPort = m_closedPortStats;
+    if (m_portOpen) {
+        statsByPort[m_currentPortName] = outputStats();
+    }
+    return statsByPort;
+}
+
+void MidiEngine::writeToPort(const MidiBytes *messages, int count)
+{
+    QMutexLocker locker(&m_portMutex);
+    if (!m_midiOut) {
+        return;
+    }
+
+    // Track even while the port is gone, so a reconnect restores the current state
+    for (int i = 0; i < count; ++i) {
+        m_stateTracker.track(messages[i]);
+    }
+    if (m_portLost) {
+        return;
+    }
+
+    // RtMidi takes one message per call; sending the whole burst under a single
+    // lock keeps the driver calls back to back
     try {
-        MidiMessage validatedMessage = message;
-        validatedMessage.validate();
-        
-        const std::vector<unsigned char> midiData = createMidiMessage(validatedMessage);
-        m_midiOut->sendMessage(&midiData);
-        
-        emit midiMessageSent(validatedMessage);
-        
+        for (int i = 0; i < count; ++i) {
+            m_midiOut->sendMessage(messages[i].data(), messages[i].size());
+        }
     } catch (const RtMidiError &error) {
-        const QString errorMsg = QString("Failed to send MIDI message: %1")
-                              .arg(QString::fromStdString(error.getMessage()));
-        qWarning() << errorMsg;
-        emit errorOccurred(errorMsg);
+        const bool lost = markPortLost();
+        locker.unlock();
+        if (lost) {
+            notifyPortLost(m_currentPortName, QString::fromStdString(error.getMessage()));
+        }
+    }
+}
+
+void MidiEngine::onPortsChanged(const QStringList &ports)
+{
+    if (m_portOpen && !isVirtualPort()) {
+        const bool present = ports.contains(m_currentPortName);
+        if (!present && !m_portLost) {
+            QMutexLocker locker(&m_portMutex);
+            const bool lost = markPortLost();
+            locker.unlock();
+            if (lost) {
+                notifyPortLost(m_currentPortName, "device removed");
+            }
+        } else if (present && m_portLost) {
+            m_reconnectWake.release();
+        }
     }
+
+    emit portsChanged(ports);
+}
+
+bool MidiEngine::markPortLost()
+{
+    if (m_portLost.exchange(true)) {
+        return false;
+    }
+
+    closeDriverPort();
+    return true;
+}
+
+void MidiEngine::closeDriverPort()
+{
+    if (!m_midiOut || !m_midiOut->isPortOpen()) {
+        return;
+    }
+
+    try {
+        m_midiOut->closePort();
+    } catch (const RtMidiError &error) {
+        qWarning() << "Error closing MIDI port:" << QString::fromStdString(error.getMessage());
+    }
+}
+
+void MidiEngine::notifyPortLost(const QString &portName, const QString &reason)
+{
+    m_reconnectWake.release();
+    reportError(QString("MIDI port %1 lost (%2), reconnecting").arg(portName, reason));
+    emit portLost(portName);
+}
+
+void MidiEngine::superviseConnection(const QString &portName)
+{
+    int backoffMs = RECONNECT_INITIAL_BACKOFF_MS;
+
+    while (m_portOpen) {
+        if (!m_portLost) {
+            m_reconnectWake.tryAcquire(1, SUPERVISOR_IDLE_WAIT_MS);
+            backoffMs = RECONNECT_INITIAL_BACKOFF_MS;
+            continue;
+        }
+
+        if (tryReconnect(portName)) {
+            continue;
+        }
+
+        // Woken early when the port watcher sees the port name again
+        m_reconnectWake.tryAcquire(1, backoffMs);
+        backoffMs = std::min(backoffMs * 2, RECONNECT_MAX_BACKOFF_MS);
+    }
+}
+
+bool MidiEngine::tryReconnect(const QString &portName)
+{
+    QMutexLocker locker(&m_portMutex);
+    if (!m_portOpen) {
+        return false;
+    }
+
+    try {
+        const int portIndex = resolvePortIndex(-1, portName);
+        if (portIndex < 0) {
+            return false;
+        }
+
+        m_midiOut->openPort(portIndex);
+        m_currentPortIndex = portIndex;
+
+        if (m_restoreState) {
+            for (const MidiBytes &message : m_stateTracker.replayMessages()) {
+                m_midiOut->sendMessage(message.data(), message.size());
+            }
+        }
+        m_portLost = false;
+    } catch (const RtMidiError &error) {
+        qWarning() << "MIDI reconnect attempt failed:" << QString::fromStdString(error.getMessage());
+        closeDriverPort();
+        return false;
+    }
+    locker.unlock();
+
+    m_errorLimiter.reset();
+    qInfo().noquote() << QString("MIDI port %1 reconnected").arg(portName);
+    emit portReconnected(portName);
+    return true;
+}
+
+void MidiEngine::reportError(const QString &error)
+{
+    int suppressed = 0;
+    if (!m_errorLimiter.allow(EngineClock::nowNs(), suppressed)) {
+        return;
+    }
+
+    const QString errorMsg = suppressed > 0
+        ? QString("%1 (%2 similar errors suppressed)").arg(error).arg(suppressed)
+        : error;
+    qWarning() << errorMsg;
+    emit errorOccurred(errorMsg);
 }
 
 void MidiEngine::sendNoteOn(int channel, int note, int velocity)
@@ -222,39 +654,6 @@ void MidiEngine::sendControlChange(int channel, int controller, int value)
     sendMidiMessage(message);
 }
 
-std::vector<unsigned char> MidiEngine::createMidiMessage(const MidiMessage &message)
-{
-    std::vector<unsigned char> midiData;
-    
-    const int channel = message.channel;
-    const int note = message.note;
-    const int velocity = message.velocity;
-    const int controller = message.controller;
-    const int value = message.value;
-    
-    switch (message.type) {
-        case MidiMessage::NOTE_ON:
-            midiData.push_back(0x90 | channel);
-            midiData.push_back(note);
-            midiData.push_back(velocity);
-            break;
-            
-        case MidiMessage::NOTE_OFF:
-            midiData.push_back(0x80 | channel);
-            midiData.push_back(note);
-            midiData.push_back(velocity);
-            break;
-            
-        case MidiMessage::CONTROL_CHANGE:
-            midiData.push_back(0xB0 | channel);
-            midiData.push_back(controller);
-            midiData.push_back(value);
-            break;
-    }
-    
-    return midiData;
-}
-
 QString MidiEngine::midiMessageToString(const MidiMessage &message)
 {
     const QString channelStr = QString::number(message.channel + 1);
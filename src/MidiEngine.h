@@ -1,10 +1,21 @@
 #pragma once
 
 #include <QObject>
+#include <QMap>
+#include <QMutex>
+#include <QSemaphore>
 #include <QString>
 #include <QStringList>
+#include <array>
+#include <atomic>
+#include <cstdint>
 #include <memory>
+#include "ErrorRateLimiter.h"
+#include "MidiOutputWorker.h"
+#include "MidiStateTracker.h"
 
+class MidiPortWatcher;
+class QThread;
 class RtMidiOut;
 
 struct MidiMessage {
@@ -23,6 +34,8 @@ struct MidiMessage {
     MidiMessage() : channel(0), note(60), velocity(127), controller(1), value(64), type(NOTE_ON) {}
     
     void validate();
+    
+    MidiBytes toBytes() const;
 };
 
 class MidiEngine : public QObject
@@ -30,37 +43,123 @@ class MidiEngine : public QObject
     Q_OBJECT
 
 public:
+    // How output to a given port is paced. USB and virtual ports take messages as fast
+    // as they arrive; 5-pin DIN interfaces only carry 31,250 baud.
+    enum OutputMode {
+        DirectOutput,
+        DinPacedOutput,
+        DinRunningStatusOutput  // Paced assuming the interface transmits with running status
+    };
+
+    // Port names with this prefix refer to a virtual port KtoMIDI publishes itself
+    static constexpr const char *VIRTUAL_PORT_PREFIX = "virtual:";
+
     explicit MidiEngine(QObject *parent = nullptr);
     ~MidiEngine();
 
-    QStringList getAvailablePorts();
+    // Cached list kept current by a background watcher; never queries the driver
+    QStringList getAvailablePorts() const;
+    quint64 portListVersion() const;
+    void rescanPorts();
     bool openPort(int portIndex);
     bool openPort(const QString &portName);
+    // Publishes an output port other applications connect to directly (ALSA, JACK, CoreMIDI)
+    bool openVirtualPort(const QString &name);
+    bool supportsVirtualPorts() const;
+    bool isVirtualPort() const;
+    static QString virtualPortSpec(const QString &name);
     void closePort();
+    // Stays true while a lost port is being reconnected; see isReconnecting()
     bool isPortOpen() const;
+    bool isReconnecting() const;
     QString getCurrentPortName() const;
     int getCurrentPortIndex() const;
 
     void sendMidiMessage(const MidiMessage &message);
+    // Queues the message for the output worker; repeats may be dropped under backpressure
+    // captureNs, when the key event behind the message was captured, times CaptureToSend
+    void sendMidiBytes(const MidiBytes &message, bool isRepeat = false, std::int64_t captureNs = 0);
     void sendNoteOn(int channel, int note, int velocity);
     void sendNoteOff(int channel, int note, int velocity);
     void sendControlChange(int channel, int controller, int value);
 
+    // Sends a note-off for each note still sounding on the open port, after the messages
+    // already queued; returns how many were sounding. closePort() does this too, so
+    // switching ports or quitting never leaves notes hanging.
+    int releaseAllNotes();
+
+    void setOverflowPolicy(MidiOutputWorker::OverflowPolicy policy);
+    MidiOutputWorker::OverflowPolicy overflowPolicy() const;
+    // Remembered per port name and applied whenever that port is opened
+    void setPortOutputMode(const QString &portName, OutputMode mode);
+    OutputMode portOutputMode(const QString &portName) const;
+    QMap<QString, OutputMode> portOutputModes() const;
+
+    static QString outputModeName(OutputMode mode);
+    static bool outputModeFromName(const QString &name, OutputMode &mode);
+
+    void setControlCoalesceWindowMs(int windowMs);
+    int controlCoalesceWindowMs() const;
+
+    // Resends held notes and the last controller values once a lost port is back
+    void setRestoreStateOnReconnect(bool enabled);
+    bool restoreStateOnReconnect() const;
+
+    // Waits until queued messages reached the port, e.g. before closing a paced port
+    bool waitForOutputIdle(int timeoutMs);
+
+    // Totals for the open port across every session since startup
+    MidiOutputStats outputStats() const;
+    QMap<QString, MidiOutputStats> outputStatsByPort() const;
+
+    // Key-to-MIDI latency. Lives here because the output worker records the last stage.
+    PipelineLatency &latency();
+    const PipelineLatency &latency() const;
+
     static QString midiMessageToString(const MidiMessage &message);
 
 signals:
+    void portsChanged(const QStringList &ports);
     void portOpened(const QString &portName);
     void portClosed();
-    void midiMessageSent(const MidiMessage &message);
+    void portLost(const QString &portName);
+    void portReconnected(const QString &portName);
     void errorOccurred(const QString &error);
 
 private:
-    void refreshPorts();
-    std::vector<unsigned char> createMidiMessage(const MidiMessage &message);
+    bool openPortByName(int cachedIndex, const QString &portName);
+    int resolvePortIndex(int cachedIndex, const QString &portName);
+    // Called with m_portMutex held once the driver port is open
+    void beginSession(int portIndex, const QString &portName);
+    void startSupervisor(const QString &portName);
+    void writeToPort(const MidiBytes *messages, int count);
+    void applyOutputMode(OutputMode mode);
+    void onPortsChanged(const QStringList &ports);
+
+    // Called with m_portMutex held; true if the port was not already marked lost
+    bool markPortLost();
+    void closeDriverPort();
+    void notifyPortLost(const QString &portName, const QString &reason);
+    void superviseConnection(const QString &portName);
+    bool tryReconnect(const QString &portName);
+
+    // Reports send-path errors at most once per interval
+    void reportError(const QString &error);
 
     std::unique_ptr<RtMidiOut> m_midiOut;
-    QStringList m_availablePorts;
-    int m_currentPortIndex;
+    MidiPortWatcher *m_portWatcher;
+    std::atomic<int> m_currentPortIndex;
     QString m_currentPortName;
-    bool m_portOpen;
+    std::atomic<bool> m_portOpen;
+    std::atomic<bool> m_portLost;
+    std::atomic<bool> m_restoreState;
+    QMutex m_portMutex;
+    MidiStateTracker m_stateTracker;
+    ErrorRateLimiter m_errorLimiter;
+    std::unique_ptr<QThread> m_supervisorThread;
+    QSemaphore m_reconnectWake;
+    PipelineLatency m_latency;
+    std::unique_ptr<MidiOutputWorker> m_outputWorker;
+    QMap<QString, MidiOutputStats> m_closedPortStats;
+    QMap<QString, OutputMode> m_portOutputModes;
 };
\ No newline at end of file
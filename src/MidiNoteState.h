@@ -0,0 +1,124 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include "MidiWireShaper.h"
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Which notes are sounding on each channel of the open port, as 16 x 128 bits.
+// Only the owning thread calls track(), releaseAll() and clear(): the output
+// worker's thread for its state, the player thread for each macro voice. The
+// words stay atomic on purpose so other threads can read isHeld() and
+// heldCount() without a lock, as MidiOutputWorker::releaseAllNotes() does.
+// Nothing here allocates.
+class MidiNoteState
+{
+public:
+    static constexpr int CHANNEL_COUNT = 16;
+    static constexpr int NOTE_COUNT = 128;
+
+    MidiNoteState()
+    {
+        clear();
+    }
+
+    MidiNoteState(const MidiNoteState &) = delete;
+    MidiNoteState &operator=(const MidiNoteState &) = delete;
+
+    void track(const MidiBytes &message)
+    {
+        const int channel = message[0] & 0x0F;
+        const int note = message[1] & 0x7F;
+
+        switch (message[0] & 0xF0) {
+            case NOTE_ON_STATUS:
+                if (message[2] != 0) {
+                    word(channel, note).fetch_or(bit(note), std::memory_order_relaxed);
+                    break;
+                }
+                [[fallthrough]]; // Velocity 0 is a note-off
+            case NOTE_OFF_STATUS:
+                word(channel, note).fetch_and(~bit(note), std::memory_order_relaxed);
+                break;
+            case CONTROL_CHANGE_STATUS:
+                if (message[1] == ALL_SOUND_OFF || message[1] == ALL_NOTES_OFF) {
+                    m_words[channel * WORDS_PER_CHANNEL].store(0, std::memory_order_relaxed);
+                    m_words[channel * WORDS_PER_CHANNEL + 1].store(0, std::memory_order_relaxed);
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    bool isHeld(int channel, int note) const
+    {
+        return (m_words[wordIndex(channel, note)].load(std::memory_order_relaxed) & bit(note)) != 0;
+    }
+
+    // A snapshot; notes may change while the words are read
+    int heldCount() const
+    {
+        int count = 0;
+        for (const std::atomic<std::uint64_t> &word : m_words) {
+            for (std::uint64_t held = word.load(std::memory_order_relaxed); held != 0; held &= held - 1) {
+                ++count;
+            }
+        }
+        return count;
+    }
+
+    // Forgets every held note and calls noteOff(channel, note) for each; returns the count
+    template<typename NoteOff>
+    int releaseAll(NoteOff &&noteOff)
+    {
+        int released = 0;
+        for (int index = 0; index < WORD_COUNT; ++index) {
+            std::uint64_t held = m_words[index].exchange(0, std::memory_order_relaxed);
+            while (held != 0) {
+                const int note = (index % WORDS_PER_CHANNEL) * 64 + lowestBit(held);
+                noteOff(index / WORDS_PER_CHANNEL, note);
+                held &= held - 1;
+                ++released;
+            }
+        }
+        return released;
+    }
+
+    void clear()
+    {
+        for (std::atomic<std::uint64_t> &word : m_words) {
+            word.store(0, std::memory_order_relaxed);
+        }
+    }
+
+private:
+    static constexpr std::uint8_t NOTE_OFF_STATUS = 0x80;
+    static constexpr std::uint8_t NOTE_ON_STATUS = 0x90;
+    static constexpr std::uint8_t CONTROL_CHANGE_STATUS = 0xB0;
+    static constexpr int ALL_SOUND_OFF = 120;
+    static constexpr int ALL_NOTES_OFF = 123;
+    static constexpr int WORDS_PER_CHANNEL = NOTE_COUNT / 64;
+    static constexpr int WORD_COUNT = CHANNEL_COUNT * WORDS_PER_CHANNEL;
+
+    static int wordIndex(int channel, int note) { return channel * WORDS_PER_CHANNEL + (note >> 6); }
+    static std::uint64_t bit(int note) { return std::uint64_t(1) << (note & 63); }
+
+    static int lowestBit(std::uint64_t value)
+    {
+#ifdef _MSC_VER
+        unsigned long index = 0;
+        _BitScanForward64(&index, value);
+        return static_cast<int>(index);
+#else
+        return __builtin_ctzll(value);
+#endif
+    }
+
+    std::atomic<std::uint64_t> &word(int channel, int note) { return m_words[wordIndex(channel, note)]; }
+
+    std::array<std::atomic<std::uint64_t>, WORD_COUNT> m_words;
+};
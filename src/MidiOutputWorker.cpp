@@ -0,0 +1,600 @@
+#include "MidiOutputWorker.h"
+#include "KeyEvent.h"
+#include <QStringList>
+#include <QThread>
+#include <algorithm>
+#include <bitset>
+#include <limits>
+
+namespace {
+    constexpr int IDLE_WAIT_TIMEOUT_MS = 100;
+    constexpr std::uint8_t STATUS_TYPE_MASK = 0xF0;
+    constexpr std::uint8_t CONTROL_CHANGE_STATUS = 0xB0;
+    constexpr std::int64_t NS_PER_MS = 1000000;
+    constexpr std::int64_t SPIN_THRESHOLD_NS = 1000000;
+
+    // Wire slots are about a millisecond apart, finer than a sleep can reliably hit
+    void waitUntil(std::int64_t deadlineNs)
+    {
+        for (;;) {
+            const std::int64_t remaining = deadlineNs - EngineClock::nowNs();
+            if (remaining <= 0) {
+                return;
+            }
+            if (remaining > SPIN_THRESHOLD_NS) {
+                QThread::usleep(static_cast<unsigned long>((remaining - SPIN_THRESHOLD_NS) / 1000));
+            } else {
+                QThread::yieldCurrentThread();
+            }
+        }
+    }
+
+    bool isControlChange(const MidiBytes &message)
+    {
+        return (message[0] & STATUS_TYPE_MASK) == CONTROL_CHANGE_STATUS;
+    }
+
+    int controlSlot(const MidiBytes &message)
+    {
+        return (message[0] & 0x0F) * 128 + (message[1] & 0x7F);
+    }
+
+    struct PolicyName {
+        MidiOutputWorker::OverflowPolicy policy;
+        const char *name;
+    };
+
+    constexpr PolicyName POLICY_NAMES[] = {
+        {MidiOutputWorker::Block, "block"},
+        {MidiOutputWorker::DropRepeats, "drop-repeats"},
+        {MidiOutputWorker::CoalesceCC, "coalesce-cc"},
+    };
+
+    QString formatLatency(const char *name, const LatencySummary &s)
+    {
+        return QString("  %1: n=%2 p50=%3 p99=%4 p999=%5 max=%6")
+               .arg(name, -16)
+               .arg(s.count)
+               .arg(QString::number(s.p50Ns / 1000.0, 'f', 1))
+               .arg(QString::number(s.p99Ns / 1000.0, 'f', 1))
+               .arg(QString::number(s.p999Ns / 1000.0, 'f', 1))
+               .arg(QString::number(s.maxNs / 1000.0, 'f', 1));
+    }
+}
+
+void MidiOutputStats::merge(const MidiOutputStats &later)
+{
+    enqueued += later.enqueued;
+    sent += later.sent;
+    dropped += later.dropped;
+    coalesced += later.coalesced;
+    queueDepth = later.queueDepth;
+    maxQueueDepth = std::max(maxQueueDepth, later.maxQueueDepth);
+    wireBytes += later.wireBytes;
+    runningStatusSavedBytes += later.runningStatusSavedBytes;
+    if (later.queueDelay.count > 0) {
+        wireBytesPerSecond = later.wireBytesPerSecond;
+        burstSendTime = later.burstSendTime;
+        queueDelay = later.queueDelay;
+    }
+}
+
+QString MidiOutputStats::report() const
+{
+    QStringList lines;
+    lines << QString("MIDI output: sent=%1 saved=%2 (dropped=%3 coalesced=%4) max queue depth=%5")
+             .arg(sent).arg(saved()).arg(dropped).arg(coalesced).arg(maxQueueDepth);
+    lines << QString("MIDI wire: %1 bytes (%2 saved by running status), %3 bytes/s average")
+             .arg(wireBytes).arg(runningStatusSavedBytes).arg(QString::number(wireBytesPerSecond, 'f', 0));
+    lines << "MIDI output timing (us):";
+    lines << formatLatency("queue delay", queueDelay);
+    lines << formatLatency("burst send", burstSendTime);
+    return lines.join('\n');
+}
+
+MidiOutputWorker::MidiOutputWorker(Sink sink, PipelineLatency *latency)
+    : m_sink(std::move(sink))
+    , m_latency(latency)
+    , m_running(false)
+    , m_policy(Block)
+    , m_backlogged(false)
+    , m_controlWindowNs(0)
+    , m_wireBaudRate(0)
+    , m_wireRunningStatus(false)
+    , m_catchingUp(false)
+    , m_heldCount(0)
+    , m_appliedBaudRate(0)
+    , m_appliedRunningStatus(false)
+    , m_enqueued(0)
+    , m_enqueuedAtReset(0)
+    , m_dequeued(0)
+    , m_retired(0)
+    , m_sent(0)
+    , m_dropped(0)
+    , m_coalesced(0)
+    , m_maxQueueDepth(0)
+    , m_wireBytes(0)
+    , m_runningStatusSavedBytes(0)
+    , m_firstWireNs(0)
+    , m_wireEndNs(0)
+{
+    for (HeldControl &control : m_heldControls) {
+        control.held = false;
+    }
+}
+
+MidiOutputWorker::~MidiOutputWorker()
+{
+    stop();
+}
+
+void MidiOutputWorker::start()
+{
+    if (m_running.load(std::memory_order_acquire)) {
+        return;
+    }
+
+    // Anything a producer slipped in after the last stop() belongs to the previous session
+    Entry stale;
+    while (m_queue.tryPop(stale)) {
+        m_dequeued.fetch_add(1, std::memory_order_relaxed);
+        m_retired.fetch_add(1, std::memory_order_relaxed);
+    }
+    while (m_pendingMessages.tryAcquire()) {
+    }
+    m_backlogged.store(false, std::memory_order_relaxed);
+    m_catchingUp = false;
+    m_noteState.clear();
+
+    m_running.store(true, std::memory_order_release);
+    m_thread.reset(QThread::create([this] { run(); }));
+    m_thread->setObjectName("MidiOutputWorker");
+    m_thread->start(QThread::TimeCriticalPriority);
+}
+
+void MidiOutputWorker::stop()
+{
+    if (!m_running.exchange(false)) {
+        return;
+    }
+
+    m_pendingMessages.release();
+    m_thread->wait();
+    m_thread.reset();
+}
+
+bool MidiOutputWorker::isRunning() const
+{
+    return m_running.load(std::memory_order_acquire);
+}
+
+bool MidiOutputWorker::waitForIdle(int timeoutMs)
+{
+    const std::int64_t deadlineNs = EngineClock::nowNs() + timeoutMs * NS_PER_MS;
+    while (m_retired.load(std::memory_order_acquire) < m_enqueued.load(std::memory_order_acquire)) {
+        if (!m_running.load(std::memory_order_acquire) || EngineClock::nowNs() >= deadlineNs) {
+            return false;
+        }
+        QThread::msleep(1);
+    }
+    return true;
+}
+
+void MidiOutputWorker::setOverflowPolicy(OverflowPolicy policy)
+{
+    m_policy.store(policy, std::memory_order_relaxed);
+}
+
+MidiOutputWorker::OverflowPolicy MidiOutputWorker::overflowPolicy() const
+{
+    return static_cast<OverflowPolicy>(m_policy.load(std::memory_order_relaxed));
+}
+
+void MidiOutputWorker::setControlCoalesceWindowMs(int windowMs)
+{
+    m_controlWindowNs.store(std::max(0, windowMs) * NS_PER_MS, std::memory_order_relaxed);
+}
+
+int MidiOutputWorker::controlCoalesceWindowMs() const
+{
+    return static_cast<int>(m_controlWindowNs.load(std::memory_order_relaxed) / NS_PER_MS);
+}
+
+void MidiOutputWorker::setWireShaping(int baudRate, bool runningStatus)
+{
+    m_wireBaudRate.store(std::max(0, baudRate), std::memory_order_relaxed);
+    m_wireRunningStatus.store(runningStatus, std::memory_order_relaxed);
+}
+
+int MidiOutputWorker::wireBaudRate() const
+{
+    return m_wireBaudRate.load(std::memory_order_relaxed);
+}
+
+bool MidiOutputWorker::wireRunningStatus() const
+{
+    return m_wireRunningStatus.load(std::memory_order_relaxed);
+}
+
+bool MidiOutputWorker::enqueue(const MidiBytes &message, bool isRepeat, std::int64_t captureNs)
+{
+    return push({message, isRepeat, false, EngineClock::nowNs(), captureNs});
+}
+
+int MidiOutputWorker::releaseAllNotes()
+{
+    const int sounding = m_noteState.heldCount();
+    return push({MidiBytes{}, false, true, EngineClock::nowNs(), 0}) ? sounding : 0;
+}
+
+bool MidiOutputWorker::push(const Entry &entry)
+{
+    if (!m_running.load(std::memory_order_acquire)) {
+        return false;
+    }
+
+    if (!m_queue.tryPush(entry)) {
+        // Tell the worker it is behind so the next bursts apply the overflow policy
+        m_backlogged.store(true, std::memory_order_release);
+
+        if (entry.isRepeat && overflowPolicy() == DropRepeats) {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        while (!m_queue.tryPush(entry)) {
+            if (!m_running.load(std::memory_order_acquire)) {
+                return false;
+            }
+            QThread::yieldCurrentThread();
+        }
+    }
+
+    m_enqueued.fetch_add(1, std::memory_order_relaxed);
+    m_pendingMessages.release();
+    return true;
+}
+
+MidiOutputStats MidiOutputWorker::stats() const
+{
+    MidiOutputStats stats;
+    const std::uint64_t enqueued = m_enqueued.load(std::memory_order_relaxed);
+    const std::uint64_t dequeued = m_dequeued.load(std::memory_order_relaxed);
+    stats.enqueued = enqueued - m_enqueuedAtReset.load(std::memory_order_relaxed);
+    stats.sent = m_sent.load(std::memory_order_relaxed);
+    stats.dropped = m_dropped.load(std::memory_order_relaxed);
+    stats.coalesced = m_coalesced.load(std::memory_order_relaxed);
+    stats.queueDepth = enqueued > dequeued ? static_cast<int>(enqueued - dequeued) : 0;
+    stats.maxQueueDepth = m_maxQueueDepth.load(std::memory_order_relaxed);
+    stats.wireBytes = m_wireBytes.load(std::memory_order_relaxed);
+    stats.runningStatusSavedBytes = m_runningStatusSavedBytes.load(std::memory_order_relaxed);
+    const std::int64_t wireSpanNs = m_wireEndNs.load(std::memory_order_relaxed)
+                                  - m_firstWireNs.load(std::memory_order_relaxed);
+    if (stats.wireBytes > 0 && wireSpanNs > 0) {
+        stats.wireBytesPerSecond = stats.wireBytes * 1e9 / wireSpanNs;
+    }
+    stats.burstSendTime = m_burstSendTime.summary();
+    stats.queueDelay = m_queueDelay.summary();
+    return stats;
+}
+
+void MidiOutputWorker::resetStats()
+{
+    m_enqueuedAtReset.store(m_enqueued.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    m_sent.store(0, std::memory_order_relaxed);
+    m_dropped.store(0, std::memory_order_relaxed);
+    m_coalesced.store(0, std::memory_order_relaxed);
+    m_maxQueueDepth.store(0, std::memory_order_relaxed);
+    m_wireBytes.store(0, std::memory_order_relaxed);
+    m_runningStatusSavedBytes.store(0, std::memory_order_relaxed);
+    m_firstWireNs.store(0, std::memory_order_relaxed);
+    m_burstSendTime.reset();
+    m_queueDelay.reset();
+}
+
+QString MidiOutputWorker::policyName(OverflowPolicy policy)
+{
+    for (const PolicyName &entry : POLICY_NAMES) {
+        if (entry.policy == policy) {
+            return entry.name;
+        }
+    }
+    return POLICY_NAMES[0].name;
+}
+
+bool MidiOutputWorker::policyFromName(const QString &name, OverflowPolicy &policy)
+{
+    for (const PolicyName &entry : POLICY_NAMES) {
+        if (name == QLatin1String(entry.name)) {
+            policy = entry.policy;
+            return true;
+        }
+    }
+    return false;
+}
+
+void MidiOutputWorker::run()
+{
+    while (m_running.load(std::memory_order_acquire)) {
+        // A timeout still drains once so held CCs go out when their window ends
+        m_pendingMessages.tryAcquire(1, waitTimeoutMs());
+
+        while (drainBurst() > 0) {
+        }
+    }
+
+    // Deliver whatever was queued before stop(), then silence every note it left sounding.
+    // A producer that slips in later is discarded by the next start(), so nothing sent
+    // after this point can turn a note on.
+    while (drainBurst() > 0) {
+    }
+    const int outCount = releaseHeldControls(0, -1, std::numeric_limits<std::int64_t>::max());
+    sendOutput(releaseSoundingNotes(outCount, EngineClock::nowNs()));
+}
+
+int MidiOutputWorker::drainBurst()
+{
+    // Stay in overflow mode until the backlog that triggered it has been fully drained
+    if (m_backlogged.exchange(false, std::memory_order_acq_rel)) {
+        m_catchingUp = true;
+    }
+    // Producers count after publishing, so this can briefly read low (even negative)
+    const std::int64_t depth = static_cast<std::int64_t>(m_enqueued.load(std::memory_order_relaxed)
+                                                       - m_dequeued.load(std::memory_order_relaxed));
+
+    int count = 0;
+    while (count < BURST_CAPACITY && m_queue.tryPop(m_burst[count])) {
+        ++count;
+    }
+
+    int kept = 0;
+    if (count > 0) {
+        m_dequeued.fetch_add(count, std::memory_order_relaxed);
+        if (depth > m_maxQueueDepth.load(std::memory_order_relaxed)) {
+            m_maxQueueDepth.store(static_cast<int>(depth), std::memory_order_relaxed);
+        }
+
+        // Each message released the semaphore once; consume the wakeups this burst covered
+        for (int i = 1; i < count; ++i) {
+            m_pendingMessages.tryAcquire();
+        }
+
+        kept = m_catchingUp ? applyOverflowPolicy(count) : count;
+        if (count < BURST_CAPACITY) {
+            m_catchingUp = false;
+        }
+    }
+
+    const std::int64_t windowNs = m_controlWindowNs.load(std::memory_order_relaxed);
+    const std::int64_t nowNs = EngineClock::nowNs();
+    int outCount = 0;
+
+    for (int i = 0; i < kept; ++i) {
+        const Entry &entry = m_burst[i];
+        if (entry.releaseNotes) {
+            outCount = releaseSoundingNotes(outCount, entry.enqueuedNs);
+            m_retired.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        if (windowNs > 0 && isControlChange(entry.message)) {
+            holdControl(entry, windowNs);
+            continue;
+        }
+        if (m_heldCount > 0) {
+            outCount = releaseHeldControls(outCount, entry.message[0] & 0x0F,
+                                           std::numeric_limits<std::int64_t>::min());
+        }
+        outCount = appendOutput(outCount, {entry.message, entry.enqueuedNs, entry.captureNs});
+    }
+
+    if (m_heldCount > 0) {
+        // A window turned off while CCs were held releases them straight away
+        const std::int64_t dueNs = windowNs > 0 ? nowNs : std::numeric_limits<std::int64_t>::max();
+        outCount = releaseHeldControls(outCount, -1, dueNs);
+    }
+
+    sendOutput(outCount);
+    return count;
+}
+
+int MidiOutputWorker::applyOverflowPolicy(int count)
+{
+    const OverflowPolicy policy = overflowPolicy();
+    if (policy == Block) {
+        return count;
+    }
+
+    // Walk backwards so the newest controller value is the one that survives
+    std::array<bool, BURST_CAPACITY> keep;
+    std::bitset<CONTROL_SLOT_COUNT> seenControllers;
+
+    for (int i = count - 1; i >= 0; --i) {
+        const Entry &entry = m_burst[i];
+        keep[i] = true;
+
+        if (policy == DropRepeats) {
+            keep[i] = !entry.isRepeat;
+        } else if (isControlChange(entry.message)) {
+            const int slot = controlSlot(entry.message);
+            keep[i] = !seenControllers.test(slot);
+            seenControllers.set(slot);
+        }
+    }
+
+    int kept = 0;
+    for (int i = 0; i < count; ++i) {
+        if (keep[i]) {
+            m_burst[kept++] = m_burst[i];
+        }
+    }
+
+    const int removed = count - kept;
+    m_retired.fetch_add(removed, std::memory_order_relaxed);
+    if (policy == DropRepeats) {
+        m_dropped.fetch_add(removed, std::memory_order_relaxed);
+    } else {
+        m_coalesced.fetch_add(removed, std::memory_order_relaxed);
+    }
+    return kept;
+}
+
+void MidiOutputWorker::holdControl(const Entry &entry, std::int64_t windowNs)
+{
+    const int slot = controlSlot(entry.message);
+    HeldControl &control = m_heldControls[slot];
+
+    if (control.held) {
+        control.message = entry.message;
+        control.enqueuedNs = entry.enqueuedNs;
+        control.captureNs = entry.captureNs;
+        m_coalesced.fetch_add(1, std::memory_order_relaxed);
+        m_retired.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    control.message = entry.message;
+    control.enqueuedNs = entry.enqueuedNs;
+    control.captureNs = entry.captureNs;
+    control.deadlineNs = entry.enqueuedNs + windowNs;
+    control.held = true;
+    m_heldOrder[m_heldCount++] = static_cast<std::uint16_t>(slot);
+}
+
+int MidiOutputWorker::releaseHeldControls(int outCount, int channel, std::int64_t dueNs)
+{
+    int remaining = 0;
+    for (int i = 0; i < m_heldCount; ++i) {
+        const std::uint16_t slot = m_heldOrder[i];
+        HeldControl &control = m_heldControls[slot];
+
+        if (slot / 128 == channel || control.deadlineNs <= dueNs) {
+            control.held = false;
+            outCount = appendOutput(outCount, {control.message, control.enqueuedNs, control.captureNs});
+        } else {
+            m_heldOrder[remaining++] = slot;
+        }
+    }
+    m_heldCount = remaining;
+    return outCount;
+}
+
+int MidiOutputWorker::appendOutput(int outCount, const Output &output)
+{
+    if (outCount == static_cast<int>(m_output.size())) {
+        sendOutput(outCount);
+        outCount = 0;
+    }
+
+    // Tracked in send order, so a release covers exactly the notes that went out before it
+    m_noteState.track(output.message);
+    m_output[outCount] = output;
+    return outCount + 1;
+}
+
+int MidiOutputWorker::releaseSoundingNotes(int outCount, std::int64_t enqueuedNs)
+{
+    m_noteState.releaseAll([&](int channel, int note) {
+        // Counted as queued and taken before it can be sent, so waitForIdle() waits for it
+        m_enqueued.fetch_add(1, std::memory_order_relaxed);
+        m_dequeued.fetch_add(1, std::memory_order_relaxed);
+        const MidiBytes noteOff{static_cast<std::uint8_t>(0x80 | channel), static_cast<std::uint8_t>(note), 0};
+        outCount = appendOutput(outCount, {noteOff, enqueuedNs, 0});
+    });
+    return outCount;
+}
+
+int MidiOutputWorker::waitTimeoutMs() const
+{
+    if (m_heldCount == 0) {
+        return IDLE_WAIT_TIMEOUT_MS;
+    }
+
+    std::int64_t earliestNs = std::numeric_limits<std::int64_t>::max();
+    for (int i = 0; i < m_heldCount; ++i) {
+        earliestNs = std::min(earliestNs, m_heldControls[m_heldOrder[i]].deadlineNs);
+    }
+
+    const std::int64_t remainingNs = earliestNs - EngineClock::nowNs();
+    if (remainingNs <= 0) {
+        return 0;
+    }
+    return static_cast<int>(std::min<std::int64_t>((remainingNs + NS_PER_MS - 1) / NS_PER_MS,
+                                                   IDLE_WAIT_TIMEOUT_MS));
+}
+
+void MidiOutputWorker::sendOutput(int outCount)
+{
+    if (outCount == 0) {
+        return;
+    }
+
+    applyWireShaping();
+
+    int chunkCount = 0;
+    const std::int64_t outputStartNs = EngineClock::nowNs();
+    std::int64_t chunkStartNs = outputStartNs;
+    std::uint64_t wireBytes = 0;
+    std::uint64_t savedBytes = 0;
+
+    for (int i = 0; i < outCount; ++i) {
+        std::int64_t nowNs = EngineClock::nowNs();
+
+        // Once stopping, flush without pacing so closing a port never stalls on the wire model
+        if (m_shaper.isPacing() && m_running.load(std::memory_order_relaxed)) {
+            const std::int64_t readyNs = m_shaper.readyAtNs(nowNs);
+            if (readyNs > nowNs) {
+                chunkCount = flushChunk(chunkCount, chunkStartNs);
+                waitUntil(readyNs);
+                nowNs = EngineClock::nowNs();
+                chunkStartNs = nowNs;
+            }
+        }
+
+        const int bytes = m_shaper.commit(m_output[i].message, nowNs);
+        wireBytes += bytes;
+        if (bytes == 2) {
+            ++savedBytes; // Status byte covered by running status
+        }
+        m_queueDelay.record(nowNs - m_output[i].enqueuedNs);
+        m_sinkMessages[chunkCount] = m_output[i].message;
+        m_sinkCaptureNs[chunkCount++] = m_output[i].captureNs;
+    }
+
+    flushChunk(chunkCount, chunkStartNs);
+
+    std::int64_t expected = 0;
+    m_firstWireNs.compare_exchange_strong(expected, outputStartNs, std::memory_order_relaxed);
+    m_wireEndNs.store(m_shaper.wireFreeNs(), std::memory_order_relaxed);
+    m_wireBytes.fetch_add(wireBytes, std::memory_order_relaxed);
+    m_runningStatusSavedBytes.fetch_add(savedBytes, std::memory_order_relaxed);
+}
+
+int MidiOutputWorker::flushChunk(int chunkCount, std::int64_t chunkStartNs)
+{
+    if (chunkCount > 0) {
+        m_sink(m_sinkMessages.data(), chunkCount);
+        const std::int64_t sentNs = EngineClock::nowNs();
+        m_burstSendTime.record(sentNs - chunkStartNs);
+        if (m_latency) {
+            for (int i = 0; i < chunkCount; ++i) {
+                if (m_sinkCaptureNs[i] != 0) {
+                    m_latency->record(PipelineLatency::CaptureToSend, sentNs - m_sinkCaptureNs[i]);
+                }
+            }
+        }
+        m_sent.fetch_add(chunkCount, std::memory_order_relaxed);
+        m_retired.fetch_add(chunkCount, std::memory_order_release);
+    }
+    return 0;
+}
+
+void MidiOutputWorker::applyWireShaping()
+{
+    const int baudRate = m_wireBaudRate.load(std::memory_order_relaxed);
+    const bool runningStatus = m_wireRunningStatus.load(std::memory_order_relaxed);
+    if (baudRate != m_appliedBaudRate || runningStatus != m_appliedRunningStatus) {
+        m_shaper.configure(baudRate, runningStatus);
+        m_appliedBaudRate = baudRate;
+        m_appliedRunningStatus = runningStatus;
+    }
+}
@@ -0,0 +1,211 @@
+#pragma once
+
+#include <QSemaphore>
+#include <QString>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include "LatencyStats.h"
+#include "MidiNoteState.h"
+#include "MidiWireShaper.h"
+#include "MpscQueue.h"
+
+class QThread;
+
+struct MidiOutputStats {
+    std::uint64_t enqueued;
+    std::uint64_t sent;
+    std::uint64_t dropped;
+    std::uint64_t coalesced;
+    int queueDepth;
+    int maxQueueDepth;
+    std::uint64_t wireBytes;
+    std::uint64_t runningStatusSavedBytes;
+    double wireBytesPerSecond;
+    LatencySummary burstSendTime;
+    LatencySummary queueDelay;
+
+    MidiOutputStats()
+        : enqueued(0), sent(0), dropped(0), coalesced(0), queueDepth(0), maxQueueDepth(0)
+        , wireBytes(0), runningStatusSavedBytes(0), wireBytesPerSecond(0.0) {}
+
+    // Messages that never had to reach the port
+    std::uint64_t saved() const { return dropped + coalesced; }
+
+    // Adds a later session's counters; latency figures are taken from the later session
+    void merge(const MidiOutputStats &later);
+
+    QString report() const;
+};
+
+// Owns the thread that talks to one MIDI output. Producers enqueue into a bounded
+// lock-free queue and return immediately; the worker drains it in bursts and hands
+// each burst to the sink, so a slow driver never stalls key processing.
+//
+// With a control-change window set, a CC is held back for up to that long and later
+// values for the same channel/controller replace it, so a fast CC stream reaches the
+// port at most once per window. Any other message flushes the held CCs of its channel
+// first, so per-channel order is unchanged.
+//
+// With wire shaping set, sends are paced to the modelled bandwidth of a serial MIDI link;
+// the resulting backlog is what the overflow policy then thins out.
+//
+// The worker tracks the notes it has turned on as it sends them, so it alone knows what
+// is sounding. A release queued by releaseAllNotes(), and the end of stop(), send a
+// note-off for each, after every message queued before them.
+class MidiOutputWorker
+{
+public:
+    // What happens when producers outrun the port and the queue fills up.
+    // Non-droppable messages always wait for space, so nothing but repeats or
+    // superseded controller values is ever lost.
+    enum OverflowPolicy {
+        Block,          // Producers wait; every message is delivered
+        DropRepeats,    // A repeat that finds the queue full is discarded, and queued repeats are dropped while a backlog drains
+        CoalesceCC      // Queued CCs for the same channel/controller collapse to the latest value
+    };
+
+    // Called on the worker thread with one burst of messages in send order
+    using Sink = std::function<void(const MidiBytes *messages, int count)>;
+
+    static constexpr std::size_t QUEUE_CAPACITY = 1024;
+    static constexpr int BURST_CAPACITY = 256;
+    static constexpr int CONTROL_SLOT_COUNT = 16 * 128;
+
+    // With a latency given, messages that carry a capture time record CaptureToSend
+    // once the sink has returned from sending them
+    explicit MidiOutputWorker(Sink sink, PipelineLatency *latency = nullptr);
+    ~MidiOutputWorker();
+
+    void start();
+
+    // Delivers everything still queued, then a note-off for every note still sounding
+    void stop();
+
+    bool isRunning() const;
+
+    // Waits until every enqueued message was sent or discarded; false on timeout
+    bool waitForIdle(int timeoutMs);
+
+    void setOverflowPolicy(OverflowPolicy policy);
+
+    OverflowPolicy overflowPolicy() const;
+
+    // 0 disables the control-change coalescing stage
+    void setControlCoalesceWindowMs(int windowMs);
+
+    int controlCoalesceWindowMs() const;
+
+    // Paces output to a serial link of the given baud rate (0 disables pacing).
+    // Running status makes repeated status bytes free in the bandwidth model.
+    void setWireShaping(int baudRate, bool runningStatus);
+
+    int wireBaudRate() const;
+
+    bool wireRunningStatus() const;
+
+    // captureNs is when the key event behind the message was captured, 0 if none
+    bool enqueue(const MidiBytes &message, bool isRepeat = false, std::int64_t captureNs = 0);
+
+    // Queues a note-off for every note sounding once the messages ahead of it are sent.
+    // Never dropped; returns how many notes had been sent on and not off when called.
+    int releaseAllNotes();
+
+    MidiOutputStats stats() const;
+
+    void resetStats();
+
+    static QString policyName(OverflowPolicy policy);
+
+    static bool policyFromName(const QString &name, OverflowPolicy &policy);
+
+private:
+    struct Entry {
+        MidiBytes message;
+        bool isRepeat;
+        bool releaseNotes;      // Not a message: send the note-offs of all sounding notes
+        std::int64_t enqueuedNs;
+        std::int64_t captureNs;
+    };
+
+    struct Output {
+        MidiBytes message;
+        std::int64_t enqueuedNs;
+        std::int64_t captureNs;
+    };
+
+    struct HeldControl {
+        MidiBytes message;
+        std::int64_t enqueuedNs;
+        std::int64_t captureNs;
+        std::int64_t deadlineNs;
+        bool held;
+    };
+
+    bool push(const Entry &entry);
+
+    void run();
+
+    int drainBurst();
+
+    int applyOverflowPolicy(int count);
+
+    void holdControl(const Entry &entry, std::int64_t windowNs);
+
+    // Moves held CCs of the given channel (-1 for none) or due by dueNs into the output
+    int releaseHeldControls(int outCount, int channel, std::int64_t dueNs);
+
+    // Both append to the output and return the new count, sending it first if it is full
+    int appendOutput(int outCount, const Output &output);
+    int releaseSoundingNotes(int outCount, std::int64_t enqueuedNs);
+
+    int waitTimeoutMs() const;
+
+    void sendOutput(int outCount);
+
+    int flushChunk(int chunkCount, std::int64_t chunkStartNs);
+
+    void applyWireShaping();
+
+    Sink m_sink;
+    PipelineLatency *m_latency;
+    MpscQueue<Entry, QUEUE_CAPACITY> m_queue;
+    QSemaphore m_pendingMessages;
+    std::unique_ptr<QThread> m_thread;
+    std::atomic<bool> m_running;
+    std::atomic<int> m_policy;
+    std::atomic<bool> m_backlogged;
+    std::atomic<std::int64_t> m_controlWindowNs;
+    std::atomic<int> m_wireBaudRate;
+    std::atomic<bool> m_wireRunningStatus;
+
+    bool m_catchingUp;
+    std::array<Entry, BURST_CAPACITY> m_burst;
+    std::array<Output, BURST_CAPACITY + CONTROL_SLOT_COUNT> m_output;
+    std::array<MidiBytes, BURST_CAPACITY + CONTROL_SLOT_COUNT> m_sinkMessages;
+    std::array<std::int64_t, BURST_CAPACITY + CONTROL_SLOT_COUNT> m_sinkCaptureNs;
+    std::array<HeldControl, CONTROL_SLOT_COUNT> m_heldControls;
+    std::array<std::uint16_t, CONTROL_SLOT_COUNT> m_heldOrder;
+    int m_heldCount;
+    MidiNoteState m_noteState;
+    MidiWireShaper m_shaper;
+    int m_appliedBaudRate;
+    bool m_appliedRunningStatus;
+
+    std::atomic<std::uint64_t> m_enqueued;
+    std::atomic<std::uint64_t> m_enqueuedAtReset;
+    std::atomic<std::uint64_t> m_dequeued;
+    std::atomic<std::uint64_t> m_retired;
+    std::atomic<std::uint64_t> m_sent;
+    std::atomic<std::uint64_t> m_dropped;
+    std::atomic<std::uint64_t> m_coalesced;
+    std::atomic<int> m_maxQueueDepth;
+    std::atomic<std::uint64_t> m_wireBytes;
+    std::atomic<std::uint64_t> m_runningStatusSavedBytes;
+    std::atomic<std::int64_t> m_firstWireNs;
+    std::atomic<std::int64_t> m_wireEndNs;
+    LatencyHistogram m_burstSendTime;
+    LatencyHistogram m_queueDelay;
+};
@@ -0,0 +1,120 @@
+#include "MidiPortWatcher.h"
+#include <QDebug>
+#include <QMutexLocker>
+#include <QThread>
+#include <rtmidi/RtMidi.h>
+
+MidiPortWatcher::MidiPortWatcher(QObject *parent)
+    : QObject(parent)
+    , m_running(false)
+    , m_pollIntervalMs(DEFAULT_POLL_INTERVAL_MS)
+    , m_version(0)
+{
+}
+
+MidiPortWatcher::~MidiPortWatcher()
+{
+    stop();
+}
+
+bool MidiPortWatcher::start(int pollIntervalMs)
+{
+    if (m_running.load(std::memory_order_acquire)) {
+        return true;
+    }
+
+    if (!m_enumerator) {
+        try {
+            m_enumerator = std::make_unique<RtMidiOut>(RtMidi::UNSPECIFIED, "KtoMIDI Port Watcher");
+        } catch (const RtMidiError &error) {
+            const QString errorMsg = QString("Failed to start MIDI port watcher: %1")
+                                   .arg(QString::fromStdString(error.getMessage()));
+            qWarning() << errorMsg;
+            emit errorOccurred(errorMsg);
+            return false;
+        }
+    }
+
+    m_pollIntervalMs = pollIntervalMs;
+    scan();
+
+    while (m_wake.tryAcquire()) {
+    }
+    m_running.store(true, std::memory_order_release);
+    m_thread.reset(QThread::create([this] { run(); }));
+    m_thread->setObjectName("MidiPortWatcher");
+    m_thread->start(QThread::LowPriority);
+    return true;
+}
+
+void MidiPortWatcher::stop()
+{
+    if (!m_running.exchange(false)) {
+        return;
+    }
+
+    m_wake.release();
+    m_thread->wait();
+    m_thread.reset();
+}
+
+bool MidiPortWatcher::isRunning() const
+{
+    return m_running.load(std::memory_order_acquire);
+}
+
+void MidiPortWatcher::rescan()
+{
+    m_wake.release();
+}
+
+QStringList MidiPortWatcher::ports() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_ports;
+}
+
+quint64 MidiPortWatcher::version() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_version;
+}
+
+void MidiPortWatcher::run()
+{
+    while (m_running.load(std::memory_order_acquire)) {
+        m_wake.tryAcquire(1, m_pollIntervalMs);
+        // Collapse rescan requests that piled up while the last scan ran
+        while (m_wake.tryAcquire()) {
+        }
+
+        if (m_running.load(std::memory_order_acquire)) {
+            scan();
+        }
+    }
+}
+
+void MidiPortWatcher::scan()
+{
+    QStringList ports;
+    try {
+        const unsigned int portCount = m_enumerator->getPortCount();
+        for (unsigned int i = 0; i < portCount; ++i) {
+            ports.append(QString::fromStdString(m_enumerator->getPortName(i)));
+        }
+    } catch (const RtMidiError &error) {
+        // A port vanishing mid-scan is normal during hot-plug; the next scan settles it
+        qWarning() << "Error enumerating MIDI ports:" << QString::fromStdString(error.getMessage());
+        return;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    if (ports == m_ports && m_version > 0) {
+        return;
+    }
+    m_ports = ports;
+    const quint64 version = ++m_version;
+    locker.unlock();
+
+    emit portsChanged(ports, version);
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <QMutex>
+#include <QObject>
+#include <QSemaphore>
+#include <QStringList>
+#include <atomic>
+#include <memory>
+
+class QThread;
+class RtMidiOut;
+
+// Enumerates MIDI output ports on a background thread and keeps a cached, versioned
+// list, so neither the GUI nor openPort() waits on driver queries. The watcher uses
+// its own RtMidi client and emits portsChanged() only when ports appear or disappear.
+class MidiPortWatcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    static constexpr int DEFAULT_POLL_INTERVAL_MS = 1000;
+
+    explicit MidiPortWatcher(QObject *parent = nullptr);
+    ~MidiPortWatcher() override;
+
+    // Scans once on the calling thread so the cache is valid on return, then keeps watching
+    bool start(int pollIntervalMs = DEFAULT_POLL_INTERVAL_MS);
+
+    void stop();
+
+    bool isRunning() const;
+
+    // Schedules an immediate scan without waiting for it
+    void rescan();
+
+    QStringList ports() const;
+
+    // Increments every time the port list changes
+    quint64 version() const;
+
+signals:
+    void portsChanged(const QStringList &ports, quint64 version);
+    void errorOccurred(const QString &error);
+
+private:
+    void run();
+
+    void scan();
+
+    std::unique_ptr<RtMidiOut> m_enumerator;
+    std::unique_ptr<QThread> m_thread;
+    QSemaphore m_wake;
+    std::atomic<bool> m_running;
+    int m_pollIntervalMs;
+
+    mutable QMutex m_mutex;
+    QStringList m_ports;
+    quint64 m_version;
+};
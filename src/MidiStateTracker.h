@@ -0,0 +1,93 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+#include "MidiWireShaper.h"
+
+// Mirrors the state a receiver has built up from the messages sent to it: which notes
+// are held (with their velocity) and the last value of every controller. After a port
+// comes back, replaying this lets a synth recover without waiting for new key presses.
+class MidiStateTracker
+{
+public:
+    static constexpr int CHANNEL_COUNT = 16;
+    static constexpr int VALUE_COUNT = 128;
+
+    MidiStateTracker() { reset(); }
+
+    void reset()
+    {
+        for (auto &channel : m_noteVelocities) {
+            channel.fill(0);
+        }
+        for (auto &channel : m_controllerValues) {
+            channel.fill(NO_VALUE);
+        }
+    }
+
+    void track(const MidiBytes &message)
+    {
+        const int channel = message[0] & 0x0F;
+        const int data1 = message[1] & 0x7F;
+        const int data2 = message[2] & 0x7F;
+
+        switch (message[0] & 0xF0) {
+            case NOTE_ON_STATUS:
+                m_noteVelocities[channel][data1] = static_cast<std::uint8_t>(data2);
+                break;
+            case NOTE_OFF_STATUS:
+                m_noteVelocities[channel][data1] = 0;
+                break;
+            case CONTROL_CHANGE_STATUS:
+                if (data1 == ALL_SOUND_OFF || data1 == ALL_NOTES_OFF) {
+                    m_noteVelocities[channel].fill(0);
+                } else {
+                    m_controllerValues[channel][data1] = static_cast<std::int8_t>(data2);
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    // Controllers first so e.g. sustain and volume are in place before notes sound again
+    std::vector<MidiBytes> replayMessages() const
+    {
+        std::vector<MidiBytes> messages;
+
+        for (int channel = 0; channel < CHANNEL_COUNT; ++channel) {
+            for (int controller = 0; controller < VALUE_COUNT; ++controller) {
+                const std::int8_t value = m_controllerValues[channel][controller];
+                if (value != NO_VALUE) {
+                    messages.push_back({static_cast<std::uint8_t>(CONTROL_CHANGE_STATUS | channel),
+                                        static_cast<std::uint8_t>(controller),
+                                        static_cast<std::uint8_t>(value)});
+                }
+            }
+        }
+
+        for (int channel = 0; channel < CHANNEL_COUNT; ++channel) {
+            for (int note = 0; note < VALUE_COUNT; ++note) {
+                const std::uint8_t velocity = m_noteVelocities[channel][note];
+                if (velocity > 0) {
+                    messages.push_back({static_cast<std::uint8_t>(NOTE_ON_STATUS | channel),
+                                        static_cast<std::uint8_t>(note), velocity});
+                }
+            }
+        }
+
+        return messages;
+    }
+
+private:
+    static constexpr std::uint8_t NOTE_OFF_STATUS = 0x80;
+    static constexpr std::uint8_t NOTE_ON_STATUS = 0x90;
+    static constexpr std::uint8_t CONTROL_CHANGE_STATUS = 0xB0;
+    static constexpr int ALL_SOUND_OFF = 120;
+    static constexpr int ALL_NOTES_OFF = 123;
+    static constexpr std::int8_t NO_VALUE = -1;
+
+    std::array<std::array<std::uint8_t, VALUE_COUNT>, CHANNEL_COUNT> m_noteVelocities;
+    std::array<std::array<std::int8_t, VALUE_COUNT>, CHANNEL_COUNT> m_controllerValues;
+};
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+using MidiBytes = std::array<std::uint8_t, 3>;
+
+// Models a serial MIDI link so output can be paced to what the wire actually carries
+// instead of overrunning a USB-to-DIN interface's small transmit buffer. With running
+// status the link omits a status byte that repeats the previous one, which is how
+// 5-pin DIN hardware transmits dense note and controller streams.
+class MidiWireShaper
+{
+public:
+    static constexpr int DIN_BAUD_RATE = 31250;
+    static constexpr int BITS_PER_BYTE = 10; // Start bit, 8 data bits, stop bit
+    // Bytes the interface may still be transmitting when the next message is handed over
+    static constexpr int INTERFACE_BUFFER_BYTES = 6;
+
+    MidiWireShaper()
+        : m_nsPerByte(0)
+        , m_runningStatus(false)
+        , m_lastStatus(0)
+        , m_wireFreeNs(0)
+    {
+    }
+
+    // A baud rate of 0 disables pacing; byte accounting still applies
+    void configure(int baudRate, bool runningStatus)
+    {
+        m_nsPerByte = baudRate > 0 ? 1000000000LL * BITS_PER_BYTE / baudRate : 0;
+        m_runningStatus = runningStatus;
+        m_lastStatus = 0;
+        m_wireFreeNs = 0;
+    }
+
+    bool isPacing() const { return m_nsPerByte > 0; }
+
+    // Earliest time the message can be handed to the port without overrunning the interface
+    std::int64_t readyAtNs(std::int64_t nowNs) const
+    {
+        return std::max(nowNs, m_wireFreeNs - INTERFACE_BUFFER_BYTES * m_nsPerByte);
+    }
+
+    // Accounts for a message handed over at sendNs and returns its size on the wire
+    int commit(const MidiBytes &message, std::int64_t sendNs)
+    {
+        const std::uint8_t status = message[0];
+        int bytes = 3;
+
+        if (status >= 0xF8) {
+            bytes = 1; // Real-time messages neither use nor cancel running status
+        } else if (status >= 0xF0) {
+            m_lastStatus = 0;
+        } else if (m_runningStatus && status == m_lastStatus) {
+            bytes = 2;
+        } else {
+            m_lastStatus = status;
+        }
+
+        m_wireFreeNs = std::max(sendNs, m_wireFreeNs) + bytes * m_nsPerByte;
+        return bytes;
+    }
+
+    std::int64_t wireFreeNs() const { return m_wireFreeNs; }
+
+private:
+    std::int64_t m_nsPerByte;
+    bool m_runningStatus;
+    std::uint8_t m_lastStatus;
+    std::int64_t m_wireFreeNs;
+};
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Bounded multi-producer/single-consumer queue (Vyukov's sequence-per-cell design).
+// Producers claim a cell with one CAS and never wait on each other's payload copy;
+// the consumer needs no atomic read-modify-write at all. Storage is preallocated.
+template <typename T, std::size_t Capacity>
+class MpscQueue
+{
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+                  "MpscQueue capacity must be a power of two");
+
+public:
+    MpscQueue()
+        : m_enqueuePos(0)
+        , m_dequeuePos(0)
+    {
+        for (std::size_t i = 0; i < Capacity; ++i) {
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MpscQueue(const MpscQueue &) = delete;
+    MpscQueue &operator=(const MpscQueue &) = delete;
+
+    bool tryPush(const T &item)
+    {
+        std::size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+        Cell *cell;
+
+        for (;;) {
+            cell = &m_cells[pos & MASK];
+            const std::size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            const std::intptr_t diff = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(pos);
+
+            if (diff == 0) {
+                if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = m_enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->value = item;
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool tryPop(T &item)
+    {
+        Cell &cell = m_cells[m_dequeuePos & MASK];
+        const std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        if (static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(m_dequeuePos + 1) < 0) {
+            return false;
+        }
+
+        item = cell.value;
+        cell.sequence.store(m_dequeuePos + Capacity, std::memory_order_release);
+        ++m_dequeuePos;
+        return true;
+    }
+
+    static constexpr std::size_t capacity() { return Capacity; }
+
+private:
+    static constexpr std::size_t MASK = Capacity - 1;
+
+    struct Cell {
+        std::atomic<std::size_t> sequence;
+        T value;
+    };
+
+    std::array<Cell, Capacity> m_cells;
+    alignas(64) std::atomic<std::size_t> m_enqueuePos;
+    alignas(64) std::size_t m_dequeuePos;
+};
@@ -0,0 +1,110 @@
+#include "PersistenceService.h"
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QThread>
+#include <QTimer>
+
+namespace {
+    constexpr int DEFAULT_QUIET_PERIOD_MS = 500;
+}
+
+PersistenceService::PersistenceService(QObject *parent)
+    : QObject(parent)
+    , m_quietTimer(new QTimer(this))
+    , m_ioThread(new QThread())
+    , m_ioContext(new QObject())
+    , m_dirty(false)
+{
+    m_quietTimer->setSingleShot(true);
+    m_quietTimer->setInterval(DEFAULT_QUIET_PERIOD_MS);
+    connect(m_quietTimer, &QTimer::timeout, this, &PersistenceService::onQuietPeriodElapsed);
+
+    m_ioThread->setObjectName("PersistenceService");
+    m_ioContext->moveToThread(m_ioThread);
+    m_ioThread->start(QThread::LowPriority);
+}
+
+PersistenceService::~PersistenceService()
+{
+    flush();
+
+    m_ioThread->quit();
+    m_ioThread->wait();
+    delete m_ioContext;
+    delete m_ioThread;
+}
+
+void PersistenceService::setSnapshotProvider(SnapshotProvider provider)
+{
+    m_snapshotProvider = std::move(provider);
+}
+
+void PersistenceService::setQuietPeriod(int milliseconds)
+{
+    m_quietTimer->setInterval(milliseconds);
+}
+
+void PersistenceService::scheduleSave()
+{
+    m_dirty = true;
+    m_quietTimer->start();
+}
+
+void PersistenceService::flush()
+{
+    m_quietTimer->stop();
+    if (!m_dirty || !m_snapshotProvider) {
+        return;
+    }
+
+    m_dirty = false;
+    const Snapshot snapshot = m_snapshotProvider();
+    QMetaObject::invokeMethod(m_ioContext, [snapshot]() { writeSnapshot(snapshot); },
+                              Qt::BlockingQueuedConnection);
+}
+
+void PersistenceService::onQuietPeriodElapsed()
+{
+    if (!m_dirty || !m_snapshotProvider) {
+        return;
+    }
+
+    m_dirty = false;
+    const Snapshot snapshot = m_snapshotProvider();
+    QMetaObject::invokeMethod(m_ioContext, [snapshot]() { writeSnapshot(snapshot); },
+                              Qt::QueuedConnection);
+}
+
+void PersistenceService::writeSnapshot(const Snapshot &snapshot)
+{
+    for (auto it = snapshot.constBegin(); it != snapshot.constEnd(); ++it) {
+        writeDocument(it.key(), it.value());
+    }
+}
+
+bool PersistenceService::writeDocument(const QString &filename, const QJsonDocument &document)
+{
+    QDir().mkpath(QFileInfo(filename).absolutePath());
+
+    QSaveFile file(filename);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Failed to open file for writing:" << filename << file.errorString();
+        return false;
+    }
+
+    const QByteArray data = document.toJson();
+    if (file.write(data) != data.size()) {
+        qWarning() << "Failed to write" << filename << file.errorString();
+        file.cancelWriting();
+        return false;
+    }
+
+    if (!file.commit()) {
+        qWarning() << "Failed to commit" << filename << file.errorString();
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <QObject>
+#include <QHash>
+#include <QJsonDocument>
+#include <QString>
+#include <functional>
+
+class QThread;
+class QTimer;
+
+class PersistenceService : public QObject
+{
+    Q_OBJECT
+
+public:
+    using Snapshot = QHash<QString, QJsonDocument>;
+    using SnapshotProvider = std::function<Snapshot()>;
+
+    explicit PersistenceService(QObject *parent = nullptr);
+    ~PersistenceService();
+
+    void setSnapshotProvider(SnapshotProvider provider);
+    
+    void setQuietPeriod(int milliseconds);
+    
+    void scheduleSave();
+    
+    void flush();
+
+    static bool writeDocument(const QString &filename, const QJsonDocument &document);
+
+private slots:
+    void onQuietPeriodElapsed();
+
+private:
+    static void writeSnapshot(const Snapshot &snapshot);
+
+    QTimer *m_quietTimer;
+    QThread *m_ioThread;
+    QObject *m_ioContext;
+    SnapshotProvider m_snapshotProvider;
+    bool m_dirty;
+};
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <thread>
+
+// Holds an immutable value that readers access without locking. publish()
+// swaps in a replacement and frees the old value once no reader still holds
+// a guard, so writers pay for the grace period instead of the hot path.
+template <typename T>
+class RcuCell
+{
+public:
+    class ReadGuard
+    {
+    public:
+        explicit ReadGuard(const RcuCell &cell)
+            : m_cell(cell)
+        {
+            m_cell.m_readers.fetch_add(1, std::memory_order_seq_cst);
+            m_value = m_cell.m_current.load(std::memory_order_seq_cst);
+        }
+
+        ~ReadGuard()
+        {
+            m_cell.m_readers.fetch_sub(1, std::memory_order_release);
+        }
+
+        ReadGuard(const ReadGuard &) = delete;
+        ReadGuard &operator=(const ReadGuard &) = delete;
+
+        const T *get() const { return m_value; }
+        const T *operator->() const { return m_value; }
+        const T &operator*() const { return *m_value; }
+
+    private:
+        const RcuCell &m_cell;
+        const T *m_value;
+    };
+
+    explicit RcuCell(std::unique_ptr<T> initial = std::make_unique<T>())
+        : m_current(initial.release())
+        , m_readers(0)
+    {
+    }
+
+    ~RcuCell()
+    {
+        delete m_current.load(std::memory_order_acquire);
+    }
+
+    RcuCell(const RcuCell &) = delete;
+    RcuCell &operator=(const RcuCell &) = delete;
+
+    ReadGuard read() const
+    {
+        return ReadGuard(*this);
+    }
+
+    void publish(std::unique_ptr<T> next)
+    {
+        const T *previous = m_current.exchange(next.release(), std::memory_order_seq_cst);
+        while (m_readers.load(std::memory_order_seq_cst) != 0) {
+            std::this_thread::yield();
+        }
+        delete previous;
+    }
+
+private:
+    std::atomic<const T *> m_current;
+    mutable std::atomic<int> m_readers;
+};
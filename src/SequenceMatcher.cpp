@@ -0,0 +1,119 @@
+#include "SequenceMatcher.h"
+
+SequenceMatcher::SequenceMatcher()
+    : m_tableGeneration(0)
+{
+    reset();
+}
+
+void SequenceMatcher::reset()
+{
+    restart();
+    m_steps.fill(0);
+    m_pendingMessages.fill(MidiBytes{});
+    m_pendingCount = 0;
+    m_outputCount = 0;
+}
+
+void SequenceMatcher::restart()
+{
+    m_state = 0;
+    m_depth = 0;
+    m_deadlineNs = NO_DEADLINE;
+}
+
+void SequenceMatcher::process(const CompiledMappingTable &table, int vkCode, bool isKeyDown, bool isRepeat,
+                              std::int64_t timestampNs)
+{
+    m_outputCount = 0;
+
+    // State indices mean nothing in a recompiled trie, so a mapping change starts over
+    if (table.generation != m_tableGeneration) {
+        m_tableGeneration = table.generation;
+        restart();
+        m_pendingCount = 0;
+    }
+
+    if (!isKeyDown || isRepeat || table.sequenceNodes.empty()
+        || vkCode <= 0 || vkCode >= CompiledMappingTable::SLOT_COUNT) {
+        return;
+    }
+
+    if (m_state != 0 && timestampNs >= m_deadlineNs) {
+        firePending();
+        restart();
+    }
+
+    int next = table.sequenceTransitions[static_cast<std::size_t>(m_state) * CompiledMappingTable::SLOT_COUNT + vkCode];
+    if (next == 0 && m_state != 0) {
+        // A key off the current path may still start a sequence of its own
+        firePending();
+        restart();
+        next = table.sequenceTransitions[vkCode];
+    }
+    if (next == 0) {
+        return;
+    }
+
+    const CompiledSequenceNode &node = table.sequenceNodes[next];
+    m_steps[node.depth - 1] = static_cast<std::uint8_t>(vkCode);
+    m_pendingCount = 0;
+
+    const MidiBytes *burst = table.sequenceMessages.data() + node.messageStart;
+    if (node.flags & CompiledSequenceNode::Accepting) {
+        if (!(node.flags & CompiledSequenceNode::HasChildren)) {
+            for (int i = 0; i < node.messageCount; ++i) {
+                emitMessage(burst[i]);
+            }
+            restart();
+            return;
+        }
+        for (int i = 0; i < node.messageCount; ++i) {
+            m_pendingMessages[i] = burst[i];
+        }
+        m_pendingCount = node.messageCount;
+    }
+
+    m_state = next;
+    m_depth = node.depth;
+    m_deadlineNs = timestampNs + node.timeoutNs;
+}
+
+void SequenceMatcher::expire(std::int64_t nowNs)
+{
+    m_outputCount = 0;
+
+    if (m_state != 0 && nowNs >= m_deadlineNs) {
+        firePending();
+        restart();
+    }
+}
+
+std::int64_t SequenceMatcher::nextDeadlineNs() const
+{
+    return m_deadlineNs;
+}
+
+std::uint64_t SequenceMatcher::progress() const
+{
+    std::uint64_t packed = static_cast<std::uint64_t>(m_depth);
+    for (int step = 0; step < m_depth; ++step) {
+        packed |= static_cast<std::uint64_t>(m_steps[step]) << (8 * (step + 1));
+    }
+    return packed;
+}
+
+void SequenceMatcher::firePending()
+{
+    for (int i = 0; i < m_pendingCount; ++i) {
+        emitMessage(m_pendingMessages[i]);
+    }
+    m_pendingCount = 0;
+}
+
+void SequenceMatcher::emitMessage(const MidiBytes &message)
+{
+    if (m_outputCount < static_cast<int>(m_output.size())) {
+        m_output[m_outputCount++] = message;
+    }
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include "CompiledMappingTable.h"
+
+// Sequence (leader key) detection for the dispatcher thread. Walks the compiled trie
+// one key-down at a time: each press is a single table lookup, and a step that takes
+// longer than its node's timeout starts over from the root. A sequence that is also
+// the start of a longer one fires when the longer one can no longer follow.
+// Single-threaded and allocation-free.
+class SequenceMatcher
+{
+public:
+    static constexpr std::int64_t NO_DEADLINE = INT64_MAX;
+
+    SequenceMatcher();
+
+    // The messages to send are available from messages() until the next call
+    void process(const CompiledMappingTable &table, int vkCode, bool isKeyDown, bool isRepeat,
+                 std::int64_t timestampNs);
+
+    // Abandons a sequence whose next step did not arrive by nowNs
+    void expire(std::int64_t nowNs);
+
+    std::int64_t nextDeadlineNs() const;
+
+    const MidiBytes *messages() const { return m_output.data(); }
+    int messageCount() const { return m_outputCount; }
+
+    // Keys matched so far, packed for lock-free publishing: the step count in the
+    // low byte, then one byte per key
+    std::uint64_t progress() const;
+
+    static int progressDepth(std::uint64_t progress) { return static_cast<int>(progress & 0xFF); }
+    static int progressKey(std::uint64_t progress, int step) { return static_cast<int>((progress >> (8 * (step + 1))) & 0xFF); }
+
+    void reset();
+
+private:
+    void restart();
+    void firePending();
+    void emitMessage(const MidiBytes &message);
+
+    std::uint64_t m_tableGeneration;    // Generation of the table m_state belongs to
+    int m_state;
+    int m_depth;
+    std::int64_t m_deadlineNs;
+    std::array<std::uint8_t, CompiledSequenceNode::MAX_STEPS> m_steps;
+    std::array<MidiBytes, CompiledSequenceNode::MAX_MESSAGES> m_pendingMessages;
+    int m_pendingCount;     // Burst of a completed sequence waiting for a longer one
+    std::array<MidiBytes, CompiledSequenceNode::MAX_MESSAGES * 2> m_output;
+    int m_outputCount;
+};
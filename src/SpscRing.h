@@ -0,0 +1,78 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+// Bounded single-producer/single-consumer ring. Storage is preallocated and
+// push/pop never block or allocate, so it is safe to use from hook callbacks.
+template <typename T, std::size_t Capacity>
+class SpscRing
+{
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+                  "SpscRing capacity must be a power of two");
+
+public:
+    SpscRing() = default;
+    SpscRing(const SpscRing &) = delete;
+    SpscRing &operator=(const SpscRing &) = delete;
+
+    bool tryPush(const T &item)
+    {
+        const std::size_t head = m_head.load(std::memory_order_relaxed);
+        if (head - m_cachedTail == Capacity) {
+            m_cachedTail = m_tail.load(std::memory_order_acquire);
+            if (head - m_cachedTail == Capacity) {
+                return false;
+            }
+        }
+
+        m_buffer[head & MASK] = item;
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool tryPop(T &item)
+    {
+        const std::size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail == m_cachedHead) {
+            m_cachedHead = m_head.load(std::memory_order_acquire);
+            if (tail == m_cachedHead) {
+                return false;
+            }
+        }
+
+        item = m_buffer[tail & MASK];
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    std::size_t size() const
+    {
+        const std::size_t tail = m_tail.load(std::memory_order_acquire);
+        const std::size_t head = m_head.load(std::memory_order_acquire);
+        return head - tail;
+    }
+
+    bool isEmpty() const
+    {
+        return size() == 0;
+    }
+
+    static constexpr std::size_t capacity()
+    {
+        return Capacity;
+    }
+
+private:
+    static constexpr std::size_t CACHE_LINE_SIZE = 64;
+    static constexpr std::size_t MASK = Capacity - 1;
+
+    alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> m_head{0};
+    std::size_t m_cachedTail = 0;
+
+    alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> m_tail{0};
+    std::size_t m_cachedHead = 0;
+
+    alignas(CACHE_LINE_SIZE) std::array<T, Capacity> m_buffer{};
+};
@@ -0,0 +1,122 @@
+#include "TapHoldResolver.h"
+
+namespace {
+    constexpr std::int64_t NS_PER_MS = 1000000;
+}
+
+TapHoldResolver::TapHoldResolver()
+    : m_wheel(KEY_COUNT)
+{
+    reset();
+}
+
+void TapHoldResolver::reset()
+{
+    m_wheel.clear();
+    m_pending.fill(0);
+    m_held.fill(0);
+    m_hasTap.fill(0);
+    m_timers.fill(TimerWheel::INVALID_HANDLE);
+    m_deadlineNs.fill(0);
+    m_tapMessages.fill(MidiBytes{});
+    m_holdMessages.fill(MidiBytes{});
+    m_resolvedCount = 0;
+    m_outputCount = 0;
+}
+
+bool TapHoldResolver::process(const CompiledMappingTable &table, int vkCode, bool isKeyDown, bool isRepeat,
+                              std::int64_t timestampNs)
+{
+    m_outputCount = 0;
+
+    if (vkCode < 0 || vkCode >= KEY_COUNT) {
+        return false;
+    }
+
+    if (!isKeyDown) {
+        if (testKey(m_pending, vkCode)) {
+            m_wheel.cancel(m_timers[vkCode]);
+            if (timestampNs >= m_deadlineNs[vkCode]) {
+                resolveHold(vkCode);
+            } else {
+                clearKey(m_pending, vkCode);
+                if (testKey(m_hasTap, vkCode)) {
+                    emitMessage(m_tapMessages[vkCode]);
+                }
+            }
+        }
+        clearKey(m_held, vkCode);
+        return false;
+    }
+
+    // Repeats of an undecided or held key say nothing new
+    if (testKey(m_pending, vkCode) || testKey(m_held, vkCode)) {
+        return true;
+    }
+
+    const CompiledMapping &slot = table.mappings[vkCode];
+    if (!(slot.flags & CompiledMapping::HoldEnabled)) {
+        return false;
+    }
+    if (isRepeat) {
+        return true; // Pressed before the key became dual-role
+    }
+
+    // The slot is this key's own, so it cannot already be in use
+    m_deadlineNs[vkCode] = timestampNs + slot.holdThresholdMs * NS_PER_MS;
+    m_timers[vkCode] = m_wheel.schedule(m_deadlineNs[vkCode], static_cast<std::uint32_t>(vkCode));
+    m_tapMessages[vkCode] = slot.messages[1];
+    m_holdMessages[vkCode] = slot.holdMessage;
+    if (slot.flags & CompiledMapping::KeyDownEnabled) {
+        setKey(m_hasTap, vkCode);
+    } else {
+        clearKey(m_hasTap, vkCode);
+    }
+    setKey(m_pending, vkCode);
+    return true;
+}
+
+void TapHoldResolver::expire(std::int64_t nowNs)
+{
+    m_outputCount = 0;
+    m_resolvedCount = 0;
+
+    m_wheel.advance(nowNs, [this](std::uint32_t vkCode, std::int64_t deadlineNs) {
+        m_resolvedDeadlines[m_resolvedCount++] = deadlineNs;
+        resolveHold(static_cast<int>(vkCode));
+    });
+}
+
+std::int64_t TapHoldResolver::nextDeadlineNs() const
+{
+    return m_wheel.nextDeadlineNs();
+}
+
+void TapHoldResolver::resolveHold(int vkCode)
+{
+    clearKey(m_pending, vkCode);
+    setKey(m_held, vkCode);
+    emitMessage(m_holdMessages[vkCode]);
+}
+
+void TapHoldResolver::emitMessage(const MidiBytes &message)
+{
+    if (m_outputCount < static_cast<int>(m_output.size())) {
+        m_output[m_outputCount++] = message;
+    }
+}
+
+bool TapHoldResolver::testKey(const KeyWords &words, int vkCode)
+{
+    return (words[vkCode >> 6] & (std::uint64_t(1) << (vkCode & 63))) != 0;
+}
+
+void TapHoldResolver::setKey(KeyWords &words, int vkCode)
+{
+    words[vkCode >> 6] |= std::uint64_t(1) << (vkCode & 63);
+}
+
+void TapHoldResolver::clearKey(KeyWords &words, int vkCode)
+{
+    words[vkCode >> 6] &= ~(std::uint64_t(1) << (vkCode & 63));
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include "CompiledMappingTable.h"
+#include "TimerWheel.h"
+
+// Tap-or-hold decisions for dual-role keys on the dispatcher thread. A press starts
+// a timeout on the timer wheel; releasing the key first sends the tap message, and
+// the timeout firing first sends the hold message. Decisions follow the event
+// timestamps, so a release that was captured after the threshold counts as a hold
+// even if the timeout has not been run yet. Single-threaded and allocation-free
+// after construction.
+class TapHoldResolver
+{
+public:
+    static constexpr int KEY_COUNT = KeyMask::KEY_COUNT;
+    static constexpr std::int64_t NO_DEADLINE = TimerWheel::NO_DEADLINE;
+
+    TapHoldResolver();
+
+    // Returns true when the event is the press (or a repeat) of a dual-role key, whose
+    // own key-down message must then not be sent. The messages to send are available
+    // from messages() until the next call.
+    bool process(const CompiledMappingTable &table, int vkCode, bool isKeyDown, bool isRepeat,
+                 std::int64_t timestampNs);
+
+    // Resolves keys held past their threshold by nowNs
+    void expire(std::int64_t nowNs);
+
+    std::int64_t nextDeadlineNs() const;
+
+    const MidiBytes *messages() const { return m_output.data(); }
+    int messageCount() const { return m_outputCount; }
+
+    // Thresholds of the holds the last expire() resolved, for measuring how late it ran
+    const std::int64_t *resolvedDeadlines() const { return m_resolvedDeadlines.data(); }
+    int resolvedCount() const { return m_resolvedCount; }
+
+    void reset();
+
+private:
+    using KeyWords = std::array<std::uint64_t, KEY_COUNT / 64>;
+
+    void resolveHold(int vkCode);
+    void emitMessage(const MidiBytes &message);
+
+    static bool testKey(const KeyWords &words, int vkCode);
+    static void setKey(KeyWords &words, int vkCode);
+    static void clearKey(KeyWords &words, int vkCode);
+
+    TimerWheel m_wheel;
+    KeyWords m_pending;     // Pressed, not yet decided
+    KeyWords m_held;        // Resolved as a hold, not yet released
+    KeyWords m_hasTap;
+    std::array<TimerWheel::Handle, KEY_COUNT> m_timers;
+    std::array<std::int64_t, KEY_COUNT> m_deadlineNs;
+    std::array<MidiBytes, KEY_COUNT> m_tapMessages;
+    std::array<MidiBytes, KEY_COUNT> m_holdMessages;
+    std::array<std::int64_t, KEY_COUNT> m_resolvedDeadlines;
+    int m_resolvedCount;
+    std::array<MidiBytes, KEY_COUNT> m_output;
+    int m_outputCount;
+};
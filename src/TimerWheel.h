@@ -0,0 +1,232 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Hashed timing wheel for one thread. Timeouts are bucketed by 0.1 ms tick into a
+// ring of slots, so schedule() and cancel() are O(1) and advance() only visits
+// slots that hold something. Timeouts never fire early and at most one tick late.
+// All storage is allocated up front for a fixed number of pending timeouts.
+class TimerWheel
+{
+public:
+    using Handle = std::uint64_t;
+
+    static constexpr std::int64_t TICK_NS = 100000;
+    static constexpr int SLOT_COUNT = 4096;     // One turn of the wheel is 409.6 ms
+    static constexpr std::int64_t NO_DEADLINE = INT64_MAX;
+    static constexpr Handle INVALID_HANDLE = 0;
+
+    explicit TimerWheel(int capacity)
+        : m_nodes(static_cast<std::size_t>(capacity))
+    {
+        for (Node &node : m_nodes) {
+            node.generation = 0;
+        }
+        clear();
+    }
+
+    TimerWheel(const TimerWheel &) = delete;
+    TimerWheel &operator=(const TimerWheel &) = delete;
+
+    // Returns INVALID_HANDLE when every timeout is in use
+    Handle schedule(std::int64_t deadlineNs, std::uint32_t payload)
+    {
+        if (m_freeHead < 0) {
+            return INVALID_HANDLE;
+        }
+
+        const int index = m_freeHead;
+        Node &node = m_nodes[index];
+        m_freeHead = node.next;
+
+        // A deadline already passed goes in the next slot advance() looks at
+        const std::int64_t tick = (deadlineNs + TICK_NS - 1) / TICK_NS;
+        node.tick = tick > m_nextTick ? tick : m_nextTick;
+        node.deadlineNs = deadlineNs;
+        node.payload = payload;
+        node.slot = static_cast<int>(node.tick & SLOT_MASK);
+        node.active = true;
+        ++node.generation;
+
+        link(index);
+        ++m_count;
+        return (static_cast<Handle>(node.generation) << 32) | static_cast<std::uint32_t>(index);
+    }
+
+    // False if the timeout already fired, was cancelled, or never existed
+    bool cancel(Handle handle)
+    {
+        const std::uint32_t index = static_cast<std::uint32_t>(handle);
+        if (handle == INVALID_HANDLE || index >= m_nodes.size()) {
+            return false;
+        }
+
+        Node &node = m_nodes[index];
+        if (!node.active || node.generation != static_cast<std::uint32_t>(handle >> 32)) {
+            return false;
+        }
+
+        release(static_cast<int>(index));
+        return true;
+    }
+
+    // Calls onTimeout(payload, deadlineNs) for every timeout due by nowNs. The callback
+    // may schedule new timeouts but must not cancel pending ones.
+    template<typename OnTimeout>
+    void advance(std::int64_t nowNs, OnTimeout &&onTimeout)
+    {
+        const std::int64_t nowTick = nowNs / TICK_NS;
+        if (nowTick < m_nextTick) {
+            return;
+        }
+
+        // Slots repeat every turn, so one turn covers any gap however long
+        const std::int64_t lastTick = nowTick - m_nextTick < SLOT_COUNT ? nowTick : m_nextTick + SLOT_COUNT - 1;
+        for (std::int64_t tick = m_nextTick; m_count > 0 && tick <= lastTick; ++tick) {
+            const int distance = nextOccupied(static_cast<int>(tick & SLOT_MASK), static_cast<int>(lastTick - tick));
+            if (distance < 0) {
+                break;
+            }
+            tick += distance;
+
+            int index = m_slotHeads[tick & SLOT_MASK];
+            while (index >= 0) {
+                Node &node = m_nodes[index];
+                const int next = node.next;
+                if (node.tick <= nowTick) {
+                    const std::uint32_t payload = node.payload;
+                    const std::int64_t deadlineNs = node.deadlineNs;
+                    release(index);
+                    onTimeout(payload, deadlineNs);
+                }
+                index = next;
+            }
+        }
+
+        // The current tick is looked at again next time, for deadlines scheduled
+        // during it that have already passed
+        m_nextTick = nowTick;
+    }
+
+    // Start of the first tick that holds a timeout. A slot can also hold timeouts
+    // for a later turn, so this may be early, but it is never late.
+    std::int64_t nextDeadlineNs() const
+    {
+        if (m_count == 0) {
+            return NO_DEADLINE;
+        }
+        const int distance = nextOccupied(static_cast<int>(m_nextTick & SLOT_MASK), SLOT_COUNT - 1);
+        return (m_nextTick + distance) * TICK_NS;
+    }
+
+    int pendingCount() const { return m_count; }
+    int capacity() const { return static_cast<int>(m_nodes.size()); }
+
+    void clear()
+    {
+        m_slotHeads.fill(-1);
+        m_occupied.fill(0);
+        for (std::size_t i = 0; i < m_nodes.size(); ++i) {
+            m_nodes[i].active = false;
+            m_nodes[i].next = i + 1 < m_nodes.size() ? static_cast<int>(i + 1) : -1;
+        }
+        m_freeHead = m_nodes.empty() ? -1 : 0;
+        m_nextTick = 0;
+        m_count = 0;
+    }
+
+private:
+    static constexpr std::int64_t SLOT_MASK = SLOT_COUNT - 1;
+    static constexpr int WORD_COUNT = SLOT_COUNT / 64;
+
+    static_assert((SLOT_COUNT & (SLOT_COUNT - 1)) == 0, "TimerWheel slot count must be a power of two");
+
+    struct Node {
+        std::int64_t tick;
+        std::int64_t deadlineNs;
+        std::uint32_t payload;
+        std::uint32_t generation;
+        int slot;
+        int next;
+        int prev;
+        bool active;
+    };
+
+    void link(int index)
+    {
+        Node &node = m_nodes[index];
+        node.prev = -1;
+        node.next = m_slotHeads[node.slot];
+        if (node.next >= 0) {
+            m_nodes[node.next].prev = index;
+        }
+        m_slotHeads[node.slot] = index;
+        m_occupied[node.slot >> 6] |= std::uint64_t(1) << (node.slot & 63);
+    }
+
+    void release(int index)
+    {
+        Node &node = m_nodes[index];
+        if (node.prev >= 0) {
+            m_nodes[node.prev].next = node.next;
+        } else {
+            m_slotHeads[node.slot] = node.next;
+        }
+        if (node.next >= 0) {
+            m_nodes[node.next].prev = node.prev;
+        }
+        if (m_slotHeads[node.slot] < 0) {
+            m_occupied[node.slot >> 6] &= ~(std::uint64_t(1) << (node.slot & 63));
+        }
+
+        node.active = false;
+        node.next = m_freeHead;
+        m_freeHead = index;
+        --m_count;
+    }
+
+    // Slots from fromSlot onwards, wrapping, up to maxDistance away; -1 if all are empty
+    int nextOccupied(int fromSlot, int maxDistance) const
+    {
+        int distance = 0;
+        int word = fromSlot >> 6;
+        std::uint64_t bits = m_occupied[word] & (~std::uint64_t(0) << (fromSlot & 63));
+        distance -= fromSlot & 63;
+
+        for (;;) {
+            if (bits != 0) {
+                distance += lowestBit(bits);
+                return distance <= maxDistance ? distance : -1;
+            }
+            distance += 64;
+            if (distance > maxDistance) {
+                return -1;
+            }
+            word = (word + 1) % WORD_COUNT;
+            bits = m_occupied[word];
+        }
+    }
+
+    static int lowestBit(std::uint64_t value)
+    {
+#ifdef _MSC_VER
+        unsigned long index = 0;
+        _BitScanForward64(&index, value);
+        return static_cast<int>(index);
+#else
+        return __builtin_ctzll(value);
+#endif
+    }
+
+    std::vector<Node> m_nodes;
+    std::array<int, SLOT_COUNT> m_slotHeads;
+    std::array<std::uint64_t, WORD_COUNT> m_occupied;
+    int m_freeHead;
+    std::int64_t m_nextTick;
+    int m_count;
+};
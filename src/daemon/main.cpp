@@ -0,0 +1,272 @@
+#include "KeyEventDispatcher.h"
+#include "KeyEventRecorder.h"
+#include "KeyMapping.h"
+#include "MidiEngine.h"
+#if __has_include("version.h")
+#include "version.h"
+#else
+#define KTOMIDI_VERSION_STRING "0.0.0"
+#define KTOMIDI_COMPANY_NAME "KtoMIDI Project"
+#endif
+#ifdef _WIN32
+#include "KeyHook.h"
+#else
+#include "EvdevInputSource.h"
+#include <QSocketNotifier>
+#include <csignal>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QStandardPaths>
+#include <QTextStream>
+#include <memory>
+
+namespace {
+    constexpr const char* APP_NAME = "ktomidi-daemon";
+    constexpr const char* ORGANIZATION_NAME = KTOMIDI_COMPANY_NAME;
+
+    struct DaemonSettings {
+        QString midiPort;
+        bool autoConnectMidi = true;
+        bool restoreMidiStateOnReconnect = true;
+        QString overflowPolicy;
+        int ccCoalesceWindowMs = 0;
+        QJsonObject portOutputModes;
+    };
+
+    // Shares the GUI's AppData directory so both executables use the same files
+    QString defaultDataPath(const QString &fileName)
+    {
+        QCoreApplication::setApplicationName("KtoMIDI");
+        const QString path = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/" + fileName;
+        QCoreApplication::setApplicationName(APP_NAME);
+        return path;
+    }
+
+    DaemonSettings loadSettings(const QString &filename)
+    {
+        DaemonSettings settings;
+
+        QFile file(filename);
+        if (!file.open(QIODevice::ReadOnly)) {
+            return settings;
+        }
+
+        QJsonParseError parseError;
+        const QJsonDocument doc = QJsonDocument::fromJson(file.readAll(), &parseError);
+        if (parseError.error != QJsonParseError::NoError || !doc.isObject()) {
+            qWarning() << "Failed to parse settings JSON:" << parseError.errorString();
+            return settings;
+        }
+
+        const QJsonObject obj = doc.object();
+        settings.midiPort = obj["midiPort"].toString();
+        settings.autoConnectMidi = obj["autoConnectMidi"].toBool(true);
+        settings.restoreMidiStateOnReconnect = obj["restoreMidiStateOnReconnect"].toBool(true);
+        settings.overflowPolicy = obj["midiOverflowPolicy"].toString();
+        settings.ccCoalesceWindowMs = obj["ccCoalesceWindowMs"].toInt(0);
+        settings.portOutputModes = obj["portOutputModes"].toObject();
+        return settings;
+    }
+
+#ifdef _WIN32
+    BOOL WINAPI consoleCtrlHandler(DWORD ctrlType)
+    {
+        switch (ctrlType) {
+            case CTRL_C_EVENT:
+            case CTRL_BREAK_EVENT:
+            case CTRL_CLOSE_EVENT:
+            case CTRL_SHUTDOWN_EVENT:
+                QMetaObject::invokeMethod(QCoreApplication::instance(), &QCoreApplication::quit,
+                                          Qt::QueuedConnection);
+                return TRUE;
+            default:
+                return FALSE;
+        }
+    }
+
+    void installShutdownHandler()
+    {
+        SetConsoleCtrlHandler(consoleCtrlHandler, TRUE);
+    }
+#else
+    int s_signalFds[2] = {-1, -1};
+
+    void signalHandler(int)
+    {
+        const char byte = 1;
+        [[maybe_unused]] const ssize_t written = ::write(s_signalFds[0], &byte, sizeof(byte));
+    }
+
+    // Self-pipe so the quit request reaches the event loop outside of signal context
+    void installShutdownHandler()
+    {
+        if (::socketpair(AF_UNIX, SOCK_STREAM, 0, s_signalFds) != 0) {
+            qWarning() << "Failed to create signal socket pair";
+            return;
+        }
+
+        auto *notifier = new QSocketNotifier(s_signalFds[1], QSocketNotifier::Read, QCoreApplication::instance());
+        QObject::connect(notifier, &QSocketNotifier::activated, QCoreApplication::instance(), &QCoreApplication::quit);
+
+        std::signal(SIGINT, signalHandler);
+        std::signal(SIGTERM, signalHandler);
+    }
+#endif
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    app.setApplicationName(APP_NAME);
+    app.setApplicationVersion(KTOMIDI_VERSION_STRING);
+    app.setOrganizationName(ORGANIZATION_NAME);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Runs the KtoMIDI key-to-MIDI engine in the background without a user interface");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    parser.addOption(QCommandLineOption({"m", "mappings"}, "Mappings file (default: the KtoMIDI mappings.json)", "file"));
+    parser.addOption(QCommandLineOption({"s", "settings"}, "Settings file (default: the KtoMIDI settings.json)", "file"));
+    parser.addOption(QCommandLineOption({"p", "port"}, "MIDI output port name (overrides the saved port)", "name"));
+    parser.addOption(QCommandLineOption("virtual-port",
+        "Publish a virtual MIDI output port called <name> instead of opening an existing one (ALSA, JACK, CoreMIDI)",
+        "name"));
+    parser.addOption(QCommandLineOption("record", "Record captured key events to <file> for ktomidi-replay", "file"));
+    parser.addOption(QCommandLineOption("overflow-policy",
+        "What to do when the MIDI port falls behind: block, drop-repeats or coalesce-cc (overrides the saved policy)",
+        "policy"));
+    parser.addOption(QCommandLineOption("output-mode",
+        "Port connection: direct, din or din-running-status (overrides the mode saved for the port)", "mode"));
+    parser.addOption(QCommandLineOption("cc-window",
+        "Merge control changes for the same controller over <ms> and send only the latest (0 = off)", "ms"));
+#ifndef _WIN32
+    parser.addOption(QCommandLineOption({"d", "device"},
+        "evdev device, pipe or recorded input_event file to read (repeatable, default: all keyboards)", "path"));
+    parser.addOption(QCommandLineOption("grab",
+        "Grab the keyboards exclusively so consumed keys never reach other applications (needs /dev/uinput)"));
+#endif
+    parser.process(app);
+
+    QTextStream err(stderr);
+
+    const QString mappingsFile = parser.isSet("mappings") ? parser.value("mappings") : defaultDataPath("mappings.json");
+    const QString settingsFile = parser.isSet("settings") ? parser.value("settings") : defaultDataPath("settings.json");
+
+    const DaemonSettings settings = loadSettings(settingsFile);
+
+    KeyMapping keyMapping;
+    if (QFile::exists(mappingsFile) && !keyMapping.loadFromFile(mappingsFile)) {
+        err << "Failed to load mappings from " << QDir::toNativeSeparators(mappingsFile) << Qt::endl;
+        return 1;
+    }
+
+    MidiEngine midiEngine;
+    QObject::connect(&midiEngine, &MidiEngine::errorOccurred, [](const QString &error) {
+        qWarning().noquote() << error;
+    });
+    QObject::connect(&midiEngine, &MidiEngine::portsChanged, [](const QStringList &ports) {
+        qInfo().noquote() << "MIDI ports changed:" << ports.join(", ");
+    });
+    midiEngine.setRestoreStateOnReconnect(settings.restoreMidiStateOnReconnect);
+
+    const QString policyName = parser.isSet("overflow-policy") ? parser.value("overflow-policy")
+                                                               : settings.overflowPolicy;
+    MidiOutputWorker::OverflowPolicy overflowPolicy = MidiOutputWorker::Block;
+    if (!policyName.isEmpty() && !MidiOutputWorker::policyFromName(policyName, overflowPolicy)) {
+        err << "Unknown overflow policy " << policyName << Qt::endl;
+        return 1;
+    }
+    midiEngine.setOverflowPolicy(overflowPolicy);
+
+    int ccWindowMs = settings.ccCoalesceWindowMs;
+    if (parser.isSet("cc-window")) {
+        bool ok = false;
+        ccWindowMs = parser.value("cc-window").toInt(&ok);
+        if (!ok || ccWindowMs < 0) {
+            err << "Invalid CC coalescing window " << parser.value("cc-window") << Qt::endl;
+            return 1;
+        }
+    }
+    midiEngine.setControlCoalesceWindowMs(ccWindowMs);
+
+    // Virtual ports are saved as MidiEngine::virtualPortSpec(), which openPort() understands
+    const QString portName = parser.isSet("virtual-port") ? MidiEngine::virtualPortSpec(parser.value("virtual-port"))
+                           : parser.isSet("port") ? parser.value("port")
+                           : (settings.autoConnectMidi ? settings.midiPort : QString());
+    if (portName.isEmpty()) {
+        err << "No MIDI output port configured; use --port, --virtual-port or select one in KtoMIDI" << Qt::endl;
+        return 1;
+    }
+    const QString outputModeName = parser.isSet("output-mode") ? parser.value("output-mode")
+                                                               : settings.portOutputModes[portName].toString();
+    MidiEngine::OutputMode outputMode = MidiEngine::DirectOutput;
+    if (!outputModeName.isEmpty() && !MidiEngine::outputModeFromName(outputModeName, outputMode)) {
+        err << "Unknown output mode " << outputModeName << Qt::endl;
+        return 1;
+    }
+    midiEngine.setPortOutputMode(portName, outputMode);
+
+    if (!midiEngine.openPort(portName)) {
+        err << "Failed to open MIDI port " << portName << Qt::endl;
+        return 1;
+    }
+
+    KeyEventDispatcher dispatcher(&keyMapping, &midiEngine);
+    dispatcher.start();
+
+    std::unique_ptr<KeyEventRecorder> recorder;
+    if (parser.isSet("record")) {
+        recorder = std::make_unique<KeyEventRecorder>();
+        if (!recorder->start(parser.value("record"))) {
+            err << "Failed to start recording to " << parser.value("record") << Qt::endl;
+            return 1;
+        }
+        dispatcher.setRecorder(recorder.get());
+    }
+
+#ifdef _WIN32
+    KeyHook inputSource;
+#else
+    EvdevInputSource inputSource(parser.values("device"));
+    inputSource.setExclusiveGrab(parser.isSet("grab"));
+    if (!parser.isSet("grab") && !keyMapping.consumedKeys().isEmpty()) {
+        qWarning() << "Consumed keys still reach other applications without --grab";
+    }
+#endif
+    inputSource.setDispatcher(&dispatcher);
+    QObject::connect(&inputSource, &InputSource::captureStopped, &dispatcher, &KeyEventDispatcher::stopMacros);
+    QObject::connect(&inputSource, &InputSource::captureStopped, &midiEngine, &MidiEngine::releaseAllNotes);
+    inputSource.setSuppressedRepeatKeys(keyMapping.suppressedRepeatKeys());
+    inputSource.setConsumedKeys(keyMapping.consumedKeys());
+    QObject::connect(&inputSource, &InputSource::finished, &app, &QCoreApplication::quit, Qt::QueuedConnection);
+    if (!inputSource.start()) {
+        err << "Failed to start keyboard capture" << Qt::endl;
+        return 1;
+    }
+
+    installShutdownHandler();
+
+    qInfo().noquote() << QString("Translating %1 key mappings to \"%2\"")
+                         .arg(keyMapping.getAllMappings().size()).arg(portName);
+
+    const int result = app.exec();
+
+    inputSource.stop();
+    dispatcher.stop();
+    dispatcher.setRecorder(nullptr);
+    if (recorder) {
+        recorder->stop();
+    }
+    qInfo().noquote() << dispatcher.latency().report();
+    qInfo().noquote() << midiEngine.outputStats().report();
+
+    return result;
+}
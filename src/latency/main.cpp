@@ -0,0 +1,228 @@
+#include "KeyEvent.h"
+#include "LatencyStats.h"
+#include "MidiEngine.h"
+#include "MidiOutputWorker.h"
+#if __has_include("version.h")
+#include "version.h"
+#else
+#define KTOMIDI_VERSION_STRING "0.0.0"
+#define KTOMIDI_COMPANY_NAME "KtoMIDI Project"
+#endif
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDebug>
+#include <QThread>
+#include <QTextStream>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <rtmidi/RtMidi.h>
+
+namespace {
+    constexpr const char* APP_NAME = "ktomidi-latency";
+    constexpr const char* ORGANIZATION_NAME = KTOMIDI_COMPANY_NAME;
+    // A probe's id is spread over note (7 bits) and velocity 1..127, as velocity 0 means note-off
+    constexpr int PROBE_ID_COUNT = 128 * 127;
+    constexpr int INPUT_SEARCH_TIMEOUT_MS = 2000;
+    constexpr int INPUT_SEARCH_INTERVAL_MS = 50;
+    constexpr int SETTLE_TIME_MS = 500;
+    constexpr std::uint8_t PROBE_STATUS = 0x90;
+
+    // Written by the sending thread before each probe goes out, read by the RtMidi input thread
+    struct ProbeLog {
+        std::array<std::atomic<std::int64_t>, PROBE_ID_COUNT> sentNs;
+        std::atomic<quint64> received;
+        std::atomic<quint64> unexpected;
+        LatencyHistogram roundTrip;
+
+        ProbeLog() : received(0), unexpected(0)
+        {
+            for (auto &sent : sentNs) {
+                sent.store(0, std::memory_order_relaxed);
+            }
+        }
+    };
+
+    MidiBytes probeMessage(int id)
+    {
+        return {PROBE_STATUS, static_cast<std::uint8_t>(id & 0x7F), static_cast<std::uint8_t>(1 + (id >> 7))};
+    }
+
+    void onMidiInput(double, std::vector<unsigned char> *message, void *userData)
+    {
+        const std::int64_t nowNs = EngineClock::nowNs();
+        ProbeLog *log = static_cast<ProbeLog *>(userData);
+
+        if (message->size() != 3 || (*message)[0] != PROBE_STATUS) {
+            log->unexpected.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        if ((*message)[2] == 0) {
+            return; // The note-off that follows every probe
+        }
+
+        const int id = ((*message)[1] & 0x7F) | ((((*message)[2] & 0x7F) - 1) << 7);
+        const std::int64_t sentNs = log->sentNs[id].exchange(0, std::memory_order_acq_rel);
+        if (sentNs == 0) {
+            log->unexpected.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        log->roundTrip.record(nowNs - sentNs);
+        log->received.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Virtual ports show up to other clients under a backend-specific prefix, so match loosely
+    int findInputPort(RtMidiIn &input, const QString &nameFragment)
+    {
+        const unsigned int portCount = input.getPortCount();
+        for (unsigned int i = 0; i < portCount; ++i) {
+            if (QString::fromStdString(input.getPortName(i)).contains(nameFragment)) {
+                return static_cast<int>(i);
+            }
+        }
+        return -1;
+    }
+
+    QString formatUs(std::int64_t valueNs)
+    {
+        return QString::number(valueNs / 1000.0, 'f', 2);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    app.setApplicationName(APP_NAME);
+    app.setApplicationVersion(KTOMIDI_VERSION_STRING);
+    app.setOrganizationName(ORGANIZATION_NAME);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Measures MIDI round-trip latency from the KtoMIDI output pipeline to a MIDI input, "
+                                     "e.g. through a loopback driver or KtoMIDI's own virtual port");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    parser.addOption(QCommandLineOption({"p", "port"}, "MIDI output port to send probes to", "name"));
+    parser.addOption(QCommandLineOption("virtual",
+        "Publish a virtual output port called <name> and send probes through it", "name"));
+    parser.addOption(QCommandLineOption({"i", "input"},
+        "MIDI input to listen on; the first port whose name contains <name> (default: the virtual port name)", "name"));
+    parser.addOption(QCommandLineOption({"n", "count"}, "Number of probes to send", "count", "1000"));
+    parser.addOption(QCommandLineOption("interval", "Time between probes", "ms", "5"));
+    parser.addOption(QCommandLineOption("output-mode",
+        "Port connection: direct, din or din-running-status", "mode", "direct"));
+    parser.process(app);
+
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    if (parser.isSet("port") == parser.isSet("virtual")) {
+        err << "Specify exactly one of --port and --virtual" << Qt::endl;
+        return 1;
+    }
+    const QString inputName = parser.isSet("input") ? parser.value("input") : parser.value("virtual");
+    if (inputName.isEmpty()) {
+        err << "No MIDI input given; use --input to name the loopback's input side" << Qt::endl;
+        return 1;
+    }
+
+    bool ok = false;
+    const int count = parser.value("count").toInt(&ok);
+    if (!ok || count < 1) {
+        err << "Invalid probe count" << Qt::endl;
+        return 1;
+    }
+
+    const int intervalMs = parser.value("interval").toInt(&ok);
+    if (!ok || intervalMs < 0) {
+        err << "Invalid probe interval" << Qt::endl;
+        return 1;
+    }
+
+    MidiEngine::OutputMode outputMode;
+    if (!MidiEngine::outputModeFromName(parser.value("output-mode"), outputMode)) {
+        err << "Unknown output mode " << parser.value("output-mode") << Qt::endl;
+        return 1;
+    }
+
+    MidiEngine midiEngine;
+    QObject::connect(&midiEngine, &MidiEngine::errorOccurred, [](const QString &error) {
+        qWarning().noquote() << error;
+    });
+
+    const QString portName = parser.isSet("virtual") ? MidiEngine::virtualPortSpec(parser.value("virtual"))
+                                                     : parser.value("port");
+    midiEngine.setPortOutputMode(portName, outputMode);
+    if (!midiEngine.openPort(portName)) {
+        err << "Failed to open MIDI port " << portName << Qt::endl;
+        return 1;
+    }
+
+    std::unique_ptr<ProbeLog> log = std::make_unique<ProbeLog>();
+    std::unique_ptr<RtMidiIn> input;
+    try {
+        input = std::make_unique<RtMidiIn>(RtMidi::UNSPECIFIED, "KtoMIDI Latency Probe");
+
+        // A freshly published virtual port can take a moment to reach other clients
+        int inputIndex = findInputPort(*input, inputName);
+        for (int waitedMs = 0; inputIndex < 0 && waitedMs < INPUT_SEARCH_TIMEOUT_MS;
+             waitedMs += INPUT_SEARCH_INTERVAL_MS) {
+            QThread::msleep(INPUT_SEARCH_INTERVAL_MS);
+            inputIndex = findInputPort(*input, inputName);
+        }
+        if (inputIndex < 0) {
+            err << "No MIDI input matching " << inputName << Qt::endl;
+            return 1;
+        }
+
+        input->setCallback(&onMidiInput, log.get());
+        input->openPort(static_cast<unsigned int>(inputIndex));
+        out << "Listening on: " << QString::fromStdString(input->getPortName(inputIndex)) << "\n";
+    } catch (const RtMidiError &error) {
+        err << "Failed to open MIDI input: " << QString::fromStdString(error.getMessage()) << Qt::endl;
+        return 1;
+    }
+
+    out << "Sending to:   " << midiEngine.getCurrentPortName() << "\n";
+    out.flush();
+
+    // Send time is taken before the message enters the output queue, so the
+    // measurement covers the worker, any pacing, the driver and the loopback
+    for (int i = 0; i < count; ++i) {
+        const int id = i % PROBE_ID_COUNT;
+        const MidiBytes probe = probeMessage(id);
+        log->sentNs[id].store(EngineClock::nowNs(), std::memory_order_release);
+        midiEngine.sendMidiBytes(probe);
+        midiEngine.sendMidiBytes({probe[0], probe[1], 0});
+        if (intervalMs > 0) {
+            QThread::msleep(static_cast<unsigned long>(intervalMs));
+        }
+    }
+
+    midiEngine.waitForOutputIdle(count * intervalMs + SETTLE_TIME_MS);
+    QThread::msleep(SETTLE_TIME_MS);
+
+    try {
+        input->cancelCallback();
+        input->closePort();
+    } catch (const RtMidiError &error) {
+        qWarning() << "Error closing MIDI input:" << QString::fromStdString(error.getMessage());
+    }
+    midiEngine.closePort();
+
+    const quint64 received = log->received.load();
+    const LatencySummary latency = log->roundTrip.summary();
+    out << "Probes:       " << count << " sent, " << received << " received, "
+        << (static_cast<quint64>(count) - std::min<quint64>(received, count)) << " lost";
+    if (log->unexpected.load() > 0) {
+        out << ", " << log->unexpected.load() << " unexpected messages";
+    }
+    out << "\n";
+    out << "Round trip (us): p50=" << formatUs(latency.p50Ns)
+        << " p99=" << formatUs(latency.p99Ns)
+        << " p999=" << formatUs(latency.p999Ns)
+        << " max=" << formatUs(latency.maxNs) << "\n";
+    out << midiEngine.outputStatsByPort().value(portName).report() << "\n";
+
+    return 0;
+}
@@ -69,11 +69,16 @@ int main(int argc, char *argv[])
     parser.addHelpOption();
     parser.addVersionOption();
     parser.addOption(QCommandLineOption("minimized", "Start minimized to system tray"));
+    parser.addOption(QCommandLineOption("record", "Record captured key events to <file> for ktomidi-replay", "file"));
     parser.process(app);
     
     try {
         MainWindow window;
         
+        if (parser.isSet("record")) {
+            window.startInputRecording(parser.value("record"));
+        }
+        
         if (parser.isSet("minimized")) {
             qDebug() << "Starting minimized to system tray";
             window.hide();
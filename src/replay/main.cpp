@@ -0,0 +1,549 @@
+#include "KeyCaptureFilter.h"
+#include "KeyEventDispatcher.h"
+#include "KeyEventRecorder.h"
+#include "KeyEventTranslator.h"
+#include "KeyMapping.h"
+#include "LatencyStats.h"
+#include "MidiEngine.h"
+#include "MidiOutputWorker.h"
+#include "TimerWheel.h"
+#if __has_include("version.h")
+#include "version.h"
+#else
+#define KTOMIDI_VERSION_STRING "0.0.0"
+#define KTOMIDI_COMPANY_NAME "KtoMIDI Project"
+#endif
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDebug>
+#include <QDir>
+#include <QStandardPaths>
+#include <QThread>
+#include <QTextStream>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+namespace {
+    constexpr const char* APP_NAME = "ktomidi-replay";
+    constexpr const char* ORGANIZATION_NAME = KTOMIDI_COMPANY_NAME;
+    constexpr std::int64_t SPIN_THRESHOLD_NS = 2000000;
+    constexpr int CAPTURE_FILTER_MIN_EVENTS = 10000000;
+    constexpr int OUTPUT_DRAIN_TIMEOUT_MS = 60000;
+    constexpr int BENCH_CHORD_SIZE = 3;
+    constexpr int BENCH_CHORD_SEED = 12345;
+    constexpr int BENCH_HOLD_KEYS = 64;
+    constexpr int BENCH_HOLD_THRESHOLD_MS = 5;
+    constexpr int BENCH_HOLD_MAX_GAP_US = 400;
+    constexpr int BENCH_WHEEL_TIMEOUTS = 10000;
+    constexpr int BENCH_WHEEL_OPERATIONS = 1000000;
+    constexpr std::int64_t BENCH_WHEEL_SPAN_NS = 10000000000;
+    constexpr int BENCH_MACRO_KEYS = 16;
+    constexpr int BENCH_MACRO_NOTES = 8;
+    constexpr double BENCH_MACRO_STRUM_MS = 5.0;
+    constexpr double BENCH_MACRO_RING_MS = 120.0;
+    constexpr int BENCH_MACRO_MAX_GAP_US = 10000;
+
+    void waitUntil(std::int64_t deadlineNs)
+    {
+        for (;;) {
+            const std::int64_t remaining = deadlineNs - EngineClock::nowNs();
+            if (remaining <= 0) {
+                return;
+            }
+            if (remaining > SPIN_THRESHOLD_NS) {
+                QThread::usleep(static_cast<unsigned long>((remaining - SPIN_THRESHOLD_NS) / 1000));
+            } else {
+                QThread::yieldCurrentThread();
+            }
+        }
+    }
+
+    QString formatUs(std::int64_t valueNs)
+    {
+        return QString::number(valueNs / 1000.0, 'f', 2);
+    }
+
+    // Runs the recording through the capture-callback state alone. A single event
+    // is too cheap to time individually, so this reports the mean over many passes.
+    double measureCaptureFilterNs(const QVector<KeyEvent> &events, const KeyMapping &keyMapping)
+    {
+        KeyCaptureFilter filter;
+        filter.setSuppressedRepeatKeys(keyMapping.suppressedRepeatKeys());
+        filter.setConsumedKeys(keyMapping.consumedKeys());
+
+        const int passes = std::max(1, CAPTURE_FILTER_MIN_EVENTS / static_cast<int>(events.size()));
+        int suppressed = 0;
+        const std::int64_t beginNs = EngineClock::nowNs();
+        for (int pass = 0; pass < passes; ++pass) {
+            for (const KeyEvent &event : events) {
+                suppressed += filter.onKey(event.vkCode, event.isKeyDown).suppress ? 1 : 0;
+            }
+        }
+        const std::int64_t elapsedNs = EngineClock::nowNs() - beginNs;
+
+        volatile int sink = suppressed;
+        Q_UNUSED(sink);
+        return static_cast<double>(elapsedNs) / (static_cast<double>(passes) * events.size());
+    }
+
+    // Key lookup plus chord and sequence matching, timed the same way as the capture filter.
+    // Each pass is shifted in time so chords started in one pass never complete in the next.
+    double measureTranslatorNs(const QVector<KeyEvent> &events, const KeyMapping &keyMapping)
+    {
+        const auto table = keyMapping.compiledTable();
+        KeyEventTranslator translator;
+
+        const std::int64_t passSpanNs = events.last().timestampNs - events.first().timestampNs
+                                      + table->chordWindowNs + 1;
+        const int passes = std::max(1, CAPTURE_FILTER_MIN_EVENTS / static_cast<int>(events.size()));
+        int messages = 0;
+        const std::int64_t beginNs = EngineClock::nowNs();
+        for (int pass = 0; pass < passes; ++pass) {
+            const std::int64_t offsetNs = pass * passSpanNs;
+            for (KeyEvent event : events) {
+                event.timestampNs += offsetNs;
+                translator.process(*table, event);
+                messages += translator.messageCount();
+            }
+            translator.expire(KeyEventTranslator::NO_DEADLINE);
+        }
+        const std::int64_t elapsedNs = EngineClock::nowNs() - beginNs;
+
+        volatile int sink = messages;
+        Q_UNUSED(sink);
+        return static_cast<double>(elapsedNs) / (static_cast<double>(passes) * events.size());
+    }
+
+    // Presses dual-role keys through a live dispatcher, a random 0-400 us apart so
+    // dozens of thresholds are pending at once, and reports how late the dispatcher
+    // resolved each hold. No port is opened; that does not change the timing.
+    LatencySummary measureHoldResolution(int presses)
+    {
+        KeyMapping keyMapping;
+        keyMapping.beginUpdate();
+        for (int vkCode = 1; vkCode <= BENCH_HOLD_KEYS; ++vkCode) {
+            KeyMappingEntry entry;
+            entry.vkCode = vkCode;
+            entry.enableHold = true;
+            entry.holdThresholdMs = BENCH_HOLD_THRESHOLD_MS;
+            keyMapping.addMapping(entry);
+        }
+        keyMapping.endUpdate();
+
+        MidiEngine midiEngine;
+        KeyEventDispatcher dispatcher(&keyMapping, &midiEngine);
+        dispatcher.start();
+
+        std::mt19937 random(BENCH_CHORD_SEED);
+        std::uniform_int_distribution<int> gapUs(0, BENCH_HOLD_MAX_GAP_US);
+        for (int i = 0; i < presses; ++i) {
+            const int vkCode = 1 + i % BENCH_HOLD_KEYS;
+            if (i >= BENCH_HOLD_KEYS) {
+                dispatcher.postEvent(KeyEvent(vkCode, false, false), KeyEventDispatcher::WaitWhenFull);
+            }
+            dispatcher.postEvent(KeyEvent(vkCode, true, false), KeyEventDispatcher::WaitWhenFull);
+            waitUntil(EngineClock::nowNs() + gapUs(random) * 1000);
+        }
+
+        waitUntil(EngineClock::nowNs() + 2 * BENCH_HOLD_THRESHOLD_MS * 1000000);
+        for (int vkCode = 1; vkCode <= BENCH_HOLD_KEYS; ++vkCode) {
+            dispatcher.postEvent(KeyEvent(vkCode, false, false), KeyEventDispatcher::WaitWhenFull);
+        }
+        dispatcher.stop();
+
+        return dispatcher.latency().summary(PipelineLatency::ThresholdToHold);
+    }
+
+    // Plays strummed chords as macros through a live dispatcher: each press strums
+    // eight notes 5 ms apart and releases them 120 ms later. Presses come a random
+    // 0-10 ms apart over 16 keys, so a dozen or more macros overlap, and a key is
+    // released just before its next press, which cancels the macro for even key codes.
+    // Reports how late the player sent each event. No port is opened; that does not change the timing.
+    LatencySummary measureMacroPlayback(int presses, int &maxVoices)
+    {
+        KeyMapping keyMapping;
+        keyMapping.beginUpdate();
+        for (int vkCode = 1; vkCode <= BENCH_MACRO_KEYS; ++vkCode) {
+            MacroMappingEntry entry;
+            entry.vkCode = vkCode;
+            entry.cancelOnRelease = vkCode % 2 == 0;
+            for (int i = 0; i < BENCH_MACRO_NOTES; ++i) {
+                MacroEvent event;
+                event.atMs = i * BENCH_MACRO_STRUM_MS;
+                event.message.note = 48 + vkCode + 3 * i;
+                entry.events.append(event);
+                event.atMs += BENCH_MACRO_RING_MS;
+                event.message.type = MidiMessage::NOTE_OFF;
+                entry.events.append(event);
+            }
+            keyMapping.addMacroMapping(entry);
+        }
+        keyMapping.endUpdate();
+
+        MidiEngine midiEngine;
+        KeyEventDispatcher dispatcher(&keyMapping, &midiEngine);
+        dispatcher.start();
+
+        std::mt19937 random(BENCH_CHORD_SEED);
+        std::uniform_int_distribution<int> gapUs(0, BENCH_MACRO_MAX_GAP_US);
+        for (int i = 0; i < presses; ++i) {
+            const int vkCode = 1 + i % BENCH_MACRO_KEYS;
+            if (i >= BENCH_MACRO_KEYS) {
+                dispatcher.postEvent(KeyEvent(vkCode, false, false), KeyEventDispatcher::WaitWhenFull);
+            }
+            dispatcher.postEvent(KeyEvent(vkCode, true, false), KeyEventDispatcher::WaitWhenFull);
+            waitUntil(EngineClock::nowNs() + gapUs(random) * 1000);
+        }
+
+        waitUntil(EngineClock::nowNs() + static_cast<std::int64_t>(2 * BENCH_MACRO_RING_MS) * 1000000);
+        dispatcher.stop();
+
+        maxVoices = dispatcher.macroPlayer().maxActiveVoices();
+        return dispatcher.macroPlayer().lateness();
+    }
+
+    // Cost of cancelling one pending timeout and scheduling another with the wheel full
+    double measureTimerWheelNs()
+    {
+        TimerWheel wheel(BENCH_WHEEL_TIMEOUTS);
+        std::vector<TimerWheel::Handle> handles(BENCH_WHEEL_TIMEOUTS);
+        std::mt19937 random(BENCH_CHORD_SEED);
+        std::uniform_int_distribution<std::int64_t> deadline(0, BENCH_WHEEL_SPAN_NS);
+        std::uniform_int_distribution<int> pick(0, BENCH_WHEEL_TIMEOUTS - 1);
+
+        for (int i = 0; i < BENCH_WHEEL_TIMEOUTS; ++i) {
+            handles[i] = wheel.schedule(deadline(random), static_cast<std::uint32_t>(i));
+        }
+
+        // Draw the random numbers up front so only the wheel is timed
+        std::vector<std::pair<int, std::int64_t>> operations(BENCH_WHEEL_OPERATIONS);
+        for (auto &operation : operations) {
+            operation = {pick(random), deadline(random)};
+        }
+
+        const std::int64_t beginNs = EngineClock::nowNs();
+        for (const auto &operation : operations) {
+            wheel.cancel(handles[operation.first]);
+            handles[operation.first] = wheel.schedule(operation.second, static_cast<std::uint32_t>(operation.first));
+        }
+        const std::int64_t elapsedNs = EngineClock::nowNs() - beginNs;
+
+        volatile int sink = wheel.pendingCount();
+        Q_UNUSED(sink);
+        return static_cast<double>(elapsedNs) / BENCH_WHEEL_OPERATIONS;
+    }
+
+    // Random chords over the keys the recording presses, so the benchmark exercises real matches
+    void addBenchmarkChords(KeyMapping &keyMapping, const QVector<KeyEvent> &events, int count)
+    {
+        QList<int> keys;
+        for (const KeyEvent &event : events) {
+            if (!keys.contains(event.vkCode)) {
+                keys.append(event.vkCode);
+            }
+        }
+        if (keys.size() < BENCH_CHORD_SIZE) {
+            return;
+        }
+
+        std::mt19937 random(BENCH_CHORD_SEED);
+        std::uniform_int_distribution<int> pick(0, static_cast<int>(keys.size()) - 1);
+        keyMapping.beginUpdate();
+        for (int i = 0; i < count; ++i) {
+            ChordMappingEntry chord;
+            while (chord.vkCodes.size() < BENCH_CHORD_SIZE) {
+                const int vkCode = keys[pick(random)];
+                if (!chord.vkCodes.contains(vkCode)) {
+                    chord.vkCodes.append(vkCode);
+                }
+            }
+            chord.keyDownMessage.note = i % 128;
+            keyMapping.addChordMapping(chord);
+        }
+        keyMapping.endUpdate();
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    app.setApplicationName(APP_NAME);
+    app.setApplicationVersion(KTOMIDI_VERSION_STRING);
+    app.setOrganizationName(ORGANIZATION_NAME);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Replays a recorded KtoMIDI key event stream through the mapping and MIDI pipeline");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    parser.addPositionalArgument("recording", "Key event recording created with KtoMIDI --record");
+    parser.addOption(QCommandLineOption({"m", "mappings"}, "Mappings file (default: the KtoMIDI mappings.json)", "file"));
+    parser.addOption(QCommandLineOption({"p", "port"}, "MIDI output port name (default: null sink)", "name"));
+    parser.addOption(QCommandLineOption({"n", "iterations"}, "Number of passes over the recording", "count", "1"));
+    parser.addOption(QCommandLineOption("realtime", "Replay with the recorded timing instead of as fast as possible"));
+    parser.addOption(QCommandLineOption("policy",
+        "Output overflow policy: block, drop-repeats or coalesce-cc", "policy", "block"));
+    parser.addOption(QCommandLineOption("output-mode",
+        "Port connection to model: direct, din or din-running-status", "mode", "direct"));
+    parser.addOption(QCommandLineOption("cc-window",
+        "Merge control changes for the same controller over <ms> before sending (0 = off)", "ms", "0"));
+    parser.addOption(QCommandLineOption("bench-capture", "Also time the capture filter per event"));
+    parser.addOption(QCommandLineOption("bench-chords",
+        "Also time chord and sequence matching after adding <count> random three-key chords (0 = only the file's)", "count"));
+    parser.addOption(QCommandLineOption("bench-holds",
+        "Also measure how accurately <count> tap-or-hold presses resolve on the dispatcher thread", "count"));
+    parser.addOption(QCommandLineOption("bench-macros",
+        "Also measure the timing of <count> overlapping macro presses on the macro player thread", "count"));
+    parser.addOption(QCommandLineOption("sink-delay",
+        "Simulated per-message send time of the null sink, to exercise backpressure", "us", "0"));
+    parser.process(app);
+
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    const QStringList positional = parser.positionalArguments();
+    if (positional.size() != 1) {
+        parser.showHelp(1);
+    }
+
+    QVector<KeyEvent> events;
+    QString error;
+    if (!KeyEventRecorder::readFile(positional.first(), events, &error)) {
+        err << error << Qt::endl;
+        return 1;
+    }
+    if (events.isEmpty()) {
+        err << "Recording contains no events" << Qt::endl;
+        return 1;
+    }
+
+    QString mappingsFile = parser.value("mappings");
+    if (mappingsFile.isEmpty()) {
+        QCoreApplication::setApplicationName("KtoMIDI");
+        mappingsFile = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/mappings.json";
+        QCoreApplication::setApplicationName(APP_NAME);
+    }
+
+    KeyMapping keyMapping;
+    if (!keyMapping.loadFromFile(mappingsFile)) {
+        err << "Failed to load mappings from " << QDir::toNativeSeparators(mappingsFile) << Qt::endl;
+        return 1;
+    }
+
+    MidiOutputWorker::OverflowPolicy overflowPolicy;
+    if (!MidiOutputWorker::policyFromName(parser.value("policy"), overflowPolicy)) {
+        err << "Unknown overflow policy " << parser.value("policy") << Qt::endl;
+        return 1;
+    }
+
+    MidiEngine::OutputMode outputMode;
+    if (!MidiEngine::outputModeFromName(parser.value("output-mode"), outputMode)) {
+        err << "Unknown output mode " << parser.value("output-mode") << Qt::endl;
+        return 1;
+    }
+
+    bool ok = false;
+    const int iterations = parser.value("iterations").toInt(&ok);
+    if (!ok || iterations < 1) {
+        err << "Invalid iteration count" << Qt::endl;
+        return 1;
+    }
+
+    const int ccWindowMs = parser.value("cc-window").toInt(&ok);
+    if (!ok || ccWindowMs < 0) {
+        err << "Invalid CC coalescing window" << Qt::endl;
+        return 1;
+    }
+
+    const int sinkDelayUs = parser.value("sink-delay").toInt(&ok);
+    if (!ok || sinkDelayUs < 0) {
+        err << "Invalid sink delay" << Qt::endl;
+        return 1;
+    }
+
+    int benchChords = 0;
+    if (parser.isSet("bench-chords")) {
+        benchChords = parser.value("bench-chords").toInt(&ok);
+        if (!ok || benchChords < 0) {
+            err << "Invalid chord count" << Qt::endl;
+            return 1;
+        }
+    }
+
+    int benchHolds = 0;
+    if (parser.isSet("bench-holds")) {
+        benchHolds = parser.value("bench-holds").toInt(&ok);
+        if (!ok || benchHolds < 0) {
+            err << "Invalid hold count" << Qt::endl;
+            return 1;
+        }
+    }
+
+    int benchMacros = 0;
+    if (parser.isSet("bench-macros")) {
+        benchMacros = parser.value("bench-macros").toInt(&ok);
+        if (!ok || benchMacros < 0) {
+            err << "Invalid macro count" << Qt::endl;
+            return 1;
+        }
+    }
+
+    std::unique_ptr<MidiEngine> midiEngine;
+    if (parser.isSet("port")) {
+        midiEngine = std::make_unique<MidiEngine>();
+        midiEngine->setOverflowPolicy(overflowPolicy);
+        midiEngine->setControlCoalesceWindowMs(ccWindowMs);
+        midiEngine->setPortOutputMode(parser.value("port"), outputMode);
+        if (!midiEngine->openPort(parser.value("port"))) {
+            err << "Failed to open MIDI port " << parser.value("port") << Qt::endl;
+            return 1;
+        }
+    }
+
+    // Without a port the same output worker feeds a checksum, so queueing and the
+    // overflow policies can be measured on machines without MIDI hardware
+    quint64 nullSinkChecksum = 0;
+    MidiOutputWorker nullSink([&nullSinkChecksum, sinkDelayUs](const MidiBytes *messages, int count) {
+        for (int i = 0; i < count; ++i) {
+            nullSinkChecksum += messages[i][0] + messages[i][1] + messages[i][2];
+        }
+        if (sinkDelayUs > 0) {
+            waitUntil(EngineClock::nowNs() + static_cast<std::int64_t>(sinkDelayUs) * 1000 * count);
+        }
+    });
+    if (!midiEngine) {
+        nullSink.setOverflowPolicy(overflowPolicy);
+        nullSink.setControlCoalesceWindowMs(ccWindowMs);
+        if (outputMode != MidiEngine::DirectOutput) {
+            nullSink.setWireShaping(MidiWireShaper::DIN_BAUD_RATE, outputMode == MidiEngine::DinRunningStatusOutput);
+        }
+        nullSink.start();
+    }
+
+    const bool realtime = parser.isSet("realtime");
+    KeyEventTranslator translator;
+    LatencyHistogram processing;
+    LatencyHistogram lateness;
+    quint64 messagesSent = 0;
+
+    const std::int64_t firstTimestamp = events.first().timestampNs;
+    const std::int64_t startNs = EngineClock::nowNs();
+
+    // Chord windows and sequence timeouts follow the recorded timeline, so the output
+    // does not depend on replay speed
+    const auto sendTranslated = [&](bool isRepeat) {
+        for (int i = 0; i < translator.messageCount(); ++i) {
+            if (midiEngine) {
+                midiEngine->sendMidiBytes(translator.messages()[i], isRepeat);
+            } else {
+                nullSink.enqueue(translator.messages()[i], isRepeat);
+            }
+            ++messagesSent;
+        }
+    };
+
+    for (int pass = 0; pass < iterations; ++pass) {
+        const std::int64_t passStartNs = EngineClock::nowNs();
+
+        for (const KeyEvent &event : events) {
+            if (realtime) {
+                const std::int64_t dueNs = passStartNs + (event.timestampNs - firstTimestamp);
+                waitUntil(dueNs);
+                lateness.record(EngineClock::nowNs() - dueNs);
+            }
+
+            const std::int64_t beginNs = EngineClock::nowNs();
+            translator.expire(event.timestampNs);
+            sendTranslated(false);
+            {
+                const auto table = keyMapping.compiledTable();
+                translator.process(*table, event);
+            }
+            sendTranslated(event.isRepeat);
+            processing.record(EngineClock::nowNs() - beginNs);
+        }
+
+        translator.expire(KeyEventTranslator::NO_DEADLINE);
+        sendTranslated(false);
+        translator.reset();
+    }
+
+    const std::int64_t elapsedNs = EngineClock::nowNs() - startNs;
+
+    // Let a paced port finish at wire speed; closing flushes the rest unpaced
+    MidiOutputStats outputStats;
+    if (midiEngine) {
+        midiEngine->waitForOutputIdle(OUTPUT_DRAIN_TIMEOUT_MS);
+        midiEngine->closePort();
+        outputStats = midiEngine->outputStatsByPort().value(parser.value("port"));
+    } else {
+        nullSink.waitForIdle(OUTPUT_DRAIN_TIMEOUT_MS);
+        nullSink.stop();
+        outputStats = nullSink.stats();
+    }
+    const quint64 totalEvents = static_cast<quint64>(events.size()) * static_cast<quint64>(iterations);
+    const double elapsedSeconds = elapsedNs / 1e9;
+
+    const LatencySummary latency = processing.summary();
+    out << "Events:      " << totalEvents << " (" << events.size() << " x " << iterations << ")\n";
+    out << "MIDI out:    " << messagesSent << (midiEngine ? " messages" : " messages (null sink)")
+        << " via " << MidiOutputWorker::policyName(overflowPolicy) << "\n";
+    out << "Elapsed:     " << QString::number(elapsedSeconds, 'f', 3) << " s\n";
+    out << "Throughput:  " << QString::number(elapsedSeconds > 0 ? totalEvents / elapsedSeconds : 0.0, 'f', 0)
+        << " events/s\n";
+    out << "Per-event latency (us): p50=" << formatUs(latency.p50Ns)
+        << " p99=" << formatUs(latency.p99Ns)
+        << " p999=" << formatUs(latency.p999Ns)
+        << " max=" << formatUs(latency.maxNs) << "\n";
+
+    if (realtime) {
+        const LatencySummary schedule = lateness.summary();
+        out << "Schedule lateness (us): p50=" << formatUs(schedule.p50Ns)
+            << " p99=" << formatUs(schedule.p99Ns)
+            << " p999=" << formatUs(schedule.p999Ns)
+            << " max=" << formatUs(schedule.maxNs) << "\n";
+    }
+
+    out << outputStats.report() << "\n";
+
+    if (parser.isSet("bench-capture")) {
+        out << "Capture filter: " << QString::number(measureCaptureFilterNs(events, keyMapping), 'f', 1)
+            << " ns/event\n";
+    }
+
+    if (parser.isSet("bench-chords")) {
+        if (benchChords > 0) {
+            addBenchmarkChords(keyMapping, events, benchChords);
+        }
+        out << "Chord and sequence matching: " << QString::number(measureTranslatorNs(events, keyMapping), 'f', 1)
+            << " ns/event over " << keyMapping.getChordMappings().size() << " chords and "
+            << keyMapping.getSequenceMappings().size() << " sequences\n";
+    }
+
+    if (benchHolds > 0) {
+        const LatencySummary holds = measureHoldResolution(benchHolds);
+        out << "Hold resolve lateness (us) at " << BENCH_HOLD_THRESHOLD_MS << " ms: n=" << holds.count
+            << " p50=" << formatUs(holds.p50Ns)
+            << " p99=" << formatUs(holds.p99Ns)
+            << " p999=" << formatUs(holds.p999Ns)
+            << " max=" << formatUs(holds.maxNs) << "\n";
+        out << "Timer wheel: " << QString::number(measureTimerWheelNs(), 'f', 1)
+            << " ns per cancel and reschedule with " << BENCH_WHEEL_TIMEOUTS << " pending\n";
+    }
+
+    if (benchMacros > 0) {
+        int maxVoices = 0;
+        const LatencySummary macros = measureMacroPlayback(benchMacros, maxVoices);
+        out << "Macro event lateness (us) with up to " << maxVoices << " overlapping: n=" << macros.count
+            << " p50=" << formatUs(macros.p50Ns)
+            << " p99=" << formatUs(macros.p99Ns)
+            << " p999=" << formatUs(macros.p999Ns)
+            << " max=" << formatUs(macros.maxNs) << "\n";
+    }
+
+    if (!midiEngine) {
+        out << "Null sink checksum: " << nullSinkChecksum << "\n";
+    }
+
+    return 0;
+}
@@ -0,0 +1,253 @@
+#include "KeyMapping.h"
+#include "TapHoldResolver.h"
+#include "TestSupport.h"
+#include "TimerWheel.h"
+#include <algorithm>
+#include <random>
+#include <vector>
+
+// Tap-or-hold timing. The timer wheel and the resolver run on simulated time, so their
+// guarantees are checked exactly: a timeout never fires before its deadline and never
+// stays pending a whole tick past it, and a key counts as held exactly when it was down
+// for at least its threshold. How late holds resolve in real time depends on the
+// machine, so it is left to `ktomidi-replay --bench-holds` rather than checked here.
+
+namespace {
+    constexpr std::int64_t NS_PER_US = 1000;
+    constexpr std::int64_t NS_PER_MS = 1000000;
+    constexpr std::int64_t WHEEL_TURN_NS = TimerWheel::SLOT_COUNT * TimerWheel::TICK_NS;
+    constexpr unsigned RANDOM_SEED = 20240611;
+
+    constexpr int WHEEL_CAPACITY = 256;
+    constexpr int WHEEL_STEPS = 20000;
+
+    constexpr int RESOLVER_PRESSES = 20000;
+    constexpr int RESOLVER_KEY = 0x41;     // 'A'
+    constexpr int TAP_NOTE = 60;
+    constexpr int HOLD_NOTE = 61;
+
+    // Timeouts fire in the first tick that starts at or after their deadline
+    std::int64_t firstTickNs(std::int64_t deadlineNs)
+    {
+        return (deadlineNs + TimerWheel::TICK_NS - 1) / TimerWheel::TICK_NS * TimerWheel::TICK_NS;
+    }
+
+    struct Timeout {
+        std::int64_t deadlineNs;
+        TimerWheel::Handle handle;
+        bool pending;
+    };
+
+    void checkTimerWheel()
+    {
+        TimerWheel wheel(WHEEL_CAPACITY);
+        std::vector<Timeout> timeouts;
+        std::vector<int> pending;
+        std::mt19937 random(RANDOM_SEED);
+
+        // Odd start so deadlines rarely fall on a tick boundary
+        std::int64_t nowNs = 7 * WHEEL_TURN_NS + 12345;
+        wheel.advance(nowNs, [](std::uint32_t, std::int64_t) {});
+
+        int fired = 0;
+        int earlyFires = 0;
+        int strayFires = 0;
+        int lateTimeouts = 0;
+        int lateNextDeadlines = 0;
+        int failedCancels = 0;
+
+        for (int step = 0; step < WHEEL_STEPS; ++step) {
+            const int action = static_cast<int>(random() % 16);
+
+            if (action < 8 && wheel.pendingCount() < wheel.capacity()) {
+                // Up to three turns ahead, a few already in the past
+                std::uniform_int_distribution<std::int64_t> offsetNs(-NS_PER_MS, 3 * WHEEL_TURN_NS);
+                const std::int64_t deadlineNs = nowNs + offsetNs(random);
+                const int id = static_cast<int>(timeouts.size());
+                const TimerWheel::Handle handle = wheel.schedule(deadlineNs, static_cast<std::uint32_t>(id));
+                CHECK(handle != TimerWheel::INVALID_HANDLE);
+                timeouts.push_back({deadlineNs, handle, true});
+                pending.push_back(id);
+            } else if (action < 10 && !pending.empty()) {
+                const std::size_t index = random() % pending.size();
+                Timeout &timeout = timeouts[pending[index]];
+                if (!wheel.cancel(timeout.handle)) {
+                    ++failedCancels;
+                }
+                timeout.pending = false;
+                pending[index] = pending.back();
+                pending.pop_back();
+            } else {
+                // Mostly short steps, sometimes a jump of more than one turn
+                std::int64_t stepNs = static_cast<std::int64_t>(random() % (300 * NS_PER_US));
+                if (action == 15) {
+                    stepNs = WHEEL_TURN_NS + static_cast<std::int64_t>(random() % (2 * WHEEL_TURN_NS));
+                }
+                nowNs += stepNs;
+
+                wheel.advance(nowNs, [&](std::uint32_t id, std::int64_t deadlineNs) {
+                    if (id >= timeouts.size() || !timeouts[id].pending || timeouts[id].deadlineNs != deadlineNs) {
+                        ++strayFires;
+                        return;
+                    }
+                    if (deadlineNs > nowNs) {
+                        ++earlyFires;
+                    }
+                    timeouts[id].pending = false;
+                    ++fired;
+                });
+                pending.erase(std::remove_if(pending.begin(), pending.end(),
+                                             [&](int id) { return !timeouts[id].pending; }),
+                              pending.end());
+
+                // Anything a whole tick past its deadline should have fired
+                std::int64_t earliestTickNs = TimerWheel::NO_DEADLINE;
+                for (int id : pending) {
+                    if (timeouts[id].deadlineNs + TimerWheel::TICK_NS <= nowNs) {
+                        ++lateTimeouts;
+                    }
+                    earliestTickNs = std::min(earliestTickNs, firstTickNs(timeouts[id].deadlineNs));
+                }
+                if (wheel.nextDeadlineNs() > earliestTickNs) {
+                    ++lateNextDeadlines;
+                }
+            }
+
+            CHECK(wheel.pendingCount() == static_cast<int>(pending.size()));
+        }
+
+        // A fired timeout's handle is spent
+        for (const Timeout &timeout : timeouts) {
+            if (!timeout.pending && wheel.cancel(timeout.handle)) {
+                ++failedCancels;
+            }
+        }
+
+        std::printf("Timer wheel: %d scheduled, %d fired, %d pending\n", static_cast<int>(timeouts.size()), fired,
+                    wheel.pendingCount());
+
+        CHECK(fired > 0);
+        CHECK(earlyFires == 0);
+        CHECK(strayFires == 0);
+        CHECK(lateTimeouts == 0);
+        CHECK(lateNextDeadlines == 0);
+        CHECK(failedCancels == 0);
+    }
+
+    int noteOf(const TapHoldResolver &resolver, int index)
+    {
+        return resolver.messages()[index][1];
+    }
+
+    void checkTapHoldResolver()
+    {
+        KeyMapping keyMapping;
+        KeyMappingEntry entry;
+        entry.vkCode = RESOLVER_KEY;
+        entry.enableHold = true;
+        entry.keyDownMessage.note = TAP_NOTE;
+        entry.holdMessage.note = HOLD_NOTE;
+
+        TapHoldResolver resolver;
+        std::mt19937 random(RANDOM_SEED);
+        std::int64_t pressNs = 3 * NS_PER_MS + 777;
+
+        int taps = 0;
+        int holds = 0;
+        int wrongDecisions = 0;
+        int earlyHolds = 0;
+        int lateHolds = 0;
+        int extraMessages = 0;
+
+        for (int press = 0; press < RESOLVER_PRESSES; ++press) {
+            // A new threshold now and then, so several tables and thresholds are covered
+            if (press % 1000 == 0) {
+                entry.holdThresholdMs = 1 + static_cast<int>(random() % 50);
+                keyMapping.addMapping(entry);
+            }
+            const std::int64_t thresholdNs = entry.holdThresholdMs * NS_PER_MS;
+            const auto table = keyMapping.compiledTable();
+
+            // Within 2 ms either side of the threshold, and exactly on it every so often
+            std::int64_t durationNs = thresholdNs - 2 * NS_PER_MS + static_cast<std::int64_t>(random() % (4 * NS_PER_MS));
+            if (press % 10 == 0) {
+                durationNs = thresholdNs;
+            } else if (press % 10 == 1) {
+                durationNs = thresholdNs - 1;
+            }
+            durationNs = std::max<std::int64_t>(durationNs, 1);
+            const std::int64_t deadlineNs = pressNs + thresholdNs;
+            const std::int64_t releaseNs = pressNs + durationNs;
+
+            CHECK(resolver.process(*table, RESOLVER_KEY, true, false, pressNs));
+            CHECK(resolver.messageCount() == 0);
+            CHECK(resolver.nextDeadlineNs() <= firstTickNs(deadlineNs));
+
+            // The dispatcher runs timeouts at arbitrary moments while the key is down
+            bool heldByTimeout = false;
+            std::int64_t expireNs = pressNs;
+            while (!heldByTimeout) {
+                expireNs += static_cast<std::int64_t>(random() % (3 * TimerWheel::TICK_NS));
+                if (expireNs >= releaseNs) {
+                    break;
+                }
+                if (random() % 4 == 0) {
+                    CHECK(resolver.process(*table, RESOLVER_KEY, true, true, expireNs));
+                    extraMessages += resolver.messageCount();
+                }
+                resolver.expire(expireNs);
+                if (resolver.messageCount() > 0) {
+                    heldByTimeout = true;
+                    if (expireNs < deadlineNs) {
+                        ++earlyHolds;
+                    }
+                    CHECK(resolver.messageCount() == 1 && noteOf(resolver, 0) == HOLD_NOTE);
+                    CHECK(resolver.resolvedCount() == 1 && resolver.resolvedDeadlines()[0] == deadlineNs);
+                } else if (expireNs >= deadlineNs + TimerWheel::TICK_NS) {
+                    ++lateHolds;
+                }
+            }
+
+            CHECK(!resolver.process(*table, RESOLVER_KEY, false, false, releaseNs));
+            bool isHold = heldByTimeout;
+            if (heldByTimeout) {
+                extraMessages += resolver.messageCount();
+            } else if (resolver.messageCount() == 1) {
+                isHold = noteOf(resolver, 0) == HOLD_NOTE;
+            } else {
+                ++wrongDecisions;
+            }
+
+            if (isHold != (durationNs >= thresholdNs)) {
+                ++wrongDecisions;
+            }
+            if (isHold) {
+                ++holds;
+            } else {
+                ++taps;
+            }
+            pressNs = releaseNs + static_cast<std::int64_t>(random() % NS_PER_MS);
+        }
+
+        // A key without a hold mapping is left alone
+        const auto table = keyMapping.compiledTable();
+        CHECK(!resolver.process(*table, RESOLVER_KEY + 1, true, false, pressNs));
+        CHECK(resolver.nextDeadlineNs() == TapHoldResolver::NO_DEADLINE);
+
+        std::printf("Tap-hold resolver: %d taps, %d holds\n", taps, holds);
+
+        CHECK(taps > 0);
+        CHECK(holds > 0);
+        CHECK(wrongDecisions == 0);
+        CHECK(earlyHolds == 0);
+        CHECK(lateHolds == 0);
+        CHECK(extraMessages == 0);
+    }
+}
+
+int main()
+{
+    checkTimerWheel();
+    checkTapHoldResolver();
+    return TestSupport::finish("HoldTimingTest");
+}
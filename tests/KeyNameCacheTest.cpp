@@ -0,0 +1,114 @@
+#include "KeyNameCache.h"
+#include "TestSupport.h"
+#include <memory>
+
+// The cache asks its provider for all 256 names at once and keeps them until the
+// keyboard layout changes, so the GUI never calls into the OS per key press.
+
+namespace {
+    // Names carry the layout they were built for, so a stale table shows
+    class StubKeyNameProvider : public KeyNameProvider
+    {
+    public:
+        quintptr layoutId() const override
+        {
+            return m_layoutId;
+        }
+
+        QString keyName(int vkCode) const override
+        {
+            ++m_nameCalls;
+            return QString("%1/%2").arg(m_layoutId).arg(vkCode);
+        }
+
+        void setLayoutId(quintptr layoutId)
+        {
+            m_layoutId = layoutId;
+        }
+
+        int nameCalls() const
+        {
+            return m_nameCalls;
+        }
+
+    private:
+        quintptr m_layoutId = 1;
+        mutable int m_nameCalls = 0;
+    };
+
+    void checkFallbackNames()
+    {
+        FallbackKeyNameProvider provider;
+        CHECK(provider.layoutId() == 0);
+
+        KeyNameCache cache(std::make_unique<FallbackKeyNameProvider>());
+        for (int vkCode = 0; vkCode < KeyNameCache::KEY_COUNT; ++vkCode) {
+            CHECK(!cache.name(vkCode).isEmpty());
+            CHECK(cache.name(vkCode) == provider.keyName(vkCode));
+        }
+
+        CHECK(cache.name(0x30) == "0");
+        CHECK(cache.name(0x39) == "9");
+        CHECK(cache.name(0x41) == "A");
+        CHECK(cache.name(0x5A) == "Z");
+        CHECK(cache.name(0x60) == "Num 0");
+        CHECK(cache.name(0x69) == "Num 9");
+        CHECK(cache.name(0x70) == "F1");
+        CHECK(cache.name(0x87) == "F24");
+        CHECK(cache.name(0x0D) == "Enter");
+        CHECK(cache.name(0x20) == "Space");
+        CHECK(cache.name(0xA0) == "Left Shift");
+        CHECK(cache.name(0xDC) == "\\");
+        CHECK(cache.name(0x07) == "Unknown Key (VK_7)");
+        CHECK(cache.name(0xFF) == "Unknown Key (VK_255)");
+        CHECK(cache.name(-1) == "Unknown Key (VK_-1)");
+        CHECK(cache.name(KeyNameCache::KEY_COUNT) == "Unknown Key (VK_256)");
+    }
+
+    void checkRebuilds()
+    {
+        auto ownedProvider = std::make_unique<StubKeyNameProvider>();
+        StubKeyNameProvider *provider = ownedProvider.get();
+        KeyNameCache cache(std::move(ownedProvider));
+
+        // Out-of-range codes never build the table
+        cache.name(-1);
+        cache.name(KeyNameCache::KEY_COUNT);
+        CHECK(provider->nameCalls() == 0);
+
+        // Built once on first use, then served from the table
+        CHECK(cache.name(0x41) == "1/65");
+        CHECK(provider->nameCalls() == KeyNameCache::KEY_COUNT);
+        for (int pass = 0; pass < 3; ++pass) {
+            for (int vkCode = 0; vkCode < KeyNameCache::KEY_COUNT; ++vkCode) {
+                CHECK(cache.name(vkCode) == QString("1/%1").arg(vkCode));
+            }
+        }
+        CHECK(provider->nameCalls() == KeyNameCache::KEY_COUNT);
+
+        // A new layout rebuilds the whole table once
+        provider->setLayoutId(2);
+        CHECK(cache.name(0x41) == "2/65");
+        CHECK(cache.name(0x00) == "2/0");
+        CHECK(cache.name(0xFF) == "2/255");
+        CHECK(provider->nameCalls() == 2 * KeyNameCache::KEY_COUNT);
+
+        // Switching back is a change too
+        provider->setLayoutId(1);
+        CHECK(cache.name(0x41) == "1/65");
+        CHECK(provider->nameCalls() == 3 * KeyNameCache::KEY_COUNT);
+
+        // invalidate() rebuilds on the next lookup even with the same layout
+        cache.invalidate();
+        CHECK(provider->nameCalls() == 3 * KeyNameCache::KEY_COUNT);
+        CHECK(cache.name(0x41) == "1/65");
+        CHECK(provider->nameCalls() == 4 * KeyNameCache::KEY_COUNT);
+    }
+}
+
+int main()
+{
+    checkFallbackNames();
+    checkRebuilds();
+    return TestSupport::finish("KeyNameCacheTest");
+}
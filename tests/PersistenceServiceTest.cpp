@@ -0,0 +1,127 @@
+#include "PersistenceService.h"
+#include "TestSupport.h"
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QJsonParseError>
+#include <QTemporaryDir>
+#include <QThread>
+
+// Bursts of saves inside the quiet period must collapse into one write, and whatever is
+// on disk afterwards must be the whole of the last snapshot. Each round makes
+// SAVES_PER_ROUND edits back to back, as fast as a user dragging a slider could, then
+// waits for the debounced write to land.
+
+namespace {
+    constexpr int ROUND_COUNT = 5;
+    constexpr int SAVES_PER_ROUND = 1000;
+    constexpr int QUIET_PERIOD_MS = 250;
+    constexpr int WRITE_TIMEOUT_MS = 5000;
+    constexpr int MAX_WRITES_PER_ROUND = 2;
+    constexpr int MAPPING_COUNT = 500;     // Large enough that a torn write would show
+
+    QJsonDocument makeDocument(int edit)
+    {
+        QJsonArray mappings;
+        for (int i = 0; i < MAPPING_COUNT; ++i) {
+            QJsonObject mapping;
+            mapping["vkCode"] = i % 256;
+            mapping["note"] = (i + edit) % 128;
+            mapping["name"] = QString("Mapping %1").arg(i);
+            mappings.append(mapping);
+        }
+
+        QJsonObject root;
+        root["edit"] = edit;
+        root["mappings"] = mappings;
+        return QJsonDocument(root);
+    }
+
+    enum class FileState {
+        Missing,
+        Complete,
+        Corrupt
+    };
+
+    // The edit number of a complete file is stored in edit
+    FileState readFile(const QString &filename, int *edit)
+    {
+        QFile file(filename);
+        if (!file.open(QIODevice::ReadOnly)) {
+            return FileState::Missing;
+        }
+
+        QJsonParseError error;
+        const QJsonDocument document = QJsonDocument::fromJson(file.readAll(), &error);
+        if (error.error != QJsonParseError::NoError || !document.isObject()
+            || document.object()["mappings"].toArray().size() != MAPPING_COUNT) {
+            return FileState::Corrupt;
+        }
+
+        *edit = document.object()["edit"].toInt(-1);
+        return FileState::Complete;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QTemporaryDir directory;
+    CHECK(directory.isValid());
+    const QString filename = directory.filePath("mappings.json");
+
+    int edit = 0;
+    int writeCount = 0;
+    PersistenceService persistence;
+    persistence.setQuietPeriod(QUIET_PERIOD_MS);
+    persistence.setSnapshotProvider([&]() {
+        ++writeCount;
+        PersistenceService::Snapshot snapshot;
+        snapshot.insert(filename, makeDocument(edit));
+        return snapshot;
+    });
+
+    for (int round = 0; round < ROUND_COUNT; ++round) {
+        const int writesBefore = writeCount;
+
+        QElapsedTimer burst;
+        burst.start();
+        for (int i = 0; i < SAVES_PER_ROUND; ++i) {
+            ++edit;
+            persistence.scheduleSave();
+        }
+        CHECK(burst.elapsed() < QUIET_PERIOD_MS);
+        CHECK(writeCount == writesBefore);
+
+        // The write lands on the I/O thread some time after the quiet period
+        int savedEdit = -1;
+        int corruptReads = 0;
+        QElapsedTimer wait;
+        wait.start();
+        while (savedEdit != edit && wait.elapsed() < WRITE_TIMEOUT_MS) {
+            QCoreApplication::processEvents();
+            if (readFile(filename, &savedEdit) == FileState::Corrupt) {
+                ++corruptReads;
+            }
+            QThread::msleep(1);
+        }
+
+        std::printf("Round %d: %d saves, %d write(s), last edit %d on disk\n", round, SAVES_PER_ROUND,
+                    writeCount - writesBefore, savedEdit);
+
+        CHECK(savedEdit == edit);
+        CHECK(corruptReads == 0);
+        CHECK(writeCount - writesBefore >= 1);
+        CHECK(writeCount - writesBefore <= MAX_WRITES_PER_ROUND);
+    }
+
+    // Nothing is pending, so neither flush() nor the destructor writes again
+    const int writesBefore = writeCount;
+    persistence.flush();
+    CHECK(writeCount == writesBefore);
+
+    return TestSupport::finish("PersistenceServiceTest");
+}
@@ -0,0 +1,282 @@
+#include "KeyEvent.h"
+#include "KeyEventTranslator.h"
+#include "KeyMapping.h"
+#include "MidiEngine.h"
+#include "MidiOutputWorker.h"
+#include "TestSupport.h"
+#include <QCoreApplication>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+#ifdef _MSC_VER
+#include <malloc.h>
+#endif
+
+// Proves that a key event costs no heap allocation on its way to the port: translation
+// against the compiled table, the output queue and the worker thread that drains it into
+// a null sink, the same path the dispatcher and the replay tool use. Allocations on any
+// thread are counted. operator new is replaced everywhere; on glibc malloc, calloc and
+// realloc are replaced too, which Qt's shared library resolves to as well, so Qt's own
+// allocations are counted there. Elsewhere only operator new is seen.
+//
+// A second run sends the same events through MidiEngine::sendMidiBytes to a virtual
+// port. The port watcher and the driver allocate on their own threads, so that run
+// counts the sending thread only; it is skipped where no virtual port can be opened.
+
+namespace {
+    constexpr int WARMUP_EVENT_COUNT = 10000;
+    constexpr int EVENT_COUNT = 1000000;
+    constexpr int ENGINE_EVENT_COUNT = 100000;
+    constexpr std::int64_t EVENT_SPACING_NS = 1000000;
+    constexpr int DRAIN_TIMEOUT_MS = 60000;
+    constexpr int KEY_PAIR_COUNT = 8;
+    constexpr int FIRST_KEY = 0x41;     // 'A'
+    constexpr int EVENTS_PER_GROUP = 5;
+
+    enum Counting {
+        NotCounting,
+        CountAllThreads,
+        CountSendingThread
+    };
+
+    std::atomic<int> g_counting(NotCounting);
+    std::atomic<std::uint64_t> g_allocations(0);
+    thread_local bool t_isSendingThread = false;
+
+    void countAllocation()
+    {
+        const int counting = g_counting.load(std::memory_order_relaxed);
+        if (counting == CountAllThreads || (counting == CountSendingThread && t_isSendingThread)) {
+            g_allocations.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    void *allocate(std::size_t size)
+    {
+#ifndef __GLIBC__
+        countAllocation();     // On glibc the malloc below counts it
+#endif
+        if (void *pointer = std::malloc(size > 0 ? size : 1)) {
+            return pointer;
+        }
+        throw std::bad_alloc();
+    }
+
+    void *allocateAligned(std::size_t size, std::align_val_t alignment)
+    {
+        countAllocation();
+        const std::size_t align = static_cast<std::size_t>(alignment);
+#ifdef _MSC_VER
+        void *pointer = _aligned_malloc(size > 0 ? size : 1, align);
+#else
+        void *pointer = std::aligned_alloc(align, (std::max<std::size_t>(size, 1) + align - 1) / align * align);
+#endif
+        if (pointer) {
+            return pointer;
+        }
+        throw std::bad_alloc();
+    }
+
+    void freeAligned(void *pointer)
+    {
+#ifdef _MSC_VER
+        _aligned_free(pointer);
+#else
+        std::free(pointer);
+#endif
+    }
+
+    void addMappings(KeyMapping *keyMapping)
+    {
+        keyMapping->beginUpdate();
+        for (int i = 0; i < 2 * KEY_PAIR_COUNT; ++i) {
+            KeyMappingEntry entry;
+            entry.vkCode = FIRST_KEY + i;
+            entry.enableKeyUp = true;
+            entry.filterRepeats = false;
+            entry.keyDownMessage.note = 60 + i;
+            entry.keyUpMessage.type = MidiMessage::NOTE_OFF;
+            entry.keyUpMessage.note = 60 + i;
+            keyMapping->addMapping(entry);
+        }
+
+        // The first pair is also a chord and the second a sequence, so both matchers run
+        ChordMappingEntry chord;
+        chord.vkCodes = {FIRST_KEY, FIRST_KEY + 1};
+        chord.withholdKeys = false;
+        chord.keyDownMessage.type = MidiMessage::CONTROL_CHANGE;
+        keyMapping->addChordMapping(chord);
+
+        SequenceMappingEntry sequence;
+        sequence.vkCodes = {FIRST_KEY + 2, FIRST_KEY + 3};
+        MidiMessage message;
+        message.type = MidiMessage::CONTROL_CHANGE;
+        message.controller = 20;
+        sequence.messages.append(message);
+        keyMapping->addSequenceMapping(sequence);
+
+        keyMapping->endUpdate();
+    }
+
+    // Each group holds two keys at once: press, auto-repeat, second press, two releases
+    KeyEvent eventAt(int index)
+    {
+        const int group = index / EVENTS_PER_GROUP;
+        const int first = FIRST_KEY + 2 * (group % KEY_PAIR_COUNT);
+
+        KeyEvent event;
+        switch (index % EVENTS_PER_GROUP) {
+            case 0: event = KeyEvent(first, true, false); break;
+            case 1: event = KeyEvent(first, true, true); break;
+            case 2: event = KeyEvent(first + 1, true, false); break;
+            case 3: event = KeyEvent(first, false, false); break;
+            default: event = KeyEvent(first + 1, false, false); break;
+        }
+        event.timestampNs = index * EVENT_SPACING_NS;
+        return event;
+    }
+}
+
+#ifdef __GLIBC__
+extern "C" {
+    void *__libc_malloc(std::size_t size);
+    void *__libc_calloc(std::size_t count, std::size_t size);
+    void *__libc_realloc(void *pointer, std::size_t size);
+
+    // glibc's own allocator underneath, so its free() and aligned_alloc() still match
+    void *malloc(std::size_t size) noexcept
+    {
+        countAllocation();
+        return __libc_malloc(size);
+    }
+
+    void *calloc(std::size_t count, std::size_t size) noexcept
+    {
+        countAllocation();
+        return __libc_calloc(count, size);
+    }
+
+    void *realloc(void *pointer, std::size_t size) noexcept
+    {
+        countAllocation();
+        return __libc_realloc(pointer, size);
+    }
+}
+#endif
+
+void *operator new(std::size_t size) { return allocate(size); }
+void *operator new[](std::size_t size) { return allocate(size); }
+void *operator new(std::size_t size, std::align_val_t alignment) { return allocateAligned(size, alignment); }
+void *operator new[](std::size_t size, std::align_val_t alignment) { return allocateAligned(size, alignment); }
+void operator delete(void *pointer) noexcept { std::free(pointer); }
+void operator delete[](void *pointer) noexcept { std::free(pointer); }
+void operator delete(void *pointer, std::size_t) noexcept { std::free(pointer); }
+void operator delete[](void *pointer, std::size_t) noexcept { std::free(pointer); }
+void operator delete(void *pointer, std::align_val_t) noexcept { freeAligned(pointer); }
+void operator delete[](void *pointer, std::align_val_t) noexcept { freeAligned(pointer); }
+void operator delete(void *pointer, std::size_t, std::align_val_t) noexcept { freeAligned(pointer); }
+void operator delete[](void *pointer, std::size_t, std::align_val_t) noexcept { freeAligned(pointer); }
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    t_isSendingThread = true;
+
+    KeyMapping keyMapping;
+    addMappings(&keyMapping);
+    KeyEventTranslator translator;
+
+    std::atomic<std::uint64_t> delivered(0);
+    MidiOutputWorker worker([&delivered](const MidiBytes *, int count) {
+        delivered.fetch_add(static_cast<std::uint64_t>(count), std::memory_order_relaxed);
+    });
+    worker.start();
+
+    std::uint64_t queued = 0;
+    auto sendToWorker = [&](const MidiBytes &message, bool isRepeat, std::int64_t captureNs) {
+        if (worker.enqueue(message, isRepeat, captureNs)) {
+            ++queued;
+        }
+    };
+
+    // Same steps as KeyEventDispatcher::handleEvent and expireTimeouts
+    auto runEvents = [&](int begin, int end, auto &&send) {
+        for (int index = begin; index < end; ++index) {
+            const KeyEvent event = eventAt(index);
+            const std::int64_t captureNs = EngineClock::nowNs();
+            if (translator.nextDeadlineNs() <= event.timestampNs) {
+                translator.expire(event.timestampNs);
+                for (int i = 0; i < translator.messageCount(); ++i) {
+                    send(translator.messages()[i], false, 0);
+                }
+            }
+            {
+                const auto table = keyMapping.compiledTable();
+                translator.process(*table, event);
+            }
+            for (int i = 0; i < translator.messageCount(); ++i) {
+                send(translator.messages()[i], event.isRepeat, captureNs);
+            }
+        }
+    };
+
+    // Lazily created state (thread-locals, first semaphore waits) is not the hot path
+    runEvents(0, WARMUP_EVENT_COUNT, sendToWorker);
+    CHECK(worker.waitForIdle(DRAIN_TIMEOUT_MS));
+
+    g_counting.store(CountAllThreads);
+    runEvents(WARMUP_EVENT_COUNT, WARMUP_EVENT_COUNT + EVENT_COUNT, sendToWorker);
+    const bool drained = worker.waitForIdle(DRAIN_TIMEOUT_MS);
+    g_counting.store(NotCounting);
+
+    const std::uint64_t allocations = g_allocations.load();
+    std::printf("%d events, %llu messages sent, %llu allocations\n", EVENT_COUNT,
+                static_cast<unsigned long long>(delivered.load()), static_cast<unsigned long long>(allocations));
+
+    CHECK(drained);
+    CHECK(allocations == 0);
+    CHECK(queued >= static_cast<std::uint64_t>(EVENT_COUNT));
+    CHECK(delivered.load() == queued);
+
+    worker.stop();
+
+    MidiEngine engine;
+    engine.setOverflowPolicy(MidiOutputWorker::Block);
+    engine.setControlCoalesceWindowMs(0);
+    if (!engine.supportsVirtualPorts() || !engine.openVirtualPort("KtoMIDI Allocation Test")) {
+        std::printf("No virtual MIDI port, skipping the MidiEngine run\n");
+        return TestSupport::finish("SendPathAllocationTest");
+    }
+
+    auto sendToEngine = [&engine](const MidiBytes &message, bool isRepeat, std::int64_t captureNs) {
+        engine.sendMidiBytes(message, isRepeat, captureNs);
+    };
+
+    const int engineBegin = WARMUP_EVENT_COUNT + EVENT_COUNT;
+    runEvents(engineBegin, engineBegin + WARMUP_EVENT_COUNT, sendToEngine);
+    CHECK(engine.waitForOutputIdle(DRAIN_TIMEOUT_MS));
+
+    const MidiOutputStats before = engine.outputStats();
+    g_allocations.store(0);
+    g_counting.store(CountSendingThread);
+    runEvents(engineBegin + WARMUP_EVENT_COUNT, engineBegin + WARMUP_EVENT_COUNT + ENGINE_EVENT_COUNT,
+              sendToEngine);
+    g_counting.store(NotCounting);
+    const bool engineDrained = engine.waitForOutputIdle(DRAIN_TIMEOUT_MS);
+
+    const std::uint64_t engineAllocations = g_allocations.load();
+    const std::uint64_t engineSent = engine.outputStats().sent - before.sent;
+    std::printf("%d events through MidiEngine, %llu messages sent, %llu allocations on the sending thread\n",
+                ENGINE_EVENT_COUNT, static_cast<unsigned long long>(engineSent),
+                static_cast<unsigned long long>(engineAllocations));
+
+    CHECK(engineDrained);
+    CHECK(engineAllocations == 0);
+    CHECK(engineSent >= static_cast<std::uint64_t>(ENGINE_EVENT_COUNT));
+
+    engine.closePort();
+    return TestSupport::finish("SendPathAllocationTest");
+}
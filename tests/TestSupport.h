@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdio>
+
+// Checks for the engine tests. Each test is a plain executable run by ctest; a failed
+// check is reported with its location and makes the test exit non-zero, but the
+// remaining checks still run.
+namespace TestSupport {
+
+inline int &failureCount()
+{
+    static int count = 0;
+    return count;
+}
+
+inline void check(bool passed, const char *expression, const char *file, int line)
+{
+    if (!passed) {
+        std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expression);
+        ++failureCount();
+    }
+}
+
+// Returns the exit code for main()
+inline int finish(const char *testName)
+{
+    if (failureCount() > 0) {
+        std::fprintf(stderr, "%s: %d check(s) failed\n", testName, failureCount());
+        return 1;
+    }
+    std::printf("%s: passed\n", testName);
+    return 0;
+}
+
+}
+
+#define CHECK(condition) TestSupport::check((condition), #condition, __FILE__, __LINE__)